@@ -7,9 +7,12 @@
 
 #include "settings/RecordingSettingsDialog.hpp"
 #include <kali-core/stateMachineEvents.hpp>
+#include <kali-core/CaptureTracer.hpp>
+#include <kali-core/FastLink.hpp>
 
 #include <kali-core/VideoPlayer.hpp>
 #include <kali-core/KaliscopeEngine.hpp>
+#include <kali-core/RealtimeThread.hpp>
 #include <kali-core/settingsTools.hpp>
 #include <mvp-player-core/MVPPlayerEngine.hpp>
 #include <mvp-player-core/MVPPlayerLogic.hpp>
@@ -71,6 +74,7 @@ bool editPipelineSettings( QMainWindow *caller, mvpplayer::Settings & settings )
 int main( int argc, char **argv )
 {
     mvpplayer::Settings::getInstance().read( QDir::homePath().toStdString() + "/" + kaliscope::kDefaultSettingsFilename );
+    kaliscope::setupMemoryLock();
     using namespace mvpplayer;
     {
         boost::optional<std::string> envStr = boost::get_env( kaliscope::kKaliscopePluginEnvKey );
@@ -120,6 +124,18 @@ int main( int argc, char **argv )
 
     // Network remote for synchronization (raspberry pi for example)
     mvpplayer::network::client::Client remote;
+    // Binary link for the high frequency events, the text protocol is used when unavailable
+    kaliscope::FastLinkClient fastLink;
+    const auto sendToRemote =
+        [&remote, &fastLink]( mvpplayer::IEvent & event )
+        {
+            if ( !fastLink.sendEvent( event ) )
+            {
+                remote.sendEvent( event );
+            }
+        };
+    // Traces the capture latency of frames triggered by the remote
+    kaliscope::CaptureTracer captureTracer;
 
     // Presenter (presenter: logic-glu between model and view)
     mvpplayer::logic::MVPPlayerPresenter presenter;
@@ -144,12 +160,27 @@ int main( int argc, char **argv )
         // Settings editor binding
         dlg.signalViewHitEditSettings.connect( boost::bind( &editSettings, &dlg, boost::ref( playerEngine ), boost::ref( dlg ), boost::ref( presenter ) ) );
 
+        // Adopt capture traces sent along with the capture triggers
+        // (connected first: the presenter's state machine owns the event afterwards)
+        const auto adoptCaptureTrace =
+            [&captureTracer]( mvpplayer::IEvent & event )
+            {
+                if ( const kaliscope::logic::EvCaptureTrace *traceEvent = dynamic_cast<const kaliscope::logic::EvCaptureTrace*>( &event ) )
+                {
+                    captureTracer.adopt( traceEvent->trace() );
+                }
+            };
+        // The remote sends each event thru one protocol: the binary link while
+        // it is up, the text one otherwise
+        remote.signalEvent.connect( adoptCaptureTrace );
+        fastLink.signalEvent.connect( adoptCaptureTrace );
         // Transfer events received from the network to the presenter's state machine
         remote.signalEvent.connect( boost::bind( &mvpplayer::logic::MVPPlayerPresenter::processEvent, &presenter, _1 ) );
+        fastLink.signalEvent.connect( boost::bind( &mvpplayer::logic::MVPPlayerPresenter::processEvent, &presenter, _1 ) );
 
         // Network setup
         dlg.signalViewConnect.connect(
-            [&remote, &dlg]()
+            [&remote, &fastLink, &dlg]()
             {
                 static QString serverIP = "192.168.1.72";
                 bool ok = false;
@@ -157,20 +188,68 @@ int main( int argc, char **argv )
                 if ( ok )
                 {
                     remote.connect( serverIP.toStdString() );
+                    fastLink.connect( serverIP.toStdString() );
                 }
             }
         );
+        dlg.signalViewDisconnect.connect( boost::bind( &kaliscope::FastLinkClient::disconnect, &fastLink ) );
         dlg.signalViewDisconnect.connect( boost::bind( &mvpplayer::network::client::Client::disconnect, &remote ) );
 
         // Bind 'frame ready' signal to display function
         playerEngine.signalFrameReady.connect( boost::bind( &Dialog::displayFrame, &dlg, _1, _2 ) );
+        playerEngine.signalFrameComputeStarted.connect(
+            [&captureTracer]( const std::size_t )
+            { captureTracer.mark( kaliscope::eCaptureStageComputeStart ); }
+        );
+        // Tell the remote which capture a frame belongs to, frames not triggered
+        // by the remote (no capture trace) are reported without correlation id
+        const auto sendCaptureProgress =
+            [&sendToRemote]( const std::string & action, const boost::uint64_t correlationId )
+            {
+                if ( correlationId )
+                {
+                    kaliscope::logic::EvCaptureProgress event( action, correlationId );
+                    sendToRemote( event );
+                }
+                else
+                {
+                    mvpplayer::logic::EvCustomState event( action );
+                    sendToRemote( event );
+                }
+            };
+        // Used to signalize that the film can move while the frame is processed
+        playerEngine.signalExposureComplete.connect(
+            [&sendCaptureProgress, &captureTracer]( const std::size_t )
+            {
+                const boost::uint64_t correlationId = captureTracer.mark( kaliscope::eCaptureStageExposureDone );
+                sendCaptureProgress( kaliscope::kExposureCompleteCustomStateAction, correlationId );
+            }
+        );
         // Used to signalize that a frame has been processed
         playerEngine.signalFrameReady.connect(
-            [&remote]( const std::size_t, const kaliscope::DefaultImageT )
+            [&sendCaptureProgress, &captureTracer]( const std::size_t, const kaliscope::DefaultImageT )
             {
-                using EventT = mvpplayer::logic::EvCustomState;
-                EventT event( kaliscope::kFrameCapturedCustomStateAction );
-                remote.sendEvent( event );
+                const boost::uint64_t correlationId = captureTracer.mark( kaliscope::eCaptureStageComputeDone );
+                sendCaptureProgress( kaliscope::kFrameCapturedCustomStateAction, correlationId );
+            }
+        );
+        // Send the capture trace back once the frame is displayed
+        dlg.viewer()->signalFrameDone.connect(
+            [&sendToRemote, &captureTracer]( const std::size_t )
+            {
+                captureTracer.mark( kaliscope::eCaptureStageDisplayDone );
+                const kaliscope::CaptureTrace trace = captureTracer.finish();
+                if ( trace.correlationId )
+                {
+                    kaliscope::logic::EvCaptureTrace event( trace );
+                    sendToRemote( event );
+                    // Give the trigger credit back to the remote, with the queue state
+                    const kaliscope::FlowState state( captureTracer.queueDepth(),
+                                                      mvpplayer::Settings::getInstance().get<int>( "flowControl", "window", kaliscope::kDefaultFlowWindow ),
+                                                      trace.correlationId );
+                    kaliscope::logic::EvFlowControl flowEvent( state );
+                    sendToRemote( flowEvent );
+                }
             }
         );
         dlg.viewer()->signalFrameDone.connect( boost::bind( &kaliscope::KaliscopeEngine::frameProcessed, &playerEngine, _1 ) );
@@ -195,9 +274,13 @@ int main( int argc, char **argv )
 
     // the following needs to be reviewed, it seems that boost::trackable has no effect on Qt objects
     dlg.viewer()->signalFrameDone.disconnect_all_slots();
+    playerEngine.signalFrameComputeStarted.disconnect_all_slots();
+    playerEngine.signalExposureComplete.disconnect_all_slots();
     playerEngine.signalFrameReady.disconnect_all_slots();
     presenter.signalEvent.disconnect_all_slots();
     remote.signalEvent.disconnect_all_slots();
+    fastLink.signalEvent.disconnect_all_slots();
+    fastLink.disconnect();
     app.processEvents();
     // Unload plugins
     mvpplayer::plugins::PluginLoader::getInstance().unloadPlugins();
@@ -5,6 +5,9 @@
 
 #include "GpioWatcher.hpp"
 
+#include <kali-core/CaptureTracer.hpp>
+#include <kali-core/RealtimeThread.hpp>
+
 #include <mvp-player-core/Settings.hpp>
 
 #include <boost/format.hpp>
@@ -149,13 +152,23 @@ void GpioWatcher::worker()
     if ( _stop )
     { return; }
 
+    setupThreadRole( eThreadRoleSensor );
+    ThreadJitterMonitor & jitterMonitor = ThreadJitterMonitor::getInstance();
+
     bool lastValue = false;
     _stop = !getValGpio( lastValue );
     signalGpioValueChanged( _gpioId, lastValue );
 
     while( !_stop )
     {
-        std::this_thread::sleep_for( std::chrono::microseconds( _microsecDelay ) );
+        // Without delay the pin is polled as fast as possible: there is no
+        // wake up to measure
+        if ( _microsecDelay > 0 )
+        {
+            const boost::int64_t sleepStart = captureTimestamp();
+            std::this_thread::sleep_for( std::chrono::microseconds( _microsecDelay ) );
+            jitterMonitor.add( eThreadRoleSensor, captureTimestamp() - sleepStart - boost::int64_t( _microsecDelay ) );
+        }
         bool gpioValue = false;
         if ( getValGpio( gpioValue ) )
         {
@@ -193,8 +206,12 @@ void GpioWatcher::startWatching( const std::size_t microsecDelay )
 void GpioWatcher::stop()
 {
     _stop = true;
-    _watcherThread->join();
-    unexportGpio();
+    if ( _watcherThread )
+    {
+        _watcherThread->join();
+        _watcherThread.reset();
+        unexportGpio();
+    }
 }
 
 }
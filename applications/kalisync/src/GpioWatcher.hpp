@@ -55,27 +55,27 @@ public:
      * @brief export gpio for further use
      * @return false if failure, true otherwise
      */
-    bool exportGpio();
+    virtual bool exportGpio();
 
     /**
      * @brief unexport (release) gpio
      * @return false if failure, true otherwise
      */
-    bool unexportGpio();
+    virtual bool unexportGpio();
 
     /**
      * @brief set gpio direction
      * @param dir[in] { out, in }
      * @return false if failure, true otherwise
      */
-    bool setDirGpio( const std::string & dir );
+    virtual bool setDirGpio( const std::string & dir );
 
     /**
      * @brief set gpio value
      * @param value true or false
      * @return false if failure, true otherwise
      */
-    bool setValGpio( const bool value ); // Set GPIO Value (putput pins)
+    virtual bool setValGpio( const bool value ); // Set GPIO Value (putput pins)
 
     /**
      * @brief toggle gpio value
@@ -87,7 +87,7 @@ public:
      * @param val[out] output value
      * @return false if failure, true otherwise
      */
-    bool getValGpio( bool & val );
+    virtual bool getValGpio( bool & val );
 
 protected:
     /**
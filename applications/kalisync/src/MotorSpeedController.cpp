@@ -0,0 +1,283 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "MotorSpeedController.hpp"
+
+#include <kali-core/CaptureTracer.hpp>
+#include <kali-core/RealtimeThread.hpp>
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace kaliscope
+{
+
+namespace
+{
+// Smoothing of the measurements
+static const double kSmoothing = 0.3;
+
+inline void smooth( double & value, const double measure )
+{
+    value = value < 0 ? measure : value + kSmoothing * ( measure - value );
+}
+}
+
+MotorSpeedController::MotorSpeedController( GpioWatcher & motor, const int pwmPeriod, const int rampTime, const double minDuty, const double approach, const double margin )
+: _motor( motor )
+, _pwmPeriod( std::max( pwmPeriod, 100 ) )
+, _rampTime( boost::int64_t( std::max( rampTime, 0 ) ) * 1000 )
+, _minDuty( std::min( std::max( minDuty, 0.01 ), 1.0 ) )
+, _approachStart( 1.0 - std::min( std::max( approach, 0.0 ), 1.0 ) )
+, _margin( std::max( margin, 0.0 ) )
+{
+}
+
+MotorSpeedController::~MotorSpeedController()
+{
+    stop();
+}
+
+/**
+ * @brief start the PWM thread
+ */
+void MotorSpeedController::start()
+{
+    if ( _pwmThread )
+    {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _stop = false;
+    }
+    _pwmThread.reset( new std::thread( &MotorSpeedController::pwmWork, this ) );
+}
+
+/**
+ * @brief stop the PWM thread (motor is stopped)
+ */
+void MotorSpeedController::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _stop = true;
+        ++_generation;
+    }
+    _stateChanged.notify_all();
+    if ( _pwmThread )
+    {
+        _pwmThread->join();
+        _pwmThread.reset();
+    }
+}
+
+/**
+ * @brief frame has been captured, move to the next one
+ */
+void MotorSpeedController::release()
+{
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        const boost::int64_t now = captureTimestamp();
+        if ( _holdStart >= 0 )
+        {
+            smooth( _holdTime, now - _holdStart );
+            _holdStart = -1;
+        }
+        _running = true;
+        _releaseTime = now;
+        _distance = 0;
+        ++_generation;
+    }
+    _stateChanged.notify_all();
+}
+
+/**
+ * @brief next frame is in the gate, stop now
+ */
+void MotorSpeedController::hold()
+{
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        const boost::int64_t now = captureTimestamp();
+        setMotor( false );
+        if ( _running && _releaseTime >= 0 )
+        {
+            adapt( now - _releaseTime );
+        }
+        _running = false;
+        _holdStart = now;
+        ++_generation;
+    }
+    _stateChanged.notify_all();
+}
+
+/**
+ * @brief stop the transport (capture stopped)
+ */
+void MotorSpeedController::halt()
+{
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        setMotor( false );
+        _running = false;
+        _releaseTime = -1;
+        _holdStart = -1;
+        ++_generation;
+    }
+    _stateChanged.notify_all();
+}
+
+/**
+ * @brief processing time of a frame, as traced by kaliscope
+ * @param latency[in] microseconds
+ */
+void MotorSpeedController::setProcessingLatency( const boost::int64_t latency )
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    smooth( _processingLatency, double( latency ) );
+}
+
+/**
+ * @brief how full kaliscope's queue is
+ * The transport slows down smoothly when the queue is more than half full.
+ * @param fill[in] 0 (empty) to 1 (full)
+ */
+void MotorSpeedController::setFlowFill( const double fill )
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    _flowFactor = std::min( std::max( 2.0 * ( 1.0 - fill ), 0.0 ), 1.0 );
+}
+
+/**
+ * @brief adapt the cruise duty to the measured travel time
+ */
+void MotorSpeedController::adapt( const boost::int64_t travelTime )
+{
+    smooth( _travelTime, double( travelTime ) );
+    smooth( _frameDistance, _distance );
+
+    // The flow control is slowing the film down, the travel time is not the cruise one
+    if ( _flowFactor < 1.0 )
+    {
+        return;
+    }
+
+    if ( _processingLatency <= 0 )
+    {
+        // No report from kaliscope yet: full speed
+        _cruiseDuty = 1.0;
+        return;
+    }
+
+    // The film may move while kaliscope processes the previous frame,
+    // a frame period (hold + travel) shall not be shorter than the processing
+    const double targetTravel = _processingLatency * ( 1.0 + _margin ) - std::max( _holdTime, 0.0 );
+    if ( targetTravel <= 0 )
+    {
+        _cruiseDuty = 1.0;
+        return;
+    }
+    // Speed is about proportional to the duty, damped correction
+    const double correction = std::sqrt( std::min( std::max( travelTime / targetTravel, 0.25 ), 4.0 ) );
+    _cruiseDuty = std::min( std::max( _cruiseDuty * correction, _minDuty ), 1.0 );
+}
+
+/**
+ * @brief duty of the current time (ramp, cruise or approach)
+ */
+double MotorSpeedController::duty( const boost::int64_t now ) const
+{
+    if ( !_running )
+    {
+        return 0.0;
+    }
+    const double cruiseDuty = std::max( _cruiseDuty * _flowFactor, _minDuty );
+    // Approaching the next frame
+    if ( _frameDistance > 0 && _distance >= _approachStart * _frameDistance )
+    {
+        return std::min( _minDuty, cruiseDuty );
+    }
+    // Acceleration ramp
+    if ( _rampTime > 0 )
+    {
+        const double ramp = _minDuty + double( now - _releaseTime ) / _rampTime;
+        return std::min( ramp, cruiseDuty );
+    }
+    return cruiseDuty;
+}
+
+void MotorSpeedController::setMotor( const bool on )
+{
+    // Avoid useless gpio writes
+    if ( on != _motorOn )
+    {
+        _motor.setValGpio( on );
+        _motorOn = on;
+    }
+}
+
+/**
+ * @brief PWM work
+ */
+void MotorSpeedController::pwmWork()
+{
+    setupThreadRole( eThreadRoleMotor );
+    ThreadJitterMonitor & jitterMonitor = ThreadJitterMonitor::getInstance();
+
+    std::unique_lock<std::mutex> lock( _mutex );
+    while( !_stop )
+    {
+        if ( !_running )
+        {
+            setMotor( false );
+            _stateChanged.wait( lock, [this]() { return _running || _stop; } );
+            continue;
+        }
+
+        const std::size_t generation = _generation;
+        const auto changed = [this, generation]() { return _generation != generation; };
+        const boost::int64_t cycleStart = captureTimestamp();
+        const double cycleDuty = duty( cycleStart );
+        const boost::int64_t onTime = boost::int64_t( cycleDuty * _pwmPeriod );
+        if ( onTime > 0 )
+        {
+            setMotor( true );
+            if ( _stateChanged.wait_for( lock, std::chrono::microseconds( onTime ), changed ) )
+            {
+                continue;
+            }
+            // Late edges distort the duty
+            jitterMonitor.add( eThreadRoleMotor, captureTimestamp() - cycleStart - onTime );
+        }
+        if ( onTime < _pwmPeriod )
+        {
+            setMotor( false );
+            if ( _stateChanged.wait_for( lock, std::chrono::microseconds( _pwmPeriod - onTime ), changed ) )
+            {
+                continue;
+            }
+            jitterMonitor.add( eThreadRoleMotor, captureTimestamp() - cycleStart - _pwmPeriod );
+        }
+        _distance += cycleDuty * ( captureTimestamp() - cycleStart );
+    }
+    setMotor( false );
+}
+
+/**
+ * @brief get a printable state of the controller
+ */
+std::string MotorSpeedController::str()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    return ( boost::format( "Speed control: cruise duty %1$.2f (flow %5$.2f), travel %2$.1fms, hold %3$.1fms, processing %4$.1fms" )
+             % _cruiseDuty % ( _travelTime / 1000.0 ) % ( _holdTime / 1000.0 ) % ( _processingLatency / 1000.0 ) % _flowFactor ).str();
+}
+
+}
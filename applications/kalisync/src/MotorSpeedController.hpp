@@ -0,0 +1,134 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_MOTORSPEEDCONTROLLER_HPP_
+#define	_KALI_MOTORSPEEDCONTROLLER_HPP_
+
+#include "GpioWatcher.hpp"
+
+#include <boost/cstdint.hpp>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace kaliscope
+{
+
+/**
+ * @brief closed loop speed controller of the film transport
+ * The motor pin is driven with a software PWM. After each capture the motor
+ * ramps up to a cruise duty, and slows down to the approach duty when the next
+ * frame is expected, so that it stops on the sensor edge without overshooting.
+ * The cruise duty is adapted after each frame so that a frame period matches
+ * the processing time reported by kaliscope: the film goes as fast as the
+ * pipeline can sustain.
+ */
+class MotorSpeedController
+{
+public:
+    /**
+     * @brief constructor
+     * @param motor[in] motor pin
+     * @param pwmPeriod[in] PWM period (microseconds)
+     * @param rampTime[in] time to ramp from stop to full speed (milliseconds)
+     * @param minDuty[in] minimal duty moving the film, used on approach
+     * @param approach[in] part of a frame travelled at the approach duty (should cover the stopping distance)
+     * @param margin[in] frame period margin over the processing time (ratio)
+     */
+    MotorSpeedController( GpioWatcher & motor, const int pwmPeriod, const int rampTime, const double minDuty, const double approach, const double margin );
+    ~MotorSpeedController();
+
+    /**
+     * @brief start the PWM thread
+     */
+    void start();
+
+    /**
+     * @brief stop the PWM thread (motor is stopped)
+     */
+    void stop();
+
+    /**
+     * @brief frame has been captured, move to the next one
+     */
+    void release();
+
+    /**
+     * @brief next frame is in the gate, stop now
+     */
+    void hold();
+
+    /**
+     * @brief stop the transport (capture stopped)
+     */
+    void halt();
+
+    /**
+     * @brief processing time of a frame, as traced by kaliscope
+     * @param latency[in] microseconds
+     */
+    void setProcessingLatency( const boost::int64_t latency );
+
+    /**
+     * @brief how full kaliscope's queue is
+     * The transport slows down smoothly when the queue is more than half full.
+     * @param fill[in] 0 (empty) to 1 (full)
+     */
+    void setFlowFill( const double fill );
+
+    /**
+     * @brief get a printable state of the controller
+     */
+    std::string str();
+
+private:
+    /**
+     * @brief PWM work
+     */
+    void pwmWork();
+
+    /**
+     * @brief duty of the current time (ramp, cruise or approach)
+     */
+    double duty( const boost::int64_t now ) const;
+
+    /**
+     * @brief adapt the cruise duty to the measured travel time
+     */
+    void adapt( const boost::int64_t travelTime );
+
+    void setMotor( const bool on );
+
+private:
+    GpioWatcher & _motor;                       ///< Motor pin
+    const boost::int64_t _pwmPeriod;            ///< PWM period (microseconds)
+    const boost::int64_t _rampTime;             ///< Stop to full speed time (microseconds)
+    const double _minDuty;                      ///< Approach duty
+    const double _approachStart;                ///< Part of a frame travelled before the approach
+    const double _margin;                       ///< Frame period margin (ratio)
+    std::mutex _mutex;                          ///< Mutex thread
+    std::condition_variable _stateChanged;      ///< Signalize release/hold
+    bool _stop = true;                          ///< Stops PWM thread
+    bool _running = false;                      ///< Is the film moving
+    bool _motorOn = false;                      ///< Motor pin value
+    std::size_t _generation = 0;                ///< Incremented on each state change
+    double _cruiseDuty = 1.0;                   ///< Adapted cruise duty
+    double _flowFactor = 1.0;                   ///< Cruise duty factor given by the flow control
+    boost::int64_t _releaseTime = -1;           ///< Last release time
+    boost::int64_t _holdStart = -1;             ///< Last hold time (frame in the gate)
+    double _travelTime = -1;                    ///< Smoothed travel time (microseconds)
+    double _holdTime = -1;                      ///< Smoothed hold time (microseconds)
+    double _processingLatency = -1;             ///< Smoothed processing time (microseconds)
+    double _distance = 0;                       ///< Distance since release (duty x microseconds)
+    double _frameDistance = -1;                 ///< Smoothed distance between two frames
+    std::unique_ptr<std::thread> _pwmThread;    ///< PWM thread
+};
+
+}
+
+#endif
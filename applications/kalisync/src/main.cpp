@@ -4,10 +4,19 @@
  */
 
 #include "GpioWatcher.hpp"
+#include "MotorSpeedController.hpp"
 #include "projector/IProjector.hpp"
 #include "projector/TinyDisplayProjector.hpp"
+#include "projector/MemoryFramebuffer.hpp"
+#include "projector/SimulatedProjector.hpp"
+#include "simulation/SimulatedGpio.hpp"
+#include "simulation/FilmTransportSimulator.hpp"
 
 #include <kali-core/stateMachineEvents.hpp>
+#include <kali-core/CaptureTracer.hpp>
+#include <kali-core/FastLink.hpp>
+#include <kali-core/FlowControl.hpp>
+#include <kali-core/RealtimeThread.hpp>
 
 #include <mvp-player-net/server/Server.hpp>
 #include <mvp-player-core/stateMachineEvents.hpp>
@@ -20,6 +29,7 @@
 #include <boost/program_options.hpp>
 #include <boost/format.hpp>
 #include <boost/exception/all.hpp>
+#include <atomic>
 #include <thread>
 #include <chrono>
 
@@ -28,6 +38,8 @@ namespace bfs = boost::filesystem;
 
 static const char * kServerPortOptionString( "port" );
 static const char * kServerPortOptionMessage( "Port for network server" );
+static const char * kFastLinkPortOptionString( "fastLinkPort" );
+static const char * kFastLinkPortOptionMessage( "Port for the binary event link (text events are used if kaliscope doesn't connect to it)" );
 static const char * kWatchInputPinOptionString( "watch" );
 static const char * kWatchInputPinOptionMessage( "Watch input pin (gpio id)" );
 static const char * kMotorPinOptionString( "motorPin" );
@@ -36,8 +48,43 @@ static const char * kFlashPinOptionString( "flashPin" );
 static const char * kFlashPinOptionMessage( "Flash pin (gpio id)" );
 static const char * kGpioDelayOptionString( "gpioDelay" );
 static const char * kGpioDelayOptionMessage( "Next gpio event delay (40 is a good value)" );
+static const char * kSensorPollOptionString( "sensorPoll" );
+static const char * kSensorPollOptionMessage( "Delay between two reads of the watched pin (microseconds, 0 polls continuously)" );
 static const char * kUseTinyDisplayOptionString( "useTinyDisplay" );
 static const char * kUseTinyDisplayOptionMessage( "Use tiny display as projector (need FBTFT driver)" );
+static const char * kFakeTinyDisplayOptionString( "fakeTinyDisplay" );
+static const char * kFakeTinyDisplayOptionMessage( "Use a memory framebuffer instead of the tiny display (no FBTFT driver needed)" );
+static const char * kSpeedControlOptionString( "speedControl" );
+static const char * kSpeedControlOptionMessage( "Drive the motor with the closed loop speed controller (PWM) instead of on/off" );
+static const char * kPwmPeriodOptionString( "pwmPeriod" );
+static const char * kPwmPeriodOptionMessage( "Motor PWM period (microseconds)" );
+static const char * kRampTimeOptionString( "rampTime" );
+static const char * kRampTimeOptionMessage( "Motor acceleration ramp, from stop to full speed (milliseconds)" );
+static const char * kMinDutyOptionString( "minDuty" );
+static const char * kMinDutyOptionMessage( "Lowest motor duty moving the film, used to approach the next frame (0..1)" );
+static const char * kApproachOptionString( "approach" );
+static const char * kApproachOptionMessage( "Part of a frame travelled at the lowest duty before the sensor edge (0..1, covers the stopping distance)" );
+static const char * kCadenceMarginOptionString( "cadenceMargin" );
+static const char * kCadenceMarginOptionMessage( "Frame period margin over the kaliscope processing time (ratio)" );
+static const char * kSimulateOptionString( "simulate" );
+static const char * kSimulateOptionMessage( "Simulate the film transport, pins and projector (no hardware needed)" );
+static const char * kSimRateOptionString( "simRate" );
+static const char * kSimRateOptionMessage( "Simulated transport speed (frames per second while the motor runs)" );
+static const char * kSimJitterOptionString( "simJitter" );
+static const char * kSimJitterOptionMessage( "Simulated frame period jitter (standard deviation, ratio of the period)" );
+static const char * kSimTimeoutOptionString( "simTimeout" );
+static const char * kSimTimeoutOptionMessage( "Simulated frames held longer than this are dropped (milliseconds)" );
+static const char * kSimInertiaOptionString( "simInertia" );
+static const char * kSimInertiaOptionMessage( "Simulated transport inertia (speed time constant in milliseconds, 0 stops instantly)" );
+static const char * kSimProjectorDelayOptionString( "simProjectorDelay" );
+static const char * kSimProjectorDelayOptionMessage( "Simulated projector switch time (microseconds)" );
+
+static const char * kRtPriorityOptionString( "rtPriority" );
+static const char * kRtPriorityOptionMessage( "SCHED_FIFO priority of the sensor thread, the motor and network threads run just below (0 keeps the normal scheduling)" );
+static const char * kRtCpusOptionString( "rtCpus" );
+static const char * kRtCpusOptionMessage( "CPUs the capture threads are pinned on (comma separated list, empty for all)" );
+static const char * kLockMemoryOptionString( "lockMemory" );
+static const char * kLockMemoryOptionMessage( "Lock the process memory, no page fault on the capture path" );
 
 mvpplayer::network::server::Server * pServer = NULL;
 
@@ -68,11 +115,105 @@ void kalisync_unexpected( void )
     BOOST_THROW_EXCEPTION( std::runtime_error( "Sorry, Kalisync has encountered an unexpected exception.\nPlease report this bug." ) );
 }
 
-inline void triggerCapture( mvpplayer::network::server::Server & server )
+/**
+ * @brief send an event to kaliscope, thru the binary link when it is connected
+ * The text protocol is only used when no binary client got the event (no
+ * client, or no binary encoding): one kaliscope drives the transport, it
+ * gets each event once and never parses text while its binary link is up.
+ */
+inline void sendEvent( mvpplayer::network::server::Server & server, kaliscope::FastLinkServer & fastLink, mvpplayer::IEvent & event )
+{
+    if ( !fastLink.sendEventMulticast( event ) )
+    {
+        server.sendEventMulticast( event );
+    }
+}
+
+inline void triggerCapture( mvpplayer::network::server::Server & server, kaliscope::FastLinkServer & fastLink, kaliscope::CaptureTracer & tracer, const kaliscope::CaptureTrace & trace )
 {
+    // Send the trace first, so that kaliscope knows which capture the next frame belongs to
+    kaliscope::logic::EvCaptureTrace traceEvent( trace );
+    sendEvent( server, fastLink, traceEvent );
     // Send next track event (means next frame in kaliscope)
     mvpplayer::logic::EvNextTrack event;
-    server.sendEventMulticast( event );
+    sendEvent( server, fastLink, event );
+    tracer.mark( kaliscope::eCaptureStageTriggerSent );
+}
+
+/**
+ * @brief log the capture latency breakdown of the roll
+ */
+inline void logCaptureLatency( kaliscope::CaptureTracer & tracer )
+{
+    const std::string report = tracer.report();
+    if ( !report.empty() )
+    {
+        std::cout << "[Kalisync] " << report << std::endl;
+    }
+    const std::string jitterReport = kaliscope::ThreadJitterMonitor::getInstance().report();
+    if ( !jitterReport.empty() )
+    {
+        std::cout << "[Kalisync] " << jitterReport << std::flush;
+    }
+}
+
+/**
+ * @brief log the simulated transport throughput of the roll
+ */
+inline void logSimulation( const std::unique_ptr<kaliscope::FilmTransportSimulator> & simulator )
+{
+    if ( simulator )
+    {
+        const std::string report = simulator->report();
+        if ( !report.empty() )
+        {
+            std::cout << "[Kalisync] " << report << std::endl;
+        }
+    }
+}
+
+/**
+ * @brief next frame is in the gate, stop the film now
+ */
+inline void holdTransport( kaliscope::GpioWatcher & motor, const std::unique_ptr<kaliscope::MotorSpeedController> & speedController )
+{
+    if ( speedController )
+    { speedController->hold(); }
+    else
+    { motor.setValGpio( false ); }
+}
+
+/**
+ * @brief frame has been captured, move to the next one
+ */
+inline void releaseTransport( kaliscope::GpioWatcher & motor, const std::unique_ptr<kaliscope::MotorSpeedController> & speedController )
+{
+    if ( speedController )
+    { speedController->release(); }
+    else
+    { motor.setValGpio( true ); }
+}
+
+/**
+ * @brief capture has been stopped, stop the film
+ */
+inline void haltTransport( kaliscope::GpioWatcher & motor, const std::unique_ptr<kaliscope::MotorSpeedController> & speedController )
+{
+    if ( speedController )
+    { speedController->halt(); }
+    else
+    { motor.setValGpio( false ); }
+}
+
+/**
+ * @brief log the state of the speed controller
+ */
+inline void logSpeedControl( const std::unique_ptr<kaliscope::MotorSpeedController> & speedController )
+{
+    if ( speedController )
+    {
+        std::cout << "[Kalisync] " << speedController->str() << std::endl;
+    }
 }
 
 int main( int argc, char** argv )
@@ -93,10 +234,28 @@ int main( int argc, char** argv )
         bpo::options_description mainOptions( "Allowed options" );
         mainOptions.add_options()
             ( kServerPortOptionString,  bpo::value<unsigned short>()->default_value( mvpplayer::network::server::kDefaultServerPort ), kServerPortOptionMessage )
+            ( kFastLinkPortOptionString,  bpo::value<unsigned short>()->default_value( kaliscope::kDefaultFastLinkPort ), kFastLinkPortOptionMessage )
             ( kMotorPinOptionString, bpo::value<int>()->required(), kMotorPinOptionMessage )
             ( kFlashPinOptionString, bpo::value<int>()->required(), kFlashPinOptionMessage )
             ( kGpioDelayOptionString, bpo::value<int>()->required(), kGpioDelayOptionMessage )
+            ( kSensorPollOptionString, bpo::value<int>()->default_value( 0 ), kSensorPollOptionMessage )
             ( kUseTinyDisplayOptionString, bpo::value<bool>()->required()->default_value( true ), kUseTinyDisplayOptionMessage )
+            ( kFakeTinyDisplayOptionString, bpo::value<bool>()->default_value( false ), kFakeTinyDisplayOptionMessage )
+            ( kSpeedControlOptionString, bpo::value<bool>()->default_value( false ), kSpeedControlOptionMessage )
+            ( kPwmPeriodOptionString, bpo::value<int>()->default_value( 10000 ), kPwmPeriodOptionMessage )
+            ( kRampTimeOptionString, bpo::value<int>()->default_value( 150 ), kRampTimeOptionMessage )
+            ( kMinDutyOptionString, bpo::value<double>()->default_value( 0.35 ), kMinDutyOptionMessage )
+            ( kApproachOptionString, bpo::value<double>()->default_value( 0.15 ), kApproachOptionMessage )
+            ( kCadenceMarginOptionString, bpo::value<double>()->default_value( 0.1 ), kCadenceMarginOptionMessage )
+            ( kSimulateOptionString, bpo::value<bool>()->default_value( false ), kSimulateOptionMessage )
+            ( kSimRateOptionString, bpo::value<double>()->default_value( 24.0 ), kSimRateOptionMessage )
+            ( kSimJitterOptionString, bpo::value<double>()->default_value( 0.05 ), kSimJitterOptionMessage )
+            ( kSimTimeoutOptionString, bpo::value<int>()->default_value( 2000 ), kSimTimeoutOptionMessage )
+            ( kSimInertiaOptionString, bpo::value<int>()->default_value( 0 ), kSimInertiaOptionMessage )
+            ( kSimProjectorDelayOptionString, bpo::value<int>()->default_value( 0 ), kSimProjectorDelayOptionMessage )
+            ( kRtPriorityOptionString, bpo::value<int>()->default_value( 0 ), kRtPriorityOptionMessage )
+            ( kRtCpusOptionString, bpo::value<std::string>()->default_value( "" ), kRtCpusOptionMessage )
+            ( kLockMemoryOptionString, bpo::value<bool>()->default_value( false ), kLockMemoryOptionMessage )
             ( kWatchInputPinOptionString, bpo::value<int>()->required(), kWatchInputPinOptionMessage );
 
         //parse the command line, and put the result in vm
@@ -118,67 +277,219 @@ int main( int argc, char** argv )
 
         mvpplayer::Settings::getInstance().set( "gpio", "nextEventDelay", vm[kGpioDelayOptionString].as<int>() );
 
+        // Capture critical threads
+        const int rtPriority = vm[kRtPriorityOptionString].as<int>();
+        const std::string rtCpus = vm[kRtCpusOptionString].as<std::string>();
+        const int sensorPoll = std::max( vm[kSensorPollOptionString].as<int>(), 0 );
+        // A continuous poll loop never sleeps: at SCHED_FIFO it would starve
+        // every thread of lower priority on its CPUs (motor, network, kernel workers)
+        if ( rtPriority > 0 && sensorPoll == 0 )
+        {
+            std::cerr << "[Kalisync] The sensor is polled continuously, its thread keeps the normal scheduling (set --" << kSensorPollOptionString << " to run it realtime)." << std::endl;
+        }
+        mvpplayer::Settings::getInstance().set( "realtime", "sensorPriority", sensorPoll > 0 ? rtPriority : 0 );
+        mvpplayer::Settings::getInstance().set( "realtime", "motorPriority", rtPriority > 0 ? std::max( rtPriority - 1, 1 ) : 0 );
+        mvpplayer::Settings::getInstance().set( "realtime", "networkPriority", rtPriority > 0 ? std::max( rtPriority - 2, 1 ) : 0 );
+        mvpplayer::Settings::getInstance().set( "realtime", "sensorCpus", rtCpus );
+        mvpplayer::Settings::getInstance().set( "realtime", "motorCpus", rtCpus );
+        mvpplayer::Settings::getInstance().set( "realtime", "networkCpus", rtCpus );
+        mvpplayer::Settings::getInstance().set( "realtime", "lockMemory", vm[kLockMemoryOptionString].as<bool>() );
+        setupMemoryLock();
+
+        const bool simulate = vm[kSimulateOptionString].as<bool>();
         std::unique_ptr<IProjector> projector;
-        if ( vm[kUseTinyDisplayOptionString].as<bool>() )
+        if ( simulate )
         {
-            projector.reset( new TinyDisplayProjector() );
+            projector.reset( new SimulatedProjector( vm[kSimProjectorDelayOptionString].as<int>() ) );
         }
-        GpioWatcher gpioWatcher( vm[kWatchInputPinOptionString].as<int>(), 0 );
-        GpioWatcher gpioMotor( vm[kMotorPinOptionString].as<int>() );
+        else if ( vm[kUseTinyDisplayOptionString].as<bool>() )
+        {
+            std::unique_ptr<IFramebuffer> framebuffer;
+            if ( vm[kFakeTinyDisplayOptionString].as<bool>() )
+            {
+                framebuffer.reset( new MemoryFramebuffer() );
+            }
+            projector.reset( new TinyDisplayProjector( std::move( framebuffer ) ) );
+        }
+        std::unique_ptr<GpioWatcher> gpioWatcherPin;
+        std::unique_ptr<GpioWatcher> gpioMotorPin;
+        std::unique_ptr<GpioWatcher> gpioFlashPin;
+        std::unique_ptr<FilmTransportSimulator> transportSimulator;
+        if ( simulate )
+        {
+            SimulatedGpio *sensor = new SimulatedGpio( vm[kWatchInputPinOptionString].as<int>() );
+            SimulatedGpio *motor = new SimulatedGpio( vm[kMotorPinOptionString].as<int>() );
+            gpioWatcherPin.reset( sensor );
+            gpioMotorPin.reset( motor );
+            gpioFlashPin.reset( new SimulatedGpio( vm[kFlashPinOptionString].as<int>() ) );
+            transportSimulator.reset( new FilmTransportSimulator( *sensor, *motor,
+                                                                  vm[kSimRateOptionString].as<double>(),
+                                                                  vm[kSimJitterOptionString].as<double>(),
+                                                                  vm[kSimTimeoutOptionString].as<int>(),
+                                                                  vm[kSimInertiaOptionString].as<int>() ) );
+        }
+        else
+        {
+            gpioWatcherPin.reset( new GpioWatcher( vm[kWatchInputPinOptionString].as<int>(), sensorPoll ) );
+            gpioMotorPin.reset( new GpioWatcher( vm[kMotorPinOptionString].as<int>() ) );
+            gpioFlashPin.reset( new GpioWatcher( vm[kFlashPinOptionString].as<int>() ) );
+        }
+        GpioWatcher & gpioWatcher = *gpioWatcherPin;
+        GpioWatcher & gpioMotor = *gpioMotorPin;
         gpioMotor.exportGpio();
         gpioMotor.setDirGpio( "out" );
         gpioMotor.setValGpio( false );
-        GpioWatcher gpioFlash( vm[kFlashPinOptionString].as<int>() );
+        std::unique_ptr<MotorSpeedController> speedController;
+        if ( vm[kSpeedControlOptionString].as<bool>() )
+        {
+            speedController.reset( new MotorSpeedController( gpioMotor,
+                                                             vm[kPwmPeriodOptionString].as<int>(),
+                                                             vm[kRampTimeOptionString].as<int>(),
+                                                             vm[kMinDutyOptionString].as<double>(),
+                                                             vm[kApproachOptionString].as<double>(),
+                                                             vm[kCadenceMarginOptionString].as<double>() ) );
+            speedController->start();
+        }
+        GpioWatcher & gpioFlash = *gpioFlashPin;
         gpioFlash.exportGpio();
         gpioFlash.setDirGpio( "out" );
         gpioFlash.setValGpio( false );
 
+        CaptureTracer captureTracer;
+        // Is the film held (motor stopped) until kaliscope releases it
+        std::atomic<bool> transportHeld( true );
+        // Correlation id of the held frame's capture, only its progress events release it (0 if none)
+        std::atomic<boost::uint64_t> heldCapture( 0 );
+        // Does kaliscope report exposures: frame captured events without
+        // correlation id then come too late to release the film
+        std::atomic<bool> exposureReported( false );
+        // Credits of the triggers kaliscope can queue
+        FlowCreditWindow flowWindow;
+        // Is the film kept in place until kaliscope gives credits back
+        std::atomic<bool> releasePending( false );
+
         std::cout << "[Kalisync] GPIO Watcher started..." << std::endl;
         Server server( vm[kServerPortOptionString].as<unsigned short>() );
         server.run();
         pServer = &server;
+        FastLinkServer fastLink( vm[kFastLinkPortOptionString].as<unsigned short>() );
+        fastLink.run();
         std::cout << "[Kalisync] GPIO Server started..." << std::endl;
         if ( projector )
         {
             std::cout << "Testing projector..." << std::endl;
+            const boost::int64_t onStart = captureTimestamp();
             projector->switchOn();
+            const boost::int64_t onTime = captureTimestamp() - onStart;
             std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
+            const boost::int64_t offStart = captureTimestamp();
             projector->switchOff();
-            std::cout << "Projector tested." << std::endl;
+            const boost::int64_t offTime = captureTimestamp() - offStart;
+            std::cout << "Projector tested (switch on: " << onTime << "us, switch off: " << offTime << "us)." << std::endl;
         }
 
         // Toggle led value
         gpioWatcher.signalGpioValueChanged.connect(
-            [&server, &gpioMotor, &gpioFlash, &projector]( const std::size_t, const bool value )
+            [&server, &fastLink, &gpioMotor, &speedController, &gpioFlash, &projector, &captureTracer, &transportHeld, &heldCapture, &flowWindow]( const std::size_t, const bool value )
             {
                 if ( value == true )
                 {
+                    const CaptureTrace trace = captureTracer.begin();
                     // Stop the motor and light the flash
-                    gpioMotor.setValGpio( false );
+                    holdTransport( gpioMotor, speedController );
+                    transportHeld = true;
+                    heldCapture = trace.correlationId;
                     gpioFlash.setValGpio( true );
                     if ( projector )
                     { projector->switchOn(); }
                     // Ask the client to capture a frame
-                    triggerCapture( server );
+                    triggerCapture( server, fastLink, captureTracer, trace );
+                    flowWindow.triggered( trace.correlationId );
                 }
             }
         );
 
-        server.signalEventFrom.connect(
-            [&gpioFlash, &projector, &gpioMotor](const std::string&, IEvent& event)
+        // Restart the motor after a capture
+        const auto restartTransport =
+            [&gpioMotor, &speedController, &captureTracer]()
+            {
+                releaseTransport( gpioMotor, speedController );
+                captureTracer.mark( eCaptureStageMotorRestart );
+                captureTracer.finish();
+            };
+        // Restart the motor if it waits for credits and kaliscope has some
+        const auto restartPendingTransport =
+            [&restartTransport, &flowWindow, &releasePending]()
+            {
+                if ( flowWindow.credits() > 0 && releasePending.exchange( false ) )
+                {
+                    restartTransport();
+                }
+            };
+
+        // The held frame is exposed: release the film
+        const auto releaseHeldFrame =
+            [&gpioFlash, &projector, &captureTracer, &flowWindow, &releasePending, &restartTransport, &restartPendingTransport]()
+            {
+                captureTracer.mark( eCaptureStageCapturedReceived );
+                // Stop the flash light and restart the motor
+                gpioFlash.setValGpio( false );
+                if ( projector )
+                { projector->switchOff(); }
+                // Unless kaliscope's queue is full: the film waits for a credit
+                if ( flowWindow.credits() > 0 )
+                {
+                    restartTransport();
+                }
+                else
+                {
+                    releasePending = true;
+                    restartPendingTransport();
+                }
+            };
+
+        // Events from kaliscope, thru the text protocol or the binary link
+        const auto onKaliscopeEvent =
+            [&gpioFlash, &projector, &gpioMotor, &speedController, &captureTracer, &transportHeld, &heldCapture, &exposureReported,
+             &transportSimulator, &flowWindow, &releasePending, &releaseHeldFrame, &restartPendingTransport](IEvent& event)
             {
                 using namespace mvpplayer::logic;
-                // When a frame has been captured, we want to step forward
-                if ( dynamic_cast<mvpplayer::logic::EvCustomState*>( &event ) )
+                // The frame of a capture has been exposed or computed, we want to step forward
+                if ( dynamic_cast<kaliscope::logic::EvCaptureProgress*>( &event ) )
+                {
+                    const kaliscope::logic::EvCaptureProgress & progress = dynamic_cast<kaliscope::logic::EvCaptureProgress&>( event );
+                    if ( progress.action() == kaliscope::kExposureCompleteCustomStateAction )
+                    {
+                        exposureReported = true;
+                    }
+                    // Only the held frame's first event releases the film, late
+                    // events of a previous frame are ignored
+                    boost::uint64_t correlationId = progress.correlationId();
+                    if ( correlationId && heldCapture.compare_exchange_strong( correlationId, 0 ) )
+                    {
+                        transportHeld = false;
+                        releaseHeldFrame();
+                    }
+                }
+                // Same, from a kaliscope that doesn't tell which capture the frame belongs to
+                else if ( dynamic_cast<mvpplayer::logic::EvCustomState*>( &event ) )
                 {
                     const EvCustomState& customState = dynamic_cast<EvCustomState&>( event );
-                    if ( customState.action() == kaliscope::kFrameCapturedCustomStateAction )
+                    const bool exposed = customState.action() == kaliscope::kExposureCompleteCustomStateAction;
+                    if ( exposed || customState.action() == kaliscope::kFrameCapturedCustomStateAction )
                     {
-                        // Stop the flash light and restart the motor
-                        gpioFlash.setValGpio( false );
-                        if ( projector )
-                        { projector->switchOff(); }
-                        gpioMotor.setValGpio( true );
+                        // The film can move as soon as the frame is exposed, the frame captured
+                        // event only releases it when kaliscope does not report the exposures
+                        // (otherwise it may come after the next frame is held)
+                        if ( exposed )
+                        {
+                            exposureReported = true;
+                        }
+                        if ( ( exposed || !exposureReported ) && transportHeld.exchange( false ) )
+                        {
+                            heldCapture = 0;
+                            releaseHeldFrame();
+                        }
                     }
                     else if ( customState.action() == kaliscope::kCaptureStopCustomStateAction )
                     {
@@ -186,18 +497,77 @@ int main( int argc, char** argv )
                         gpioFlash.setValGpio( false );
                         if ( projector )
                         { projector->switchOff(); }
-                        gpioMotor.setValGpio( false );
+                        haltTransport( gpioMotor, speedController );
+                        transportHeld = true;
+                        heldCapture = 0;
+                        releasePending = false;
+                        flowWindow.reset();
+                        logCaptureLatency( captureTracer );
+                        logSimulation( transportSimulator );
+                        logSpeedControl( speedController );
+                    }
+                }
+                // Kaliscope sends back the stages it has traced
+                else if ( dynamic_cast<kaliscope::logic::EvCaptureTrace*>( &event ) )
+                {
+                    const CaptureTrace & trace = dynamic_cast<kaliscope::logic::EvCaptureTrace&>( event ).trace();
+                    captureTracer.merge( trace );
+                    // Kaliscope processing time sets the transport cadence
+                    const boost::int64_t processing = trace.elapsed( eCaptureStageComputeStart, eCaptureStageDisplayDone );
+                    if ( speedController && processing > 0 )
+                    {
+                        speedController->setProcessingLatency( processing );
                     }
                 }
+                // Kaliscope gives credits back and tells how full its queue is
+                else if ( dynamic_cast<kaliscope::logic::EvFlowControl*>( &event ) )
+                {
+                    flowWindow.update( dynamic_cast<kaliscope::logic::EvFlowControl&>( event ).state() );
+                    if ( speedController )
+                    {
+                        speedController->setFlowFill( flowWindow.fill() );
+                    }
+                    restartPendingTransport();
+                }
                 // When we hit stop, we want to stop flash and motor
                 else if ( dynamic_cast<EvStop*>( &event ) )
                 {
                     gpioFlash.setValGpio( false );
-                    gpioMotor.setValGpio( false );
+                    haltTransport( gpioMotor, speedController );
+                    transportHeld = true;
+                    heldCapture = 0;
+                    releasePending = false;
+                    flowWindow.reset();
+                    logCaptureLatency( captureTracer );
+                    logSimulation( transportSimulator );
+                    logSpeedControl( speedController );
                 }
-            }
-        );
+            };
+        server.signalEventFrom.connect( [&onKaliscopeEvent](const std::string&, IEvent& event) { onKaliscopeEvent( event ); } );
+        fastLink.signalEvent.connect( onKaliscopeEvent );
+        if ( transportSimulator )
+        {
+            // Restart dropped frames thru the speed controller, which owns the motor pin
+            transportSimulator->signalFrameDropped.connect(
+                [&gpioMotor, &speedController]()
+                { releaseTransport( gpioMotor, speedController ); }
+            );
+            std::cout << "[Kalisync] Simulating film transport..." << std::endl;
+            transportSimulator->start();
+        }
         server.wait();
+        if ( transportSimulator )
+        {
+            transportSimulator->stop();
+        }
+        fastLink.stop();
+        logCaptureLatency( captureTracer );
+        logSimulation( transportSimulator );
+        logSpeedControl( speedController );
+        if ( speedController )
+        {
+            speedController->stop();
+        }
         gpioFlash.setValGpio( false );
         if ( projector )
         { projector->switchOff(); }
@@ -0,0 +1,103 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_IFRAMEBUFFER_HPP_
+#define	_KALI_IFRAMEBUFFER_HPP_
+
+#include <linux/fb.h>
+#include <boost/cstdint.hpp>
+#include <cstddef>
+
+namespace kaliscope
+{
+
+/**
+ * @brief truecolor framebuffer split in pages of one screen each
+ * The visible page is selected by panning, so a full screen change
+ * can be prepared in a hidden page and shown at once.
+ */
+class IFramebuffer
+{
+public:
+    virtual ~IFramebuffer() = 0;
+
+    /**
+     * @brief open the framebuffer
+     * @param nbPages[in] number of pages wanted (less can be given)
+     * @return false on failure
+     */
+    virtual bool open( const std::size_t nbPages = 2 ) = 0;
+
+    /**
+     * @brief close the framebuffer
+     */
+    virtual void close() = 0;
+
+    /**
+     * @brief show a page
+     * @return false if the page cannot be shown
+     */
+    virtual bool panTo( const std::size_t page ) = 0;
+
+    inline bool isOpen() const
+    { return _mem != nullptr; }
+
+    inline std::size_t width() const
+    { return _width; }
+
+    inline std::size_t height() const
+    { return _height; }
+
+    inline std::size_t lineLength() const
+    { return _lineLength; }
+
+    inline std::size_t bytesPerPixel() const
+    { return _bytesPerPixel; }
+
+    inline std::size_t nbPages() const
+    { return _nbPages; }
+
+    inline std::size_t visiblePage() const
+    { return _visiblePage; }
+
+    inline std::size_t pageSize() const
+    { return _lineLength * _height; }
+
+    /**
+     * @brief get the memory of a page
+     */
+    inline unsigned char *page( const std::size_t n )
+    { return _mem + n * pageSize(); }
+
+    /**
+     * @brief pack a color in the framebuffer pixel format
+     */
+    inline boost::uint32_t packColor( const unsigned char r, const unsigned char g, const unsigned char b ) const
+    {
+        return packChannel( r, _red ) | packChannel( g, _green ) | packChannel( b, _blue );
+    }
+
+protected:
+    static inline boost::uint32_t packChannel( const unsigned char v, const fb_bitfield & field )
+    {
+        return field.length ? boost::uint32_t( v >> ( 8 - field.length ) ) << field.offset : 0;
+    }
+
+protected:
+    unsigned char *_mem = nullptr;      ///< Framebuffer memory (all pages)
+    std::size_t _width = 0;             ///< Visible width
+    std::size_t _height = 0;            ///< Visible height
+    std::size_t _lineLength = 0;        ///< Bytes per line
+    std::size_t _bytesPerPixel = 0;     ///< Bytes per pixel
+    std::size_t _nbPages = 0;           ///< Number of screen pages
+    std::size_t _visiblePage = 0;       ///< Currently shown page
+    fb_bitfield _red = fb_bitfield();   ///< Red channel layout
+    fb_bitfield _green = fb_bitfield(); ///< Green channel layout
+    fb_bitfield _blue = fb_bitfield();  ///< Blue channel layout
+};
+
+}
+
+#endif
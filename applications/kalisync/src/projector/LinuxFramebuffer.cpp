@@ -0,0 +1,164 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "LinuxFramebuffer.hpp"
+
+#include <iostream>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+
+namespace kaliscope
+{
+
+LinuxFramebuffer::LinuxFramebuffer( const std::string & device )
+: _device( device )
+{
+}
+
+LinuxFramebuffer::~LinuxFramebuffer()
+{
+    close();
+}
+
+/**
+ * @brief open the framebuffer
+ * @param nbPages[in] number of pages wanted (less can be given)
+ * @return false on failure
+ */
+bool LinuxFramebuffer::open( const std::size_t nbPages )
+{
+    close();
+
+    _fb = ::open( _device.c_str(), O_RDWR );
+    if ( _fb == -1 )
+    {
+        std::cerr << "Failed to open fbdevice, did you installed your tiny screen correctly?" << std::endl;
+        return false;
+    }
+
+    if ( ioctl( _fb, FBIOGET_VSCREENINFO, &_var ) < 0 )
+    {
+        std::cerr << "Failed ioctl FBIOGET_VSCREENINFO" << std::endl;
+        ::close( _fb );
+        _fb = -1;
+        return false;
+    }
+    memcpy( &_origVar, &_var, sizeof( fb_var_screeninfo ) );
+
+    _nbPages = setupPages( nbPages );
+
+    if ( ioctl( _fb, FBIOGET_FSCREENINFO, &_fix ) < 0 )
+    {
+        std::cerr << "Failed ioctl FBIOGET_FSCREENINFO" << std::endl;
+        close();
+        return false;
+    }
+
+    _width = _var.xres;
+    _height = _var.yres;
+    _lineLength = _fix.line_length;
+    _bytesPerPixel = ( _var.bits_per_pixel + 7 ) / 8;
+    _red = _var.red;
+    _green = _var.green;
+    _blue = _var.blue;
+    _visiblePage = 0;
+
+    // map framebuffer to user memory
+    _mappedSize = _fix.smem_len;
+    void *mem = mmap( 0, _mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fb, 0 );
+    if ( mem == MAP_FAILED )
+    {
+        std::cerr << "Failed to memory map!" << std::endl;
+        close();
+        return false;
+    }
+    _mem = static_cast<unsigned char*>( mem );
+
+    // Don't trust the driver further than its memory
+    if ( _nbPages * pageSize() > _mappedSize )
+    {
+        _nbPages = 1;
+    }
+    return true;
+}
+
+/**
+ * @brief try to get a virtual screen of nbPages screens
+ * @return the number of usable pages
+ */
+std::size_t LinuxFramebuffer::setupPages( const std::size_t nbPages )
+{
+    if ( nbPages > 1 )
+    {
+        fb_var_screeninfo var = _var;
+        var.yres_virtual = var.yres * nbPages;
+        var.xoffset = 0;
+        var.yoffset = 0;
+        if ( ioctl( _fb, FBIOPUT_VSCREENINFO, &var ) == 0 )
+        {
+            ioctl( _fb, FBIOGET_VSCREENINFO, &_var );
+            // Check that the driver really pans
+            _var.yoffset = 0;
+            if ( _var.yres_virtual >= 2 * _var.yres && ioctl( _fb, FBIOPAN_DISPLAY, &_var ) == 0 )
+            {
+                return _var.yres_virtual / _var.yres;
+            }
+        }
+        ioctl( _fb, FBIOPUT_VSCREENINFO, &_origVar );
+        ioctl( _fb, FBIOGET_VSCREENINFO, &_var );
+    }
+    return 1;
+}
+
+/**
+ * @brief close the framebuffer
+ */
+void LinuxFramebuffer::close()
+{
+    if ( _mem )
+    {
+        munmap( _mem, _mappedSize );
+        _mem = nullptr;
+    }
+    if ( _fb != -1 )
+    {
+        if ( ioctl( _fb, FBIOPUT_VSCREENINFO, &_origVar ) )
+        {
+            std::cerr << "Error re-setting variable information" << std::endl;
+        }
+        ::close( _fb );
+        _fb = -1;
+    }
+    _nbPages = 0;
+}
+
+/**
+ * @brief show a page
+ * @return false if the page cannot be shown
+ */
+bool LinuxFramebuffer::panTo( const std::size_t page )
+{
+    if ( page >= _nbPages )
+    {
+        return false;
+    }
+    if ( page == _visiblePage )
+    {
+        return true;
+    }
+    _var.xoffset = 0;
+    _var.yoffset = page * _var.yres;
+    if ( ioctl( _fb, FBIOPAN_DISPLAY, &_var ) < 0 )
+    {
+        return false;
+    }
+    _visiblePage = page;
+    return true;
+}
+
+}
@@ -0,0 +1,63 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_LINUXFRAMEBUFFER_HPP_
+#define	_KALI_LINUXFRAMEBUFFER_HPP_
+
+#include "IFramebuffer.hpp"
+
+#include <string>
+
+namespace kaliscope
+{
+
+/**
+ * @brief memory mapped linux framebuffer device
+ * Pages are stacked in the virtual screen and shown with FBIOPAN_DISPLAY.
+ * Drivers that can't pan give a single page.
+ */
+class LinuxFramebuffer : public IFramebuffer
+{
+public:
+    LinuxFramebuffer( const std::string & device = "/dev/fb1" );
+    virtual ~LinuxFramebuffer();
+
+    /**
+     * @brief open the framebuffer
+     * @param nbPages[in] number of pages wanted (less can be given)
+     * @return false on failure
+     */
+    bool open( const std::size_t nbPages = 2 );
+
+    /**
+     * @brief close the framebuffer
+     */
+    void close();
+
+    /**
+     * @brief show a page
+     * @return false if the page cannot be shown
+     */
+    bool panTo( const std::size_t page );
+
+private:
+    /**
+     * @brief try to get a virtual screen of nbPages screens
+     * @return the number of usable pages
+     */
+    std::size_t setupPages( const std::size_t nbPages );
+
+private:
+    std::string _device;            ///< Device path
+    int _fb = -1;                   ///< Device file descriptor
+    std::size_t _mappedSize = 0;    ///< Mapped memory size
+    fb_fix_screeninfo _fix;
+    fb_var_screeninfo _origVar;
+    fb_var_screeninfo _var;
+};
+
+}
+
+#endif
@@ -0,0 +1,72 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "MemoryFramebuffer.hpp"
+
+namespace kaliscope
+{
+
+MemoryFramebuffer::MemoryFramebuffer( const std::size_t width, const std::size_t height )
+{
+    _width = width;
+    _height = height;
+    _bytesPerPixel = 2;
+    _lineLength = width * _bytesPerPixel;
+    _red.offset = 11;
+    _red.length = 5;
+    _green.offset = 5;
+    _green.length = 6;
+    _blue.offset = 0;
+    _blue.length = 5;
+}
+
+MemoryFramebuffer::~MemoryFramebuffer()
+{
+}
+
+/**
+ * @brief open the framebuffer
+ * @param nbPages[in] number of pages wanted
+ * @return false on failure
+ */
+bool MemoryFramebuffer::open( const std::size_t nbPages )
+{
+    _nbPages = nbPages ? nbPages : 1;
+    _buffer.assign( _nbPages * pageSize(), 0 );
+    _mem = _buffer.data();
+    _visiblePage = 0;
+    _nbPans = 0;
+    return true;
+}
+
+/**
+ * @brief close the framebuffer
+ */
+void MemoryFramebuffer::close()
+{
+    _buffer.clear();
+    _mem = nullptr;
+    _nbPages = 0;
+}
+
+/**
+ * @brief show a page
+ * @return false if the page cannot be shown
+ */
+bool MemoryFramebuffer::panTo( const std::size_t page )
+{
+    if ( page >= _nbPages )
+    {
+        return false;
+    }
+    if ( page != _visiblePage )
+    {
+        _visiblePage = page;
+        ++_nbPans;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,62 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_MEMORYFRAMEBUFFER_HPP_
+#define	_KALI_MEMORYFRAMEBUFFER_HPP_
+
+#include "IFramebuffer.hpp"
+
+#include <vector>
+
+namespace kaliscope
+{
+
+/**
+ * @brief memory backed RGB565 framebuffer
+ * Stands for the tiny display when it is not attached (tests, benchmarks).
+ */
+class MemoryFramebuffer : public IFramebuffer
+{
+public:
+    /**
+     * @brief constructor
+     * @param width[in] screen width (default is the 2.8" PiTFT)
+     * @param height[in] screen height
+     */
+    MemoryFramebuffer( const std::size_t width = 320, const std::size_t height = 240 );
+    virtual ~MemoryFramebuffer();
+
+    /**
+     * @brief open the framebuffer
+     * @param nbPages[in] number of pages wanted
+     * @return false on failure
+     */
+    bool open( const std::size_t nbPages = 2 );
+
+    /**
+     * @brief close the framebuffer
+     */
+    void close();
+
+    /**
+     * @brief show a page
+     * @return false if the page cannot be shown
+     */
+    bool panTo( const std::size_t page );
+
+    /**
+     * @brief number of page switches
+     */
+    inline std::size_t nbPans() const
+    { return _nbPans; }
+
+private:
+    std::vector<unsigned char> _buffer;     ///< Pages memory
+    std::size_t _nbPans = 0;                ///< Number of page switches
+};
+
+}
+
+#endif
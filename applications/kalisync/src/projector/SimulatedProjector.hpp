@@ -0,0 +1,82 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_SIMULATEDPROJECTOR_HPP_
+#define	_KALI_SIMULATEDPROJECTOR_HPP_
+
+#include "IProjector.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace kaliscope
+{
+
+/**
+ * @brief projector of the simulation mode
+ * Only counts the switches, each one takes a configurable time
+ * to emulate the light source update.
+ */
+class SimulatedProjector : public IProjector
+{
+public:
+    /**
+     * @brief constructor
+     * @param switchTime[in] time taken by a switch (microseconds)
+     */
+    SimulatedProjector( const int switchTime = 0 )
+    : _switchTime( switchTime )
+    , _nbSwitchOn( 0 )
+    {}
+
+    virtual ~SimulatedProjector();
+
+    /**
+     * @brief initialize projector
+     */
+    void init()
+    {}
+
+    /**
+     * @brief switch projector on
+     */
+    void switchOn()
+    {
+        simulateSwitch();
+        _active = true;
+        ++_nbSwitchOn;
+    }
+
+    /**
+     * @brief switch projector off
+     */
+    void switchOff()
+    {
+        simulateSwitch();
+        _active = false;
+    }
+
+    /**
+     * @brief number of times the projector has been switched on
+     */
+    inline std::size_t nbSwitchOn() const
+    { return _nbSwitchOn; }
+
+private:
+    inline void simulateSwitch() const
+    {
+        if ( _switchTime > 0 )
+        { std::this_thread::sleep_for( std::chrono::microseconds( _switchTime ) ); }
+    }
+
+private:
+    const int _switchTime;                  ///< Switch time (microseconds)
+    std::atomic<std::size_t> _nbSwitchOn;   ///< Number of switch on
+};
+
+}
+
+#endif
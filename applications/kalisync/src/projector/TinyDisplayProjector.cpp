@@ -4,11 +4,10 @@
  */
 
 #include "TinyDisplayProjector.hpp"
-#include <cassert>
+#include "LinuxFramebuffer.hpp"
+
+#include <algorithm>
 #include <iostream>
-#include <fcntl.h>
-#include <sys/ioctl.h> 
-#include <unistd.h>
 #include <cstring>
 
 #define KNRM  "\x1B[0m"
@@ -54,8 +53,9 @@ static unsigned short def_b[] =
 namespace kaliscope
 {
 
-TinyDisplayProjector::TinyDisplayProjector()
+TinyDisplayProjector::TinyDisplayProjector( std::unique_ptr<IFramebuffer> framebuffer )
 : IProjector( -1 )
+, _framebuffer( std::move( framebuffer ) )
 {
    init();
 }
@@ -65,7 +65,7 @@ TinyDisplayProjector::~TinyDisplayProjector()
    try
    {
       switchOff();
-      closeFramebuffer();
+      _framebuffer->close();
    }
    catch( ... )
    {}
@@ -76,50 +76,32 @@ TinyDisplayProjector::~TinyDisplayProjector()
  */
 void TinyDisplayProjector::init()
 {
-    static const char *kFbDevice = "/dev/fb1";
-
-    if ( _fb )
+    std::unique_lock<std::mutex> lock( _mutex );
+    if ( !_framebuffer )
     {
-        closeFramebuffer();
+        _framebuffer.reset( new LinuxFramebuffer( "/dev/fb1" ) );
     }
 
-    _fb = open( kFbDevice, O_RDWR );
-    if ( _fb == -1 )
+    // Two pages: one for 'off', one for 'on'
+    if ( !_framebuffer->open( 2 ) )
     {
-        std::cerr << "Failed to open fbdevice, did you installed your tiny screen correctly?" << std::endl;
         return;
     }
 
-    if ( ioctl( _fb, FBIOGET_FSCREENINFO, &_fix ) < 0 )
-    {
-        std::cerr << "Failed ioctl FBIOGET_FSCREENINFO" << std::endl;
-        close( _fb );
-        return;
-    }
+    renderPatterns();
 
-    if ( ioctl( _fb, FBIOGET_VSCREENINFO, &_var ) < 0 )
+    _pagePatterns.assign( _framebuffer->nbPages(), -1 );
+    _pageFlip = _framebuffer->nbPages() > 1;
+    writePage( _framebuffer->visiblePage(), eProjectorPatternBlack );
+    if ( _pageFlip )
     {
-        std::cerr << "Failed ioctl FBIOGET_VSCREENINFO" << std::endl;
-        close( _fb );
-        return;
+        writePage( backPage(), eProjectorPatternWhite );
     }
-
-    memcpy( &_origVar, &_var, sizeof( fb_var_screeninfo ) );
-
-    // map framebuffer to user memory 
-    _screensize = _fix.smem_len;
-    _fbp = (char*)mmap(0, 
-                _screensize, 
-                PROT_READ | PROT_WRITE, 
-                MAP_SHARED, 
-                _fb, 0);
-    if ( (int)_fbp == -1 )
+    else
     {
-        std::cerr << "Failed to memory map!" << std::endl;
+        std::cout << "[Kalisync] Tiny display can't flip pages, patterns will be copied." << std::endl;
     }
-
-    _width = _var.xres;
-    _height = _var.yres;
+    _active = false;
 }
 
 /**
@@ -127,10 +109,7 @@ void TinyDisplayProjector::init()
  */
 void TinyDisplayProjector::switchOn()
 {
-    // set framebuffer to white
-    for( std::size_t x = 0; x < _width; ++x )
-        for( std::size_t y = 0; y < _height; ++y )
-            drawPixel( x, y, 255, 255, 255 );
+    showPattern( eProjectorPatternWhite );
 }
 
 /**
@@ -138,49 +117,180 @@ void TinyDisplayProjector::switchOn()
  */
 void TinyDisplayProjector::switchOff()
 {
-    // set framebuffer to black
-    for( std::size_t x = 0; x < _width; ++x )
-        for( std::size_t y = 0; y < _height; ++y )
-            drawPixel( x, y, 0, 0, 0 );
+    showPattern( eProjectorPatternBlack );
 }
 
+/**
+ * @brief show a full screen pattern
+ */
+void TinyDisplayProjector::showPattern( const EProjectorPattern pattern )
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    if ( !_framebuffer->isOpen() )
+    {
+        return;
+    }
+    _active = pattern != eProjectorPatternBlack;
+
+    const std::size_t visible = _framebuffer->visiblePage();
+    if ( _pagePatterns[visible] == pattern )
+    {
+        return;
+    }
+
+    if ( _pageFlip )
+    {
+        // Already rendered in a hidden page: a single pan
+        const std::vector<int>::const_iterator it = std::find( _pagePatterns.begin(), _pagePatterns.end(), int( pattern ) );
+        if ( it != _pagePatterns.end() && _framebuffer->panTo( it - _pagePatterns.begin() ) )
+        {
+            return;
+        }
+
+        const std::size_t page = backPage();
+        writePage( page, pattern );
+        if ( _framebuffer->panTo( page ) )
+        {
+            return;
+        }
+        // Pages stay mapped (_pagePatterns keeps one entry per page), only
+        // the visible one is written from now on
+        std::cerr << "[Kalisync] Tiny display page flip failed, patterns will be copied." << std::endl;
+        _pageFlip = false;
+    }
 
+    writePage( _framebuffer->visiblePage(), pattern );
+}
 
-void TinyDisplayProjector::drawPixel( const std::size_t x, const std::size_t y, int r, int g, int b)
+/**
+ * @brief render all patterns in memory
+ */
+void TinyDisplayProjector::renderPatterns()
 {
-    assert( _fbp != nullptr );
+    const std::size_t width = _framebuffer->width();
+    const std::size_t height = _framebuffer->height();
+    const std::size_t lineLength = _framebuffer->lineLength();
+    const std::size_t bpp = _framebuffer->bytesPerPixel();
 
-    unsigned int pix_offset;
-    unsigned short c;
+    const boost::uint32_t black = _framebuffer->packColor( 0, 0, 0 );
+    const boost::uint32_t white = _framebuffer->packColor( 255, 255, 255 );
+    const boost::uint32_t solids[] =
+    {
+        black,
+        white,
+        _framebuffer->packColor( 255, 0, 0 ),
+        _framebuffer->packColor( 0, 255, 0 ),
+        _framebuffer->packColor( 0, 0, 255 )
+    };
 
-    // calculate the pixel's byte offset inside the buffer
-    pix_offset = x*2 + y * _fix.line_length;
+    for( std::size_t p = 0; p < eProjectorPatternCount; ++p )
+    {
+        _patterns[p].assign( _framebuffer->pageSize(), 0 );
+    }
 
-    //some magic to work out the color
-    c = ((r / 8) << 11) + ((g / 4) << 5) + (b / 8);
+    // Solid patterns: fill the first row, copy it to the others
+    for( std::size_t p = eProjectorPatternBlack; p <= eProjectorPatternBlue; ++p )
+    {
+        unsigned char *data = _patterns[p].data();
+        fillRow( data, width, solids[p] );
+        for( std::size_t y = 1; y < height; ++y )
+        {
+            memcpy( data + y * lineLength, data, lineLength );
+        }
+    }
 
-    // write 'two bytes at once'
-    *((unsigned short*)(_fbp + pix_offset)) = c;
-}
+    // Grid: 8x8 cells with a border
+    {
+        unsigned char *data = _patterns[eProjectorPatternGrid].data();
+        unsigned char *lineRow = data;
+        unsigned char *cellRow = data + lineLength;
+        fillRow( lineRow, width, white );
+        fillRow( cellRow, width, black );
+        for( std::size_t i = 0; i <= 8; ++i )
+        {
+            const std::size_t x = std::min( i * width / 8, width - 1 );
+            fillRow( cellRow + x * bpp, 1, white );
+        }
+        for( std::size_t y = 2; y < height; ++y )
+        {
+            const bool isLine = ( y * 8 ) % height < 8 || y == height - 1;
+            memcpy( data + y * lineLength, isLine ? lineRow : cellRow, lineLength );
+        }
+    }
 
+    // Color bars: the 16 colors of the default palette
+    {
+        unsigned char *data = _patterns[eProjectorPatternColorBars].data();
+        for( std::size_t c = 0; c < 16; ++c )
+        {
+            const std::size_t x0 = c * width / 16;
+            const std::size_t x1 = ( c + 1 ) * width / 16;
+            fillRow( data + x0 * bpp, x1 - x0, _framebuffer->packColor( def_r[c], def_g[c], def_b[c] ) );
+        }
+        for( std::size_t y = 1; y < height; ++y )
+        {
+            memcpy( data + y * lineLength, data, lineLength );
+        }
+    }
+}
 
-void TinyDisplayProjector::drawSquare( const std::size_t x, const std::size_t y, const std::size_t height, const std::size_t width, int c )
+/**
+ * @brief fill count pixels of a row with a packed color
+ */
+void TinyDisplayProjector::fillRow( unsigned char *row, const std::size_t count, const boost::uint32_t color ) const
 {
-    for ( std::size_t h = 0; h < height; ++h )
-        for ( std::size_t w = 0; w < width; ++w )
-            drawPixel( h + ( x - 2 ), w + ( y - 2 ) , def_r[ c ], def_g[ c ], def_b[ c ] );
+    // fill_n on the pixel type is vectorized by the compiler
+    switch( _framebuffer->bytesPerPixel() )
+    {
+        case 2:
+            std::fill_n( reinterpret_cast<boost::uint16_t*>( row ), count, boost::uint16_t( color ) );
+            break;
+        case 4:
+            std::fill_n( reinterpret_cast<boost::uint32_t*>( row ), count, color );
+            break;
+        case 1:
+            memset( row, color & 0xff, count );
+            break;
+        default:
+        {
+            const std::size_t bpp = _framebuffer->bytesPerPixel();
+            for( std::size_t x = 0; x < count; ++x )
+                for( std::size_t b = 0; b < bpp; ++b )
+                    row[x * bpp + b] = ( color >> ( 8 * b ) ) & 0xff;
+            break;
+        }
+    }
 }
 
-void TinyDisplayProjector::closeFramebuffer()
+/**
+ * @brief copy a rendered pattern to a framebuffer page
+ */
+void TinyDisplayProjector::writePage( const std::size_t page, const EProjectorPattern pattern )
 {
-    switchOff();
+    memcpy( _framebuffer->page( page ), _patterns[pattern].data(), _framebuffer->pageSize() );
+    _pagePatterns[page] = pattern;
+}
 
-    munmap( _fbp, _screensize );
-    if (ioctl( _fb, FBIOPUT_VSCREENINFO, &_origVar ) )
+/**
+ * @brief choose the hidden page that will receive a pattern
+ */
+std::size_t TinyDisplayProjector::backPage() const
+{
+    // Keep 'on' and 'off' in their pages as long as possible
+    std::size_t page = _framebuffer->visiblePage();
+    for( std::size_t p = 0; p < _pagePatterns.size(); ++p )
     {
-        std::cerr << "Error re-setting variable information" << std::endl;
+        if ( p == _framebuffer->visiblePage() )
+        {
+            continue;
+        }
+        if ( page == _framebuffer->visiblePage() ||
+             ( _pagePatterns[p] != eProjectorPatternBlack && _pagePatterns[p] != eProjectorPatternWhite ) )
+        {
+            page = p;
+        }
     }
-    close( _fb );
+    return page;
 }
 
 }
@@ -7,21 +7,45 @@
 #define	_KALI_TINYDISPLAYPROJECTOR_HPP_
 
 #include "IProjector.hpp"
+#include "IFramebuffer.hpp"
 
-#include <stdlib.h>
-#include <linux/fb.h>
-#include <sys/mman.h>
-#include <string>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace kaliscope
 {
 
+/**
+ * @brief full screen patterns of the tiny display
+ */
+enum EProjectorPattern
+{
+    eProjectorPatternBlack = 0,     ///< projector off
+    eProjectorPatternWhite,         ///< projector on
+    eProjectorPatternRed,
+    eProjectorPatternGreen,
+    eProjectorPatternBlue,
+    eProjectorPatternGrid,          ///< calibration grid (framing, focus)
+    eProjectorPatternColorBars,     ///< calibration color bars (framebuffer palette)
+    eProjectorPatternCount
+};
+
+/**
+ * @brief projector using a tiny display (FBTFT driver) as light source
+ * Patterns are rendered once at init, showing one is a page flip when the
+ * framebuffer has several pages, a single copy otherwise.
+ */
 class TinyDisplayProjector : public IProjector
 {
 public:
-    TinyDisplayProjector();
+    /**
+     * @brief constructor
+     * @param framebuffer[in] framebuffer to use, /dev/fb1 if not given
+     */
+    TinyDisplayProjector( std::unique_ptr<IFramebuffer> framebuffer = std::unique_ptr<IFramebuffer>() );
     virtual ~TinyDisplayProjector();
-    
+
     /**
      * @brief initialize projector
      */
@@ -37,21 +61,38 @@ public:
      */
     void switchOff();
 
+    /**
+     * @brief show a full screen pattern
+     */
+    void showPattern( const EProjectorPattern pattern );
+
 private:
-    void drawPixel( const std::size_t x, const std::size_t y, int r, int g, int b );
+    /**
+     * @brief render all patterns in memory
+     */
+    void renderPatterns();
+
+    /**
+     * @brief fill count pixels of a row with a packed color
+     */
+    void fillRow( unsigned char *row, const std::size_t count, const boost::uint32_t color ) const;
 
-    void drawSquare( const std::size_t x, const std::size_t y, const std::size_t height, const std::size_t width, int c );
+    /**
+     * @brief copy a rendered pattern to a framebuffer page
+     */
+    void writePage( const std::size_t page, const EProjectorPattern pattern );
 
-    void closeFramebuffer();
+    /**
+     * @brief choose the hidden page that will receive a pattern
+     */
+    std::size_t backPage() const;
 
-    char *_fbp = NULL;
-    int _fb = 0;
-    std::size_t _width = 0;
-    std::size_t _height = 0;
-    long int _screensize = 0;
-    fb_fix_screeninfo _fix;
-    fb_var_screeninfo _origVar;
-    fb_var_screeninfo _var;
+private:
+    std::unique_ptr<IFramebuffer> _framebuffer;                 ///< Display framebuffer
+    std::vector<unsigned char> _patterns[eProjectorPatternCount];   ///< Rendered patterns (one page each)
+    std::vector<int> _pagePatterns;                             ///< Pattern held by each page, -1 if unknown
+    bool _pageFlip = false;                                     ///< Are patterns shown by page flips (copied otherwise)
+    std::mutex _mutex;                                          ///< Mutex thread
 };
 
 }
@@ -0,0 +1,258 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "FilmTransportSimulator.hpp"
+
+#include <kali-core/CaptureTracer.hpp>
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <sstream>
+
+namespace kaliscope
+{
+
+namespace
+{
+// Film move step while the film is moving (microseconds)
+static const boost::int64_t kMoveStep = 250;
+// A frame coasting further than this after its sensor edge is misregistered (ratio of a frame)
+static const double kRegistrationTolerance = 0.05;
+}
+
+FilmTransportSimulator::FilmTransportSimulator( SimulatedGpio & sensor, SimulatedGpio & motor, const double frameRate, const double jitter, const int timeout, const int inertia )
+: _sensor( sensor )
+, _motor( motor )
+, _framePeriod( 1000000.0 / std::max( frameRate, 0.1 ) )
+, _jitter( std::max( jitter, 0.0 ) )
+, _timeout( boost::int64_t( timeout ) * 1000 )
+, _inertia( std::max( inertia, 0 ) * 1000.0 )
+, _random( std::random_device()() )
+{
+    _motor.signalGpioValueChanged.connect( [this]( const std::size_t, const bool value ) { onMotorChanged( value ); } );
+}
+
+FilmTransportSimulator::~FilmTransportSimulator()
+{
+    stop();
+}
+
+/**
+ * @brief start the transport thread
+ */
+void FilmTransportSimulator::start()
+{
+    if ( _thread )
+    {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _stop = false;
+        _motorOn = _motor.value();
+        _lastStep = captureTimestamp();
+        _framePitch = nextFramePitch();
+    }
+    _thread.reset( new std::thread( &FilmTransportSimulator::work, this ) );
+}
+
+/**
+ * @brief stop the transport thread
+ */
+void FilmTransportSimulator::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _stop = true;
+    }
+    _motorChanged.notify_all();
+    if ( _thread )
+    {
+        _thread->join();
+        _thread.reset();
+    }
+}
+
+void FilmTransportSimulator::onMotorChanged( const bool value )
+{
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        // The film moved with the previous motor value until now
+        advance( captureTimestamp() );
+        if ( value && !_motorOn && _frameInGate )
+        {
+            // The frame in the gate has been released
+            _holdTimes.push_back( _lastStep - _lastEdge );
+            _coastSum += _position;
+            if ( _position > kRegistrationTolerance )
+            {
+                ++_nbOvershot;
+            }
+            _frameInGate = false;
+        }
+        _motorOn = value;
+    }
+    _motorChanged.notify_all();
+}
+
+/**
+ * @brief draw the pitch of the next frame
+ * @return frame pitch (1 is the nominal pitch)
+ */
+double FilmTransportSimulator::nextFramePitch()
+{
+    std::normal_distribution<double> distribution( 1.0, _jitter );
+    return std::max( distribution( _random ), 0.1 );
+}
+
+/**
+ * @brief move the film up to the given time
+ */
+void FilmTransportSimulator::advance( const boost::int64_t now )
+{
+    const double dt = double( now - _lastStep );
+    _lastStep = now;
+    if ( dt <= 0 )
+    {
+        return;
+    }
+    const double targetSpeed = _motorOn ? 1.0 / _framePeriod : 0.0;
+    if ( _inertia > 0 )
+    {
+        const double speed = targetSpeed + ( _speed - targetSpeed ) * std::exp( -dt / _inertia );
+        _position += 0.5 * ( _speed + speed ) * dt;
+        _speed = speed;
+    }
+    else
+    {
+        _speed = targetSpeed;
+        _position += _speed * dt;
+    }
+}
+
+/**
+ * @brief transport work
+ */
+void FilmTransportSimulator::work()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    while( !_stop )
+    {
+        const boost::int64_t now = captureTimestamp();
+        advance( now );
+
+        if ( _position >= _framePitch )
+        {
+            // Next frame is in the gate
+            _position -= _framePitch;
+            if ( _frameInGate )
+            {
+                // The previous frame went away before its capture
+                ++_nbOvershot;
+            }
+            _frameInGate = true;
+            _lastEdge = now;
+            if ( _firstEdge < 0 )
+            {
+                _firstEdge = _lastEdge;
+            }
+            ++_nbFrames;
+            _framePitch = nextFramePitch();
+            lock.unlock();
+            _sensor.setValGpio( true );
+            _sensor.setValGpio( false );
+            lock.lock();
+            continue;
+        }
+
+        // Film is moving or coasting
+        if ( _motorOn || _speed * _framePeriod > 1e-3 )
+        {
+            _motorChanged.wait_for( lock, std::chrono::microseconds( kMoveStep ) );
+            continue;
+        }
+        _speed = 0;
+
+        if ( !_frameInGate )
+        {
+            // Transport stopped (not started yet, or capture stopped)
+            _motorChanged.wait( lock, [this]() { return _motorOn || _stop; } );
+            continue;
+        }
+
+        const boost::int64_t deadline = _lastEdge + _timeout;
+        if ( now < deadline )
+        {
+            _motorChanged.wait_for( lock, std::chrono::microseconds( deadline - now ), [this]() { return _motorOn || _stop; } );
+            continue;
+        }
+
+        // Frame held too long: drop it and move the film forward
+        ++_nbDropped;
+        _frameInGate = false;
+        lock.unlock();
+        // A speed controller caches the motor state: it has to restart the motor itself
+        if ( signalFrameDropped.empty() )
+        {
+            _motor.setValGpio( true );
+        }
+        else
+        {
+            signalFrameDropped();
+        }
+        lock.lock();
+    }
+}
+
+/**
+ * @brief get the throughput report and reset the statistics
+ * @return the printable report, empty if no frame went thru the gate
+ */
+std::string FilmTransportSimulator::report()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    if ( !_nbFrames )
+    {
+        return std::string();
+    }
+
+    std::ostringstream os;
+    const double elapsed = std::max<boost::int64_t>( _lastEdge - _firstEdge, 1 ) / 1000000.0;
+    const double transportRate = 1000000.0 / _framePeriod;
+    os << boost::format( "Simulation: %1% frames in %2$.2fs (%3$.2f fps, transport at %4$.2f fps), dropped %5% (%6$.2f%%)" )
+          % _nbFrames % elapsed % ( ( _nbFrames - 1 ) / elapsed ) % transportRate
+          % _nbDropped % ( 100.0 * _nbDropped / _nbFrames ) << std::endl;
+
+    if ( !_holdTimes.empty() )
+    {
+        std::vector<boost::int64_t> holdTimes = _holdTimes;
+        std::sort( holdTimes.begin(), holdTimes.end() );
+        const double mean = std::accumulate( holdTimes.begin(), holdTimes.end(), 0.0 ) / holdTimes.size();
+        const boost::int64_t p95 = holdTimes[ std::min( holdTimes.size() - 1, holdTimes.size() * 95 / 100 ) ];
+        os << boost::format( "  hold time (ms): mean %1$.2f, p95 %2$.2f, max %3$.2f" )
+              % ( mean / 1000.0 ) % ( p95 / 1000.0 ) % ( holdTimes.back() / 1000.0 ) << std::endl;
+        // 95% of the frames are captured in time at this rate
+        os << boost::format( "  max sustainable rate: %1$.2f fps at this transport speed, %2$.2f fps pipeline bound" )
+              % ( 1000000.0 / ( _framePeriod + p95 ) ) % ( 1000000.0 / std::max<boost::int64_t>( p95, 1 ) ) << std::endl;
+        os << boost::format( "  overshot %1% (%2$.2f%%), mean coast %3$.1f%% of a frame" )
+              % _nbOvershot % ( 100.0 * _nbOvershot / _nbFrames ) % ( 100.0 * _coastSum / holdTimes.size() );
+    }
+
+    _firstEdge = -1;
+    _lastEdge = -1;
+    _nbFrames = 0;
+    _nbDropped = 0;
+    _nbOvershot = 0;
+    _coastSum = 0;
+    _frameInGate = false;
+    _holdTimes.clear();
+    return os.str();
+}
+
+}
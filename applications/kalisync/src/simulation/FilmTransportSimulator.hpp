@@ -0,0 +1,118 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_FILMTRANSPORTSIMULATOR_HPP_
+#define	_KALI_FILMTRANSPORTSIMULATOR_HPP_
+
+#include "SimulatedGpio.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/signals2.hpp>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kaliscope
+{
+
+/**
+ * @brief emulates the film transport of the telecinema
+ * While the motor pin is on, the film travels and a sensor edge is raised
+ * each frame (frame pitch has a gaussian jitter). The film speed follows the
+ * motor pin with a first order inertia, so it keeps coasting after the motor
+ * is stopped: a frame is overshot when it coasts past the registration
+ * tolerance. A frame is dropped when it is held longer than the timeout,
+ * the transport is then restarted as the operator would do: by the slots
+ * of signalFrameDropped, or by the motor pin if there are none.
+ * Driving the motor pin with a PWM gives a speed proportional to the duty.
+ */
+class FilmTransportSimulator
+{
+public:
+    /**
+     * @brief constructor
+     * @param sensor[in] simulated sensor pin, edges are raised on it
+     * @param motor[in] simulated motor pin
+     * @param frameRate[in] transport speed (frames per second at full speed)
+     * @param jitter[in] standard deviation of the frame pitch (ratio of the pitch)
+     * @param timeout[in] maximum hold time of a frame (milliseconds)
+     * @param inertia[in] time constant of the transport speed (milliseconds, 0 for an instant stop)
+     */
+    FilmTransportSimulator( SimulatedGpio & sensor, SimulatedGpio & motor, const double frameRate, const double jitter, const int timeout, const int inertia = 0 );
+    ~FilmTransportSimulator();
+
+    /**
+     * @brief start the transport thread
+     */
+    void start();
+
+    /**
+     * @brief stop the transport thread
+     */
+    void stop();
+
+    /**
+     * @brief get the throughput report and reset the statistics
+     * @return the printable report, empty if no frame went thru the gate
+     */
+    std::string report();
+
+public:
+    boost::signals2::signal<void()> signalFrameDropped;    ///< Signalize that a frame was held too long, the transport is to be restarted
+
+private:
+    /**
+     * @brief transport work
+     */
+    void work();
+
+    /**
+     * @brief draw the pitch of the next frame
+     * @return frame pitch (1 is the nominal pitch)
+     */
+    double nextFramePitch();
+
+    /**
+     * @brief move the film up to the given time
+     */
+    void advance( const boost::int64_t now );
+
+    void onMotorChanged( const bool value );
+
+private:
+    SimulatedGpio & _sensor;                ///< Sensor pin
+    SimulatedGpio & _motor;                 ///< Motor pin
+    const double _framePeriod;              ///< Frame period at full speed (microseconds)
+    const double _jitter;                   ///< Pitch standard deviation (ratio)
+    const boost::int64_t _timeout;          ///< Maximum hold time (microseconds)
+    const double _inertia;                  ///< Speed time constant (microseconds)
+    std::mt19937 _random;                   ///< Jitter generator
+    std::mutex _mutex;                      ///< Mutex thread
+    std::condition_variable _motorChanged;  ///< Signalize motor changes
+    bool _motorOn = false;                  ///< Is the motor running
+    bool _stop = true;                      ///< Stops transport thread
+    boost::int64_t _lastStep = -1;          ///< Time of the last film move
+    double _speed = 0;                      ///< Film speed (frames per microsecond)
+    double _position = 0;                   ///< Film travelled since the last sensor edge (frames)
+    double _framePitch = 1;                 ///< Pitch of the coming frame (frames)
+    bool _frameInGate = false;              ///< Is a frame waiting for its capture
+    boost::int64_t _firstEdge = -1;         ///< First sensor edge of the run
+    boost::int64_t _lastEdge = -1;          ///< Last sensor edge of the run
+    std::size_t _nbFrames = 0;              ///< Frames that went thru the gate
+    std::size_t _nbDropped = 0;             ///< Frames held too long
+    std::size_t _nbOvershot = 0;            ///< Frames that coasted past the tolerance
+    double _coastSum = 0;                   ///< Sum of the coasting distances (frames)
+    std::vector<boost::int64_t> _holdTimes; ///< Hold time of each captured frame
+    std::unique_ptr<std::thread> _thread;   ///< Transport thread
+};
+
+}
+
+#endif
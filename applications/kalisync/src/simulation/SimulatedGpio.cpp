@@ -0,0 +1,59 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "SimulatedGpio.hpp"
+
+namespace kaliscope
+{
+
+SimulatedGpio::SimulatedGpio( const std::size_t numPin )
+: GpioWatcher( numPin, -1 )
+, _simulatedValue( false )
+{
+}
+
+SimulatedGpio::~SimulatedGpio()
+{
+}
+
+bool SimulatedGpio::exportGpio()
+{
+    return true;
+}
+
+bool SimulatedGpio::unexportGpio()
+{
+    return true;
+}
+
+bool SimulatedGpio::setDirGpio( const std::string & )
+{
+    return true;
+}
+
+/**
+ * @brief set gpio value
+ * @param value true or false
+ * @return always true
+ */
+bool SimulatedGpio::setValGpio( const bool value )
+{
+    _simulatedValue = value;
+    signalGpioValueChanged( gpioId(), value );
+    return true;
+}
+
+/**
+ * @brief get gpio value
+ * @param val[out] output value
+ * @return always true
+ */
+bool SimulatedGpio::getValGpio( bool & val )
+{
+    val = _simulatedValue;
+    return true;
+}
+
+}
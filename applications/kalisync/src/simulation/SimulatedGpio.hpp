@@ -0,0 +1,54 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_SIMULATEDGPIO_HPP_
+#define	_KALI_SIMULATEDGPIO_HPP_
+
+#include "../GpioWatcher.hpp"
+
+#include <atomic>
+
+namespace kaliscope
+{
+
+/**
+ * @brief in memory GPIO pin, used by the simulation mode
+ * Every value set is signalized thru signalGpioValueChanged,
+ * so that simulated hardware can react to output pins.
+ */
+class SimulatedGpio : public GpioWatcher
+{
+public:
+    SimulatedGpio( const std::size_t numPin );
+    virtual ~SimulatedGpio();
+
+    bool exportGpio();
+    bool unexportGpio();
+    bool setDirGpio( const std::string & dir );
+
+    /**
+     * @brief set gpio value
+     * @param value true or false
+     * @return always true
+     */
+    bool setValGpio( const bool value );
+
+    /**
+     * @brief get gpio value
+     * @param val[out] output value
+     * @return always true
+     */
+    bool getValGpio( bool & val );
+
+    inline bool value() const
+    { return _simulatedValue; }
+
+private:
+    std::atomic<bool> _simulatedValue;  ///< Pin value
+};
+
+}
+
+#endif
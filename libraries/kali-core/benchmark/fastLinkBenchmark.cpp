@@ -0,0 +1,265 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+/**
+ * Loopback round trip benchmark of the kalisync/kaliscope event links.
+ * A client sends a 'frame captured' event, the server answers with a
+ * 'next track' event, as on each frame of a capture. The binary link and
+ * the text archive protocol are measured the same way, and so is the
+ * encoding and decoding cost of a frame trigger in both formats.
+ */
+
+#include <kali-core/EventCodec.hpp>
+#include <kali-core/FastLink.hpp>
+#include <kali-core/stateMachineEvents.hpp>
+
+#include <mvp-player-core/stateMachineEvents.hpp>
+#include <mvp-player-net/client/Client.hpp>
+#include <mvp-player-net/server/Server.hpp>
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace bpo = boost::program_options;
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief answers received by the client
+ */
+class Answers
+{
+public:
+    void received()
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        ++_count;
+        _condition.notify_one();
+    }
+
+    /**
+     * @brief wait for the answer count to reach n
+     * @return false on timeout
+     */
+    bool wait( const std::size_t n, const std::chrono::milliseconds timeout )
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        return _condition.wait_for( lock, timeout, [this, n]() { return _count >= n; } );
+    }
+
+    std::size_t count()
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        return _count;
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::size_t _count = 0;
+};
+
+/**
+ * @brief ping-pong rounds
+ * @param send sends the 'frame captured' event
+ * @return the round trip times (microseconds), empty if the link doesn't answer
+ */
+std::vector<double> pingPong( const std::function<void()> & send, Answers & answers, const std::size_t nbRounds )
+{
+    std::vector<double> times;
+    times.reserve( nbRounds );
+    // The connection may still be settling: wait for the first answer
+    const std::size_t first = answers.count();
+    send();
+    if ( !answers.wait( first + 1, std::chrono::milliseconds( 2000 ) ) )
+    {
+        return times;
+    }
+    for( std::size_t i = 1; i <= nbRounds; ++i )
+    {
+        const Clock::time_point start = Clock::now();
+        send();
+        if ( !answers.wait( first + 1 + i, std::chrono::milliseconds( 1000 ) ) )
+        {
+            times.clear();
+            break;
+        }
+        times.push_back( std::chrono::duration<double, std::micro>( Clock::now() - start ).count() );
+    }
+    return times;
+}
+
+void printTimes( const char * name, std::vector<double> times )
+{
+    if ( times.empty() )
+    {
+        std::printf( "%-8s no answer\n", name );
+        return;
+    }
+    std::sort( times.begin(), times.end() );
+    double sum = 0.0;
+    for( const double t: times )
+    { sum += t; }
+    std::printf( "%-8s rounds %zu  min %.1fus  median %.1fus  mean %.1fus  p99 %.1fus  max %.1fus\n",
+                 name, times.size(), times.front(), times[times.size() / 2], sum / times.size(),
+                 times[std::min( times.size() - 1, times.size() * 99 / 100 )], times.back() );
+}
+
+/**
+ * @brief encode and decode cost of a frame trigger (capture trace and next track)
+ */
+void benchmarkCodec( const std::size_t nbRounds )
+{
+    kaliscope::CaptureTrace trace( 1 );
+    trace.mark( kaliscope::eCaptureStageSensorEdge );
+    trace.mark( kaliscope::eCaptureStageTriggerSent );
+    const kaliscope::logic::EvCaptureTrace traceEvent( trace );
+    const mvpplayer::logic::EvNextTrack nextTrack;
+    std::vector<boost::uint8_t> packet;
+    std::size_t bytes = 0;
+    const Clock::time_point start = Clock::now();
+    for( std::size_t i = 0; i < nbRounds; ++i )
+    {
+        kaliscope::codec::encode( traceEvent, packet );
+        bytes += packet.size();
+        kaliscope::codec::decode( kaliscope::codec::decodeHeader( &packet[0] ), &packet[kaliscope::codec::kHeaderSize] );
+        kaliscope::codec::encode( nextTrack, packet );
+        bytes += packet.size();
+        kaliscope::codec::decode( kaliscope::codec::decodeHeader( &packet[0] ), &packet[kaliscope::codec::kHeaderSize] );
+    }
+    const double elapsed = std::chrono::duration<double, std::nano>( Clock::now() - start ).count();
+    std::printf( "codec    binary %.0fns per frame trigger (%zu bytes)\n", elapsed / nbRounds, bytes / nbRounds );
+}
+
+/**
+ * @brief same, with the text archives of the text protocol (events sent thru an IEvent pointer)
+ */
+void benchmarkTextCodec( const std::size_t nbRounds )
+{
+    kaliscope::CaptureTrace trace( 1 );
+    trace.mark( kaliscope::eCaptureStageSensorEdge );
+    trace.mark( kaliscope::eCaptureStageTriggerSent );
+    kaliscope::logic::EvCaptureTrace traceEvent( trace );
+    mvpplayer::logic::EvNextTrack nextTrack;
+    mvpplayer::IEvent * const events[] = { &traceEvent, &nextTrack };
+    std::size_t bytes = 0;
+    const Clock::time_point start = Clock::now();
+    for( std::size_t i = 0; i < nbRounds; ++i )
+    {
+        for( mvpplayer::IEvent * event: events )
+        {
+            std::ostringstream out;
+            {
+                boost::archive::text_oarchive archive( out );
+                archive << event;
+            }
+            const std::string text = out.str();
+            bytes += text.size();
+            std::istringstream in( text );
+            boost::archive::text_iarchive archive( in );
+            mvpplayer::IEvent * decoded = NULL;
+            archive >> decoded;
+            delete decoded;
+        }
+    }
+    const double elapsed = std::chrono::duration<double, std::nano>( Clock::now() - start ).count();
+    std::printf( "codec    text %.0fns per frame trigger (%zu bytes)\n", elapsed / nbRounds, bytes / nbRounds );
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    using namespace kaliscope;
+    bpo::options_description options( "Allowed options" );
+    options.add_options()
+        ( "help", "Print this help" )
+        ( "rounds", bpo::value<std::size_t>()->default_value( 10000 ), "Number of round trips per protocol" )
+        ( "fastLinkPort", bpo::value<unsigned short>()->default_value( kDefaultFastLinkPort ), "Port of the binary link" )
+        ( "port", bpo::value<unsigned short>()->default_value( mvpplayer::network::server::kDefaultServerPort ), "Port of the text protocol" );
+    bpo::variables_map vm;
+    bpo::store( bpo::parse_command_line( argc, argv, options ), vm );
+    bpo::notify( vm );
+    if ( vm.count( "help" ) )
+    {
+        std::cout << options << std::endl;
+        return 0;
+    }
+    const std::size_t nbRounds = vm["rounds"].as<std::size_t>();
+
+    benchmarkCodec( nbRounds );
+    benchmarkTextCodec( nbRounds );
+
+    // Binary link
+    {
+        FastLinkServer server( vm["fastLinkPort"].as<unsigned short>() );
+        server.signalEvent.connect(
+            [&server]( mvpplayer::IEvent & )
+            {
+                mvpplayer::logic::EvNextTrack answer;
+                server.sendEventMulticast( answer );
+            }
+        );
+        server.run();
+        FastLinkClient client;
+        Answers answers;
+        client.signalEvent.connect( [&answers]( mvpplayer::IEvent & ) { answers.received(); } );
+        std::vector<double> times;
+        if ( client.connect( "127.0.0.1", vm["fastLinkPort"].as<unsigned short>() ) )
+        {
+            times = pingPong(
+                [&client]()
+                {
+                    mvpplayer::logic::EvCustomState event( kFrameCapturedCustomStateAction );
+                    client.sendEvent( event );
+                }, answers, nbRounds );
+        }
+        printTimes( "binary", times );
+        client.disconnect();
+        server.stop();
+    }
+
+    // Text archive protocol
+    {
+        mvpplayer::network::server::Server server( vm["port"].as<unsigned short>() );
+        server.signalEventFrom.connect(
+            [&server]( const std::string &, mvpplayer::IEvent & )
+            {
+                mvpplayer::logic::EvNextTrack answer;
+                server.sendEventMulticast( answer );
+            }
+        );
+        server.run();
+        mvpplayer::network::client::Client client;
+        Answers answers;
+        client.signalEvent.connect( [&answers]( mvpplayer::IEvent & ) { answers.received(); } );
+        client.connect( "127.0.0.1" );
+        const std::vector<double> times = pingPong(
+            [&client]()
+            {
+                mvpplayer::logic::EvCustomState event( kFrameCapturedCustomStateAction );
+                client.sendEvent( event );
+            }, answers, nbRounds );
+        printTimes( "text", times );
+        client.disconnect();
+        server.stop();
+    }
+    return 0;
+}
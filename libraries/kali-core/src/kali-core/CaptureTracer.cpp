@@ -0,0 +1,277 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "CaptureTracer.hpp"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+
+namespace kaliscope
+{
+
+const char * captureStageName( const ECaptureStage stage )
+{
+    switch( stage )
+    {
+        case eCaptureStageSensorEdge: return "sensor edge";
+        case eCaptureStageTriggerSent: return "trigger sent";
+        case eCaptureStageTriggerReceived: return "trigger received";
+        case eCaptureStageComputeStart: return "compute start";
+        case eCaptureStageExposureDone: return "exposure done";
+        case eCaptureStageComputeDone: return "compute done";
+        case eCaptureStageDisplayDone: return "display done";
+        case eCaptureStageCapturedReceived: return "captured received";
+        case eCaptureStageMotorRestart: return "motor restart";
+        case eCaptureStageCount: break;
+    }
+    return "unknown";
+}
+
+namespace
+{
+
+const char * segmentName( const CaptureLatencyReport::ESegment segment )
+{
+    switch( segment )
+    {
+        case CaptureLatencyReport::eSegmentTrigger: return "sensor -> trigger";
+        case CaptureLatencyReport::eSegmentNetwork: return "network (round trip)";
+        case CaptureLatencyReport::eSegmentQueue: return "engine queue";
+        case CaptureLatencyReport::eSegmentExposure: return "engine exposure";
+        case CaptureLatencyReport::eSegmentCompute: return "engine compute";
+        case CaptureLatencyReport::eSegmentDisplay: return "display";
+        case CaptureLatencyReport::eSegmentMotor: return "captured -> motor";
+        case CaptureLatencyReport::eSegmentTotal: return "total";
+        case CaptureLatencyReport::eSegmentCount: break;
+    }
+    return "unknown";
+}
+
+inline double toMs( const boost::int64_t us )
+{
+    return us / 1000.0;
+}
+
+}
+
+CaptureLatencyReport::CaptureLatencyReport( const boost::int64_t histogramBinWidth, const std::size_t histogramNbBins )
+: _histogramBinWidth( std::max<boost::int64_t>( histogramBinWidth, 1 ) )
+, _histogramNbBins( std::max<std::size_t>( histogramNbBins, 1 ) )
+{
+}
+
+/**
+ * @brief add a finished trace
+ */
+void CaptureLatencyReport::add( const CaptureTrace & trace )
+{
+    const boost::int64_t total = trace.elapsed( eCaptureStageSensorEdge, eCaptureStageMotorRestart );
+    if ( total < 0 )
+    {
+        return;
+    }
+    _segments[eSegmentTotal].push_back( total );
+
+    const boost::int64_t trigger = trace.elapsed( eCaptureStageSensorEdge, eCaptureStageTriggerSent );
+    const boost::int64_t roundTrip = trace.elapsed( eCaptureStageTriggerSent, eCaptureStageCapturedReceived );
+    // The transport is released on the exposure if kaliscope reports it, else on the computed frame
+    const ECaptureStage released = trace.has( eCaptureStageExposureDone ) ? eCaptureStageExposureDone : eCaptureStageComputeDone;
+    const boost::int64_t remote = trace.elapsed( eCaptureStageTriggerReceived, released );
+    const boost::int64_t queue = trace.elapsed( eCaptureStageTriggerReceived, eCaptureStageComputeStart );
+    const boost::int64_t exposure = trace.elapsed( eCaptureStageComputeStart, eCaptureStageExposureDone );
+    const boost::int64_t compute = trace.elapsed( eCaptureStageComputeStart, eCaptureStageComputeDone );
+    const boost::int64_t display = trace.elapsed( eCaptureStageComputeDone, eCaptureStageDisplayDone );
+    const boost::int64_t motor = trace.elapsed( eCaptureStageCapturedReceived, eCaptureStageMotorRestart );
+
+    if ( trigger >= 0 )
+    { _segments[eSegmentTrigger].push_back( trigger ); }
+    // Clocks of both processes are not comparable, so the network time is
+    // what is left of the round trip once the remote processing is removed
+    if ( roundTrip >= 0 && remote >= 0 )
+    { _segments[eSegmentNetwork].push_back( std::max<boost::int64_t>( roundTrip - remote, 0 ) ); }
+    if ( queue >= 0 )
+    { _segments[eSegmentQueue].push_back( queue ); }
+    if ( exposure >= 0 )
+    { _segments[eSegmentExposure].push_back( exposure ); }
+    if ( compute >= 0 )
+    { _segments[eSegmentCompute].push_back( compute ); }
+    if ( display >= 0 )
+    { _segments[eSegmentDisplay].push_back( display ); }
+    if ( motor >= 0 )
+    { _segments[eSegmentMotor].push_back( motor ); }
+}
+
+void CaptureLatencyReport::clear()
+{
+    for( std::vector<boost::int64_t> & segment: _segments )
+    { segment.clear(); }
+}
+
+/**
+ * @brief get a printable per-segment breakdown with a histogram of the total latency
+ */
+std::string CaptureLatencyReport::str() const
+{
+    std::ostringstream os;
+    os << "Capture latency over " << size() << " frame(s), in ms:" << std::endl;
+    os << boost::format( "%-22s %6s %9s %9s %9s %9s %9s" ) % "segment" % "count" % "min" % "mean" % "p50" % "p95" % "max" << std::endl;
+    for( std::size_t s = 0; s < eSegmentCount; ++s )
+    {
+        std::vector<boost::int64_t> values = _segments[s];
+        if ( values.empty() )
+        {
+            os << boost::format( "%-22s %6d" ) % segmentName( ESegment( s ) ) % 0 << std::endl;
+            continue;
+        }
+        std::sort( values.begin(), values.end() );
+        const double mean = std::accumulate( values.begin(), values.end(), 0.0 ) / values.size();
+        const boost::int64_t p50 = values[ ( values.size() - 1 ) * 50 / 100 ];
+        const boost::int64_t p95 = values[ ( values.size() - 1 ) * 95 / 100 ];
+        os << boost::format( "%-22s %6d %9.2f %9.2f %9.2f %9.2f %9.2f" )
+              % segmentName( ESegment( s ) ) % values.size()
+              % toMs( values.front() ) % toMs( mean ) % toMs( p50 ) % toMs( p95 ) % toMs( values.back() ) << std::endl;
+    }
+
+    const std::vector<boost::int64_t> & totals = _segments[eSegmentTotal];
+    if ( !totals.empty() )
+    {
+        std::vector<std::size_t> bins( _histogramNbBins, 0 );
+        for( const boost::int64_t total: totals )
+        {
+            ++bins[ std::min<std::size_t>( total / _histogramBinWidth, _histogramNbBins - 1 ) ];
+        }
+        const std::size_t maxBin = *std::max_element( bins.begin(), bins.end() );
+        static const std::size_t kBarWidth = 50;
+        os << "Total latency histogram:" << std::endl;
+        for( std::size_t b = 0; b < _histogramNbBins; ++b )
+        {
+            const std::string range = ( b + 1 < _histogramNbBins ) ?
+                ( boost::format( "%7.1f - %7.1f" ) % toMs( b * _histogramBinWidth ) % toMs( ( b + 1 ) * _histogramBinWidth ) ).str() :
+                ( boost::format( "%7.1f -   ...  " ) % toMs( b * _histogramBinWidth ) ).str();
+            os << range << boost::format( " %6d " ) % bins[b] << std::string( bins[b] * kBarWidth / maxBin, '#' ) << std::endl;
+        }
+    }
+    return os.str();
+}
+
+CaptureTracer::CaptureTracer()
+{
+}
+
+/**
+ * @brief begin a new trace (kalisync side)
+ * @return the trace, with a new correlation id and the sensor edge stamped
+ */
+CaptureTrace CaptureTracer::begin()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    _current = CaptureTrace( _nextId++ );
+    _current.mark( eCaptureStageSensorEdge );
+    return _current;
+}
+
+/**
+ * @brief adopt a trace received from the other process (kaliscope side)
+ * @param trace received trace, the trigger reception is stamped
+ */
+void CaptureTracer::adopt( const CaptureTrace & trace )
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    // Only keep the correlation id: stamps of the other process are useless here
+    CaptureTrace adopted( trace.correlationId );
+    adopted.mark( eCaptureStageTriggerReceived );
+    _adopted.push_back( adopted );
+}
+
+/**
+ * @brief stamp a stage of the trace in flight
+ * @return the correlation id of the stamped trace, 0 if it has none
+ */
+boost::uint64_t CaptureTracer::mark( const ECaptureStage stage )
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    if ( stage == eCaptureStageComputeStart && !_adopted.empty() )
+    {
+        _current = _adopted.front();
+        _adopted.pop_front();
+    }
+    _current.mark( stage );
+    return _current.correlationId;
+}
+
+/**
+ * @brief the trace in flight is finished on this side
+ * Traces begun by this tracer are kept until the other process sends its stages back.
+ * @return the finished trace
+ */
+CaptureTrace CaptureTracer::finish()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    const CaptureTrace trace = _current;
+    if ( trace.has( eCaptureStageSensorEdge ) )
+    {
+        _finished[trace.correlationId] = trace;
+    }
+    _current = CaptureTrace();
+    return trace;
+}
+
+/**
+ * @brief merge stages stamped by the other process into a finished trace (kalisync side)
+ * @param remote trace sent back by the other process
+ */
+void CaptureTracer::merge( const CaptureTrace & remote )
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    auto it = _finished.find( remote.correlationId );
+    if ( it == _finished.end() )
+    {
+        return;
+    }
+    CaptureTrace & trace = it->second;
+    for( std::size_t s = eCaptureStageTriggerReceived; s <= eCaptureStageDisplayDone; ++s )
+    {
+        trace.stamps[s] = remote.stamps[s];
+    }
+    _report.add( trace );
+    _finished.erase( it );
+}
+
+/**
+ * @brief number of adopted traces not finished yet (kaliscope side)
+ */
+std::size_t CaptureTracer::queueDepth()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    return _adopted.size() + ( _current.correlationId ? 1 : 0 );
+}
+
+/**
+ * @brief get the latency report and reset the tracer
+ * @return the printable report, empty if no frame was traced
+ */
+std::string CaptureTracer::report()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    // Frames whose remote stages never came back still count for the local segments
+    for( const auto & finished: _finished )
+    {
+        _report.add( finished.second );
+    }
+    _finished.clear();
+    _adopted.clear();
+    if ( !_report.size() )
+    {
+        return std::string();
+    }
+    const std::string result = _report.str();
+    _report.clear();
+    return result;
+}
+
+}
@@ -0,0 +1,211 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_CORE_CAPTURETRACER_HPP_
+#define	_KALI_CORE_CAPTURETRACER_HPP_
+
+#include <boost/serialization/serialization.hpp>
+#include <boost/cstdint.hpp>
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace kaliscope
+{
+
+/**
+ * @brief stages of a frame capture, from the sensor edge to the motor restart
+ * Stages are ordered as they happen on the capture chain.
+ */
+enum ECaptureStage
+{
+    eCaptureStageSensorEdge = 0,        ///< (kalisync) sensor edge seen by the gpio watcher
+    eCaptureStageTriggerSent,           ///< (kalisync) capture event sent to kaliscope
+    eCaptureStageTriggerReceived,       ///< (kaliscope) capture event received from kalisync
+    eCaptureStageComputeStart,          ///< (kaliscope) engine starts computing the frame
+    eCaptureStageExposureDone,          ///< (kaliscope) reader has acquired the frame
+    eCaptureStageComputeDone,           ///< (kaliscope) engine has computed the frame
+    eCaptureStageDisplayDone,           ///< (kaliscope) frame has been displayed
+    eCaptureStageCapturedReceived,      ///< (kalisync) first 'exposure complete' or 'frame captured' event received
+    eCaptureStageMotorRestart,          ///< (kalisync) motor has been restarted
+    eCaptureStageCount
+};
+
+/**
+ * @brief get a printable name of a capture stage
+ */
+const char * captureStageName( const ECaptureStage stage );
+
+/**
+ * @brief get the current trace timestamp
+ * @return microseconds on a monotonic clock (only meaningful inside a process)
+ */
+inline boost::int64_t captureTimestamp()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/**
+ * @brief timestamps of one frame capture
+ * Stamps from both processes are kept in their own clock,
+ * only durations between stamps of the same process are meaningful.
+ */
+struct CaptureTrace
+{
+    CaptureTrace( const boost::uint64_t id = 0 )
+    : correlationId( id )
+    {
+        for( boost::int64_t & stamp: stamps )
+        { stamp = -1; }
+    }
+
+    /**
+     * @brief stamp a stage with the current time
+     */
+    inline void mark( const ECaptureStage stage )
+    { stamps[stage] = captureTimestamp(); }
+
+    inline bool has( const ECaptureStage stage ) const
+    { return stamps[stage] >= 0; }
+
+    /**
+     * @brief duration between two stages of the same process
+     * @return microseconds, -1 if one of the stages is missing
+     */
+    inline boost::int64_t elapsed( const ECaptureStage from, const ECaptureStage to ) const
+    { return ( has( from ) && has( to ) ) ? stamps[to] - stamps[from] : -1; }
+
+    friend class boost::serialization::access;
+    template<class Archive>
+    void serialize( Archive & ar, const unsigned int version )
+    {
+        ar & correlationId;
+        ar & stamps;
+    }
+
+    boost::uint64_t correlationId;                  ///< Identifies a capture in both processes
+    boost::int64_t stamps[eCaptureStageCount];      ///< Stage timestamps, -1 if not reached
+};
+
+/**
+ * @brief latency breakdown of a capture chain
+ * Collects finished capture traces and summarizes them per segment.
+ */
+class CaptureLatencyReport
+{
+public:
+    /**
+     * @brief segments of the capture chain
+     */
+    enum ESegment
+    {
+        eSegmentTrigger = 0,        ///< sensor edge -> trigger sent
+        eSegmentNetwork,            ///< network round trip (both ways)
+        eSegmentQueue,              ///< trigger received -> compute start
+        eSegmentExposure,           ///< compute start -> exposure done (reader)
+        eSegmentCompute,            ///< engine compute
+        eSegmentDisplay,            ///< compute done -> display done
+        eSegmentMotor,              ///< captured received -> motor restart
+        eSegmentTotal,              ///< sensor edge -> motor restart
+        eSegmentCount
+    };
+
+    CaptureLatencyReport( const boost::int64_t histogramBinWidth = 5000, const std::size_t histogramNbBins = 20 );
+
+    /**
+     * @brief add a finished trace
+     */
+    void add( const CaptureTrace & trace );
+
+    /**
+     * @brief number of traced frames
+     */
+    inline std::size_t size() const
+    { return _segments[eSegmentTotal].size(); }
+
+    void clear();
+
+    /**
+     * @brief get a printable per-segment breakdown with a histogram of the total latency
+     */
+    std::string str() const;
+
+private:
+    std::vector<boost::int64_t> _segments[eSegmentCount];  ///< Per segment latencies (microseconds)
+    boost::int64_t _histogramBinWidth;                      ///< Histogram bin width (microseconds)
+    std::size_t _histogramNbBins;                           ///< Number of histogram bins (last one is overflow)
+};
+
+/**
+ * @brief thread safe tracer of the capture chain
+ * kalisync begins a trace on each sensor edge and merges the stages
+ * reported back by kaliscope. kaliscope adopts the trace it receives
+ * and stamps its own stages before sending it back.
+ */
+class CaptureTracer
+{
+public:
+    CaptureTracer();
+
+    /**
+     * @brief begin a new trace (kalisync side)
+     * @return the trace, with a new correlation id and the sensor edge stamped
+     */
+    CaptureTrace begin();
+
+    /**
+     * @brief adopt a trace received from the other process (kaliscope side)
+     * The film moves while frames are processed, so triggers can arrive before
+     * the previous frame is done: adopted traces are queued and become the trace
+     * in flight when the compute start is stamped.
+     * @param trace received trace, the trigger reception is stamped
+     */
+    void adopt( const CaptureTrace & trace );
+
+    /**
+     * @brief stamp a stage of the trace in flight
+     * @return the correlation id of the stamped trace, 0 if it has none
+     */
+    boost::uint64_t mark( const ECaptureStage stage );
+
+    /**
+     * @brief the trace in flight is finished on this side
+     * @return the finished trace
+     */
+    CaptureTrace finish();
+
+    /**
+     * @brief merge stages stamped by the other process into a finished trace (kalisync side)
+     * @param remote trace sent back by the other process
+     */
+    void merge( const CaptureTrace & remote );
+
+    /**
+     * @brief number of adopted traces not finished yet (kaliscope side)
+     */
+    std::size_t queueDepth();
+
+    /**
+     * @brief get the latency report and reset the tracer
+     * @return the printable report, empty if no frame was traced
+     */
+    std::string report();
+
+private:
+    std::mutex _mutex;                                      ///< Mutex thread
+    boost::uint64_t _nextId = 1;                            ///< Next correlation id
+    CaptureTrace _current;                                  ///< Trace in flight
+    std::deque<CaptureTrace> _adopted;                      ///< Received traces waiting for their frame
+    std::map<boost::uint64_t, CaptureTrace> _finished;      ///< Traces waiting for remote stages
+    CaptureLatencyReport _report;                           ///< Accumulated report
+};
+
+}
+
+#endif
@@ -0,0 +1,291 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "EventCodec.hpp"
+#include "stateMachineEvents.hpp"
+
+#include <mvp-player-core/stateMachineEvents.hpp>
+
+#include <algorithm>
+
+namespace kaliscope
+{
+namespace codec
+{
+
+namespace
+{
+
+inline void putU16( std::vector<boost::uint8_t> & out, const boost::uint16_t v )
+{
+    out.push_back( v & 0xff );
+    out.push_back( ( v >> 8 ) & 0xff );
+}
+
+inline void putU64( std::vector<boost::uint8_t> & out, const boost::uint64_t v )
+{
+    for( std::size_t i = 0; i < 8; ++i )
+    { out.push_back( ( v >> ( 8 * i ) ) & 0xff ); }
+}
+
+inline boost::uint16_t getU16( const boost::uint8_t *data )
+{
+    return boost::uint16_t( data[0] | ( data[1] << 8 ) );
+}
+
+inline boost::uint64_t getU64( const boost::uint8_t *data )
+{
+    boost::uint64_t v = 0;
+    for( std::size_t i = 0; i < 8; ++i )
+    { v |= boost::uint64_t( data[i] ) << ( 8 * i ); }
+    return v;
+}
+
+/**
+ * @brief start a packet, the payload size is patched by endPacket
+ */
+inline void beginPacket( std::vector<boost::uint8_t> & packet, const EPacketType type, const boost::uint8_t code )
+{
+    packet.clear();
+    packet.push_back( type );
+    packet.push_back( code );
+    putU16( packet, 0 );
+}
+
+inline void endPacket( std::vector<boost::uint8_t> & packet )
+{
+    const boost::uint16_t payloadSize = packet.size() - kHeaderSize;
+    packet[2] = payloadSize & 0xff;
+    packet[3] = ( payloadSize >> 8 ) & 0xff;
+}
+
+inline boost::uint8_t customStateCode( const std::string & action )
+{
+    if ( action == kFrameCapturedCustomStateAction )
+    { return eCustomStateFrameCaptured; }
+    else if ( action == kExposureCompleteCustomStateAction )
+    { return eCustomStateExposureComplete; }
+    else if ( action == kCaptureStopCustomStateAction )
+    { return eCustomStateCaptureStop; }
+    return 0;
+}
+
+/**
+ * @brief wire ids of the capture stages, in ECaptureStage order
+ * Stages can be inserted in the enum, ids never change: new stages get new ids.
+ */
+const boost::uint8_t kCaptureStageIds[] =
+{
+    1,  // eCaptureStageSensorEdge
+    2,  // eCaptureStageTriggerSent
+    3,  // eCaptureStageTriggerReceived
+    4,  // eCaptureStageComputeStart
+    5,  // eCaptureStageExposureDone
+    6,  // eCaptureStageComputeDone
+    7,  // eCaptureStageDisplayDone
+    8,  // eCaptureStageCapturedReceived
+    9,  // eCaptureStageMotorRestart
+};
+static_assert( sizeof( kCaptureStageIds ) == eCaptureStageCount, "each capture stage needs a wire id" );
+
+/**
+ * @brief capture stage of a wire id
+ * @return eCaptureStageCount if the stage is unknown
+ */
+inline ECaptureStage captureStage( const boost::uint8_t id )
+{
+    const boost::uint8_t *stage = std::find( kCaptureStageIds, kCaptureStageIds + eCaptureStageCount, id );
+    return ECaptureStage( stage - kCaptureStageIds );
+}
+
+inline const std::string * customStateAction( const boost::uint8_t code )
+{
+    switch( code )
+    {
+        case eCustomStateFrameCaptured: return &kFrameCapturedCustomStateAction;
+        case eCustomStateExposureComplete: return &kExposureCompleteCustomStateAction;
+        case eCustomStateCaptureStop: return &kCaptureStopCustomStateAction;
+    }
+    return nullptr;
+}
+
+}
+
+/**
+ * @brief build the hello message sent at connection time
+ * @param version protocol version (0 to refuse the binary protocol)
+ */
+std::vector<boost::uint8_t> encodeHello( const boost::uint16_t version )
+{
+    std::vector<boost::uint8_t> hello( kHelloMagic, kHelloMagic + 4 );
+    putU16( hello, version );
+    putU16( hello, 0 );
+    return hello;
+}
+
+/**
+ * @brief read a hello message
+ * @return the protocol version, 0 if the message is not a valid hello
+ */
+boost::uint16_t decodeHello( const boost::uint8_t *data )
+{
+    if ( !std::equal( kHelloMagic, kHelloMagic + 4, data ) )
+    {
+        return 0;
+    }
+    return getU16( data + 4 );
+}
+
+/**
+ * @brief encode an event
+ * @param event event to encode
+ * @param packet[out] header and payload
+ * @return false if the event has no binary encoding
+ */
+bool encode( const mvpplayer::IEvent & event, std::vector<boost::uint8_t> & packet )
+{
+    using namespace mvpplayer::logic;
+    if ( dynamic_cast<const EvNextTrack*>( &event ) )
+    {
+        beginPacket( packet, ePacketTypeNextTrack, 0 );
+    }
+    else if ( dynamic_cast<const EvStop*>( &event ) )
+    {
+        beginPacket( packet, ePacketTypeStop, 0 );
+    }
+    else if ( const EvCustomState *customState = dynamic_cast<const EvCustomState*>( &event ) )
+    {
+        const boost::uint8_t code = customStateCode( customState->action() );
+        if ( !code )
+        {
+            return false;
+        }
+        beginPacket( packet, ePacketTypeCustomState, code );
+    }
+    else if ( const logic::EvCaptureTrace *traceEvent = dynamic_cast<const logic::EvCaptureTrace*>( &event ) )
+    {
+        // Only the reached stages are sent
+        const CaptureTrace & trace = traceEvent->trace();
+        beginPacket( packet, ePacketTypeCaptureTrace, 0 );
+        putU64( packet, trace.correlationId );
+        for( std::size_t s = 0; s < eCaptureStageCount; ++s )
+        {
+            if ( trace.has( ECaptureStage( s ) ) )
+            {
+                packet.push_back( kCaptureStageIds[s] );
+                putU64( packet, boost::uint64_t( trace.stamps[s] ) );
+                ++packet[1];
+            }
+        }
+    }
+    else if ( const logic::EvCaptureProgress *progress = dynamic_cast<const logic::EvCaptureProgress*>( &event ) )
+    {
+        const boost::uint8_t code = customStateCode( progress->action() );
+        if ( !code )
+        {
+            return false;
+        }
+        beginPacket( packet, ePacketTypeCaptureProgress, code );
+        putU64( packet, progress->correlationId() );
+    }
+    else if ( const logic::EvFlowControl *flowEvent = dynamic_cast<const logic::EvFlowControl*>( &event ) )
+    {
+        const FlowState & state = flowEvent->state();
+        beginPacket( packet, ePacketTypeFlowControl, 0 );
+        putU16( packet, state.queueDepth );
+        putU16( packet, state.window );
+        putU64( packet, state.lastDoneId );
+    }
+    else
+    {
+        return false;
+    }
+    endPacket( packet );
+    return true;
+}
+
+/**
+ * @brief decode a packet header
+ */
+PacketHeader decodeHeader( const boost::uint8_t *data )
+{
+    PacketHeader header;
+    header.type = data[0];
+    header.code = data[1];
+    header.payloadSize = getU16( data + 2 );
+    return header;
+}
+
+/**
+ * @brief decode a packet
+ * @param header decoded header
+ * @param payload payload of header.payloadSize bytes
+ * @return the event, null if the packet is unknown
+ */
+boost::intrusive_ptr<boost::statechart::event_base> decode( const PacketHeader & header, const boost::uint8_t *payload )
+{
+    using namespace mvpplayer::logic;
+    switch( header.type )
+    {
+        case ePacketTypeNextTrack:
+        {
+            return boost::intrusive_ptr<boost::statechart::event_base>( new EvNextTrack() );
+        }
+        case ePacketTypeStop:
+        {
+            return boost::intrusive_ptr<boost::statechart::event_base>( new EvStop() );
+        }
+        case ePacketTypeCustomState:
+        {
+            const std::string *action = customStateAction( header.code );
+            if ( action )
+            {
+                return boost::intrusive_ptr<boost::statechart::event_base>( new EvCustomState( *action ) );
+            }
+            break;
+        }
+        case ePacketTypeCaptureTrace:
+        {
+            // Stages the other side knows but we don't are dropped, missing ones stay unset
+            if ( header.payloadSize != 8 + 9 * header.code )
+            {
+                break;
+            }
+            CaptureTrace trace( getU64( payload ) );
+            for( std::size_t s = 0; s < header.code; ++s )
+            {
+                const boost::uint8_t *entry = payload + 8 + 9 * s;
+                const ECaptureStage stage = captureStage( entry[0] );
+                if ( stage != eCaptureStageCount )
+                {
+                    trace.stamps[stage] = boost::int64_t( getU64( entry + 1 ) );
+                }
+            }
+            return boost::intrusive_ptr<boost::statechart::event_base>( new logic::EvCaptureTrace( trace ) );
+        }
+        case ePacketTypeCaptureProgress:
+        {
+            const std::string *action = customStateAction( header.code );
+            if ( action && header.payloadSize == 8 )
+            {
+                return boost::intrusive_ptr<boost::statechart::event_base>( new logic::EvCaptureProgress( *action, getU64( payload ) ) );
+            }
+            break;
+        }
+        case ePacketTypeFlowControl:
+        {
+            if ( header.payloadSize != 12 )
+            {
+                break;
+            }
+            const FlowState state( getU16( payload ), getU16( payload + 2 ), getU64( payload + 4 ) );
+            return boost::intrusive_ptr<boost::statechart::event_base>( new logic::EvFlowControl( state ) );
+        }
+    }
+    return boost::intrusive_ptr<boost::statechart::event_base>();
+}
+
+}
+}
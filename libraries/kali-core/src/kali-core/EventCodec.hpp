@@ -0,0 +1,101 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_CORE_EVENTCODEC_HPP_
+#define	_KALI_CORE_EVENTCODEC_HPP_
+
+#include <mvp-player-core/IEvent.hpp>
+
+#include <boost/statechart/event_base.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/cstdint.hpp>
+
+#include <vector>
+
+namespace kaliscope
+{
+
+/**
+ * @brief compact binary encoding of the high frequency kalisync/kaliscope events
+ * Each packet is a 4 bytes header { type, code, payload size (16 bits) }
+ * followed by a fixed layout payload. Integers are little endian.
+ * Events that are not listed here go thru the text archive protocol.
+ */
+namespace codec
+{
+
+static const boost::uint8_t kHelloMagic[4] = { 'K', 'L', 'N', 'K' };
+static const boost::uint16_t kProtocolVersion = 3;
+static const std::size_t kHelloSize = 8;
+static const std::size_t kHeaderSize = 4;
+static const std::size_t kMaxPayloadSize = 256;
+
+enum EPacketType
+{
+    ePacketTypeNextTrack = 1,
+    ePacketTypeStop,
+    ePacketTypeCustomState,         ///< code is one of ECustomStateCode
+    ePacketTypeCaptureTrace,        ///< code is the number of stamps, { correlation id (64 bits), { stage id (8 bits), stamp (64 bits) }... }
+    ePacketTypeFlowControl,         ///< { queue depth (16 bits), window (16 bits), last done id (64 bits) }
+    ePacketTypeCaptureProgress      ///< code is one of ECustomStateCode, { correlation id (64 bits) }
+};
+
+enum ECustomStateCode
+{
+    eCustomStateFrameCaptured = 1,
+    eCustomStateExposureComplete,
+    eCustomStateCaptureStop
+};
+
+/**
+ * @brief packet header
+ */
+struct PacketHeader
+{
+    boost::uint8_t type = 0;
+    boost::uint8_t code = 0;
+    boost::uint16_t payloadSize = 0;
+};
+
+/**
+ * @brief build the hello message sent at connection time
+ * @param version protocol version (0 to refuse the binary protocol)
+ */
+std::vector<boost::uint8_t> encodeHello( const boost::uint16_t version = kProtocolVersion );
+
+/**
+ * @brief read a hello message
+ * @return the protocol version, 0 if the message is not a valid hello
+ */
+boost::uint16_t decodeHello( const boost::uint8_t *data );
+
+/**
+ * @brief encode an event
+ * @param event event to encode
+ * @param packet[out] header and payload
+ * @return false if the event has no binary encoding
+ */
+bool encode( const mvpplayer::IEvent & event, std::vector<boost::uint8_t> & packet );
+
+/**
+ * @brief decode a packet header
+ */
+PacketHeader decodeHeader( const boost::uint8_t *data );
+
+/**
+ * @brief decode a packet
+ * @param header decoded header
+ * @param payload payload of header.payloadSize bytes
+ * @return the event (also an mvpplayer::IEvent), null if the packet is unknown
+ * @note events are reference counted (statechart events), keep the pointer
+ *       while dispatching: the state machine takes its own reference
+ */
+boost::intrusive_ptr<boost::statechart::event_base> decode( const PacketHeader & header, const boost::uint8_t *payload );
+
+}
+
+}
+
+#endif
@@ -0,0 +1,359 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "FastLink.hpp"
+#include "EventCodec.hpp"
+#include "RealtimeThread.hpp"
+
+#include <iostream>
+
+namespace kaliscope
+{
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+FastLinkConnection::FastLinkConnection( asio::io_service & ioService )
+: _socket( ioService )
+, _open( false )
+, _closed( false )
+{
+}
+
+FastLinkConnection::~FastLinkConnection()
+{
+    close();
+}
+
+/**
+ * @brief negotiate the protocol version
+ * The client sends its hello first. The server checks it, opens the
+ * connection, then answers: when the client gets the answer, the server
+ * already sends its events thru this connection.
+ * @param accepting server side of the connection
+ * @return true if the binary protocol is accepted by both sides
+ */
+bool FastLinkConnection::handshake( const bool accepting )
+{
+    boost::system::error_code ec;
+    _socket.set_option( tcp::no_delay( true ), ec );
+
+    const std::vector<boost::uint8_t> hello = codec::encodeHello();
+    boost::uint8_t otherHello[codec::kHelloSize];
+    if ( accepting )
+    {
+        asio::read( _socket, asio::buffer( otherHello ), ec );
+        if ( ec || codec::decodeHello( otherHello ) != codec::kProtocolVersion )
+        {
+            return false;
+        }
+        // Events sent from now on follow the hello in the stream
+        std::unique_lock<std::mutex> lock( _mutexWrite );
+        _open = true;
+        asio::write( _socket, asio::buffer( hello ), ec );
+        if ( ec )
+        {
+            _open = false;
+            return false;
+        }
+        return true;
+    }
+
+    asio::write( _socket, asio::buffer( hello ), ec );
+    if ( ec )
+    {
+        return false;
+    }
+    asio::read( _socket, asio::buffer( otherHello ), ec );
+    if ( ec || codec::decodeHello( otherHello ) != codec::kProtocolVersion )
+    {
+        return false;
+    }
+    _open = true;
+    return true;
+}
+
+/**
+ * @brief send an event
+ * @return false if the event has no binary encoding or on network error
+ */
+bool FastLinkConnection::send( const mvpplayer::IEvent & event )
+{
+    if ( !_open )
+    {
+        return false;
+    }
+    std::vector<boost::uint8_t> packet;
+    if ( !codec::encode( event, packet ) )
+    {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock( _mutexWrite );
+    boost::system::error_code ec;
+    asio::write( _socket, asio::buffer( packet ), ec );
+    if ( ec )
+    {
+        _open = false;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief read packets until the connection is closed, events are given to signalEvent
+ */
+void FastLinkConnection::readLoop()
+{
+    setupThreadRole( eThreadRoleNetwork );
+    boost::uint8_t headerData[codec::kHeaderSize];
+    boost::uint8_t payload[codec::kMaxPayloadSize];
+    while( _open )
+    {
+        boost::system::error_code ec;
+        asio::read( _socket, asio::buffer( headerData ), ec );
+        if ( ec )
+        {
+            break;
+        }
+        const codec::PacketHeader header = codec::decodeHeader( headerData );
+        if ( header.payloadSize > codec::kMaxPayloadSize )
+        {
+            std::cerr << "[FastLink] Invalid packet, closing connection." << std::endl;
+            break;
+        }
+        asio::read( _socket, asio::buffer( payload, header.payloadSize ), ec );
+        if ( ec )
+        {
+            break;
+        }
+
+        // Unknown packets are skipped
+        boost::intrusive_ptr<boost::statechart::event_base> event = codec::decode( header, payload );
+        if ( mvpplayer::IEvent *ievent = dynamic_cast<mvpplayer::IEvent*>( event.get() ) )
+        {
+            signalEvent( *ievent );
+        }
+    }
+    _open = false;
+}
+
+/**
+ * @brief close the connection (unblocks readLoop)
+ */
+void FastLinkConnection::close()
+{
+    _open = false;
+    _closed = true;
+    boost::system::error_code ec;
+    _socket.shutdown( tcp::socket::shutdown_both, ec );
+    _socket.close( ec );
+}
+
+FastLinkServer::FastLinkServer( const unsigned short port )
+: _acceptor( _ioService )
+, _stopped( true )
+{
+    try
+    {
+        const tcp::endpoint endpoint( tcp::v4(), port );
+        _acceptor.open( endpoint.protocol() );
+        _acceptor.set_option( tcp::acceptor::reuse_address( true ) );
+        _acceptor.bind( endpoint );
+        _acceptor.listen();
+    }
+    catch( const std::exception & e )
+    {
+        std::cerr << "[FastLink] Unable to listen on port " << port << " (" << e.what() << "), using text events only." << std::endl;
+        boost::system::error_code ec;
+        _acceptor.close( ec );
+    }
+}
+
+FastLinkServer::~FastLinkServer()
+{
+    stop();
+}
+
+/**
+ * @brief start accepting clients
+ */
+void FastLinkServer::run()
+{
+    if ( !_acceptor.is_open() || _acceptThread )
+    {
+        return;
+    }
+    _stopped = false;
+    _acceptThread.reset( new std::thread( &FastLinkServer::acceptWork, this ) );
+}
+
+/**
+ * @brief accept clients
+ */
+void FastLinkServer::acceptWork()
+{
+    while( !_stopped )
+    {
+        std::shared_ptr<FastLinkConnection> connection( new FastLinkConnection( _ioService ) );
+        boost::system::error_code ec;
+        _acceptor.accept( connection->socket(), ec );
+        if ( ec || _stopped )
+        {
+            break;
+        }
+        connection->signalEvent.connect( [this]( mvpplayer::IEvent & event ) { signalEvent( event ); } );
+
+        // The handshake runs on the client's thread: a client that never
+        // says hello doesn't block the next ones, and stop() closes it
+        std::unique_lock<std::mutex> lock( _mutexConnections );
+        pruneConnections();
+        _connections.push_back( connection );
+        _readThreads.emplace_back( new std::thread( &FastLinkServer::serveWork, this, connection ) );
+    }
+}
+
+/**
+ * @brief negotiate the protocol with a client and read its packets (client's thread)
+ */
+void FastLinkServer::serveWork( const std::shared_ptr<FastLinkConnection> & connection )
+{
+    // A client that doesn't speak the binary protocol uses the text one
+    if ( connection->handshake( true ) )
+    {
+        connection->readLoop();
+    }
+    connection->close();
+}
+
+/**
+ * @brief forget the closed connections, _mutexConnections must be locked
+ * Clients reconnecting after a network failure would pile up otherwise.
+ */
+void FastLinkServer::pruneConnections()
+{
+    for( std::size_t i = 0; i < _connections.size(); )
+    {
+        if ( _connections[i]->isClosed() )
+        {
+            _readThreads[i]->join();
+            _connections.erase( _connections.begin() + i );
+            _readThreads.erase( _readThreads.begin() + i );
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+/**
+ * @brief close all connections
+ */
+void FastLinkServer::stop()
+{
+    _stopped = true;
+    boost::system::error_code ec;
+    if ( _acceptThread )
+    {
+        // A blocking accept is not woken up by closing the acceptor, so connect to it
+        tcp::socket wakeUp( _ioService );
+        wakeUp.connect( tcp::endpoint( asio::ip::address_v4::loopback(), _acceptor.local_endpoint( ec ).port() ), ec );
+        _acceptThread->join();
+        _acceptThread.reset();
+    }
+    _acceptor.close( ec );
+
+    std::unique_lock<std::mutex> lock( _mutexConnections );
+    for( const std::shared_ptr<FastLinkConnection> & connection: _connections )
+    {
+        connection->close();
+    }
+    for( const std::unique_ptr<std::thread> & thread: _readThreads )
+    {
+        thread->join();
+    }
+    _readThreads.clear();
+    _connections.clear();
+}
+
+/**
+ * @brief send an event to all the clients connected to the binary link
+ * @return false if no binary client received it (no client or no binary encoding)
+ */
+bool FastLinkServer::sendEventMulticast( const mvpplayer::IEvent & event )
+{
+    std::unique_lock<std::mutex> lock( _mutexConnections );
+    bool sent = false;
+    for( const std::shared_ptr<FastLinkConnection> & connection: _connections )
+    {
+        sent = connection->send( event ) || sent;
+    }
+    return sent;
+}
+
+FastLinkClient::FastLinkClient()
+{
+}
+
+FastLinkClient::~FastLinkClient()
+{
+    disconnect();
+}
+
+/**
+ * @brief connect to a server and negotiate the binary protocol
+ * @return false if unavailable, the text protocol has to be used
+ */
+bool FastLinkClient::connect( const std::string & host, const unsigned short port )
+{
+    disconnect();
+    try
+    {
+        tcp::resolver resolver( _ioService );
+        tcp::resolver::iterator endpoint = resolver.resolve( tcp::resolver::query( host, std::to_string( port ) ) );
+
+        std::shared_ptr<FastLinkConnection> connection( new FastLinkConnection( _ioService ) );
+        asio::connect( connection->socket(), endpoint );
+        if ( !connection->handshake( false ) )
+        {
+            return false;
+        }
+        connection->signalEvent.connect( [this]( mvpplayer::IEvent & event ) { signalEvent( event ); } );
+        _connection = connection;
+        _readThread.reset( new std::thread( &FastLinkConnection::readLoop, _connection.get() ) );
+        return true;
+    }
+    catch( const std::exception & e )
+    {
+        std::cerr << "[FastLink] Binary link unavailable (" << e.what() << "), using text events only." << std::endl;
+        return false;
+    }
+}
+
+void FastLinkClient::disconnect()
+{
+    if ( _connection )
+    {
+        _connection->close();
+    }
+    if ( _readThread )
+    {
+        _readThread->join();
+        _readThread.reset();
+    }
+    _connection.reset();
+}
+
+/**
+ * @brief send an event
+ * @return false if not sent (not connected or no binary encoding)
+ */
+bool FastLinkClient::sendEvent( const mvpplayer::IEvent & event )
+{
+    return _connection && _connection->send( event );
+}
+
+}
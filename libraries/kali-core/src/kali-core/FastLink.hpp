@@ -0,0 +1,174 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_CORE_FASTLINK_HPP_
+#define	_KALI_CORE_FASTLINK_HPP_
+
+#include <mvp-player-core/IEvent.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/signals2.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kaliscope
+{
+
+static const unsigned short kDefaultFastLinkPort = 11998;
+
+/**
+ * @brief one connection of the binary event link
+ * Sockets are set to no-delay: packets are tiny and latency matters more than bandwidth.
+ */
+class FastLinkConnection
+{
+public:
+    FastLinkConnection( boost::asio::io_service & ioService );
+    ~FastLinkConnection();
+
+    boost::asio::ip::tcp::socket & socket()
+    { return _socket; }
+
+    /**
+     * @brief negotiate the protocol version (the client says hello first)
+     * @param accepting server side of the connection, opened before it answers
+     * @return true if the binary protocol is accepted by both sides
+     */
+    bool handshake( const bool accepting );
+
+    /**
+     * @brief send an event
+     * @return false if the event has no binary encoding or on network error
+     */
+    bool send( const mvpplayer::IEvent & event );
+
+    /**
+     * @brief read packets until the connection is closed, events are given to signalEvent
+     */
+    void readLoop();
+
+    /**
+     * @brief close the connection (unblocks readLoop)
+     */
+    void close();
+
+    inline bool isOpen() const
+    { return _open; }
+
+    /**
+     * @brief is the connection closed (by close, a failed handshake or a failed read)
+     */
+    inline bool isClosed() const
+    { return _closed; }
+
+public:
+    boost::signals2::signal<void( mvpplayer::IEvent & event )> signalEvent;    ///< Signalize that an event has been received
+
+private:
+    boost::asio::ip::tcp::socket _socket;   ///< Socket
+    std::mutex _mutexWrite;                 ///< Mutex thread
+    std::atomic<bool> _open;                ///< Is connection usable
+    std::atomic<bool> _closed;              ///< Is connection closed for good
+};
+
+/**
+ * @brief binary event link server (kalisync side)
+ */
+class FastLinkServer
+{
+public:
+    FastLinkServer( const unsigned short port = kDefaultFastLinkPort );
+    ~FastLinkServer();
+
+    /**
+     * @brief start accepting clients
+     */
+    void run();
+
+    /**
+     * @brief close all connections
+     */
+    void stop();
+
+    /**
+     * @brief send an event to all the clients connected to the binary link
+     * Clients which only use the text protocol don't get it: the event is
+     * to be sent thru the text protocol when this returns false only.
+     * @return false if no binary client received it (no client or no binary encoding)
+     */
+    bool sendEventMulticast( const mvpplayer::IEvent & event );
+
+public:
+    boost::signals2::signal<void( mvpplayer::IEvent & event )> signalEvent;    ///< Signalize that an event has been received
+
+private:
+    /**
+     * @brief accept clients
+     */
+    void acceptWork();
+
+    /**
+     * @brief negotiate the protocol with a client and read its packets (client's thread)
+     */
+    void serveWork( const std::shared_ptr<FastLinkConnection> & connection );
+
+    /**
+     * @brief forget the closed connections, _mutexConnections must be locked
+     */
+    void pruneConnections();
+
+private:
+    boost::asio::io_service _ioService;
+    boost::asio::ip::tcp::acceptor _acceptor;
+    std::atomic<bool> _stopped;
+    std::mutex _mutexConnections;                                       ///< Mutex thread
+    std::vector<std::shared_ptr<FastLinkConnection>> _connections;     ///< Connected clients
+    std::vector<std::unique_ptr<std::thread>> _readThreads;            ///< Clients' threads, same order as _connections
+    std::unique_ptr<std::thread> _acceptThread;                         ///< Accepting thread
+};
+
+/**
+ * @brief binary event link client (kaliscope side)
+ */
+class FastLinkClient
+{
+public:
+    FastLinkClient();
+    ~FastLinkClient();
+
+    /**
+     * @brief connect to a server and negotiate the binary protocol
+     * @return false if unavailable, the text protocol has to be used
+     */
+    bool connect( const std::string & host, const unsigned short port = kDefaultFastLinkPort );
+
+    void disconnect();
+
+    inline bool isConnected() const
+    { return _connection && _connection->isOpen(); }
+
+    /**
+     * @brief send an event
+     * @return false if not sent (not connected or no binary encoding)
+     */
+    bool sendEvent( const mvpplayer::IEvent & event );
+
+public:
+    boost::signals2::signal<void( mvpplayer::IEvent & event )> signalEvent;    ///< Signalize that an event has been received
+
+private:
+    boost::asio::io_service _ioService;
+    std::shared_ptr<FastLinkConnection> _connection;    ///< Connection to the server
+    std::unique_ptr<std::thread> _readThread;           ///< Reading thread
+};
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "FlowControl.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace kaliscope
+{
+
+FlowCreditWindow::FlowCreditWindow()
+{
+}
+
+/**
+ * @brief a trigger has been sent
+ * @param id correlation id of the trigger
+ */
+void FlowCreditWindow::triggered( const boost::uint64_t id )
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    _lastSentId = std::max( _lastSentId, id );
+}
+
+/**
+ * @brief kaliscope reported its state
+ */
+void FlowCreditWindow::update( const FlowState & state )
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    _active = state.window > 0;
+    _window = state.window;
+    _lastDoneId = std::max( _lastDoneId, state.lastDoneId );
+}
+
+/**
+ * @brief forget the state (capture stopped)
+ */
+void FlowCreditWindow::reset()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    _active = false;
+    _window = 0;
+    _lastDoneId = _lastSentId;
+}
+
+/**
+ * @brief has kaliscope reported its state
+ */
+bool FlowCreditWindow::isActive()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    return _active;
+}
+
+/**
+ * @brief number of triggers that can be sent without overflowing kaliscope
+ */
+int FlowCreditWindow::credits()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    return _active ? creditsNoLock() : std::numeric_limits<int>::max();
+}
+
+/**
+ * @brief how full kaliscope's queue is
+ * @return 0 (empty) to 1 (full), 0 until kaliscope reports its state
+ */
+double FlowCreditWindow::fill()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    if ( !_active )
+    {
+        return 0.0;
+    }
+    return std::min( std::max( 1.0 - double( creditsNoLock() ) / _window, 0.0 ), 1.0 );
+}
+
+}
@@ -0,0 +1,103 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_CORE_FLOWCONTROL_HPP_
+#define	_KALI_CORE_FLOWCONTROL_HPP_
+
+#include <boost/serialization/serialization.hpp>
+#include <boost/cstdint.hpp>
+
+#include <mutex>
+
+namespace kaliscope
+{
+
+static const boost::uint16_t kDefaultFlowWindow = 4;
+
+/**
+ * @brief flow control state of kaliscope
+ * Sent each time a triggered frame is done. Triggers are identified by
+ * their capture trace correlation id, so kalisync knows how many of its
+ * triggers are still in kaliscope's queue.
+ */
+struct FlowState
+{
+    FlowState( const boost::uint16_t depth = 0, const boost::uint16_t creditWindow = kDefaultFlowWindow, const boost::uint64_t doneId = 0 )
+    : queueDepth( depth )
+    , window( creditWindow )
+    , lastDoneId( doneId )
+    {}
+
+    friend class boost::serialization::access;
+    template<class Archive>
+    void serialize( Archive & ar, const unsigned int version )
+    {
+        ar & queueDepth;
+        ar & window;
+        ar & lastDoneId;
+    }
+
+    boost::uint16_t queueDepth;     ///< Triggered frames waiting or being processed
+    boost::uint16_t window;         ///< Maximum number of triggered frames kaliscope can hold
+    boost::uint64_t lastDoneId;     ///< Correlation id of the last frame done
+};
+
+/**
+ * @brief credit window of the triggers sent to kaliscope (kalisync side)
+ * Each trigger consumes a credit, frames done by kaliscope give them back.
+ * Until kaliscope reports its state, credits are unlimited.
+ */
+class FlowCreditWindow
+{
+public:
+    FlowCreditWindow();
+
+    /**
+     * @brief a trigger has been sent
+     * @param id correlation id of the trigger
+     */
+    void triggered( const boost::uint64_t id );
+
+    /**
+     * @brief kaliscope reported its state
+     */
+    void update( const FlowState & state );
+
+    /**
+     * @brief forget the state (capture stopped)
+     */
+    void reset();
+
+    /**
+     * @brief has kaliscope reported its state
+     */
+    bool isActive();
+
+    /**
+     * @brief number of triggers that can be sent without overflowing kaliscope
+     */
+    int credits();
+
+    /**
+     * @brief how full kaliscope's queue is
+     * @return 0 (empty) to 1 (full), 0 until kaliscope reports its state
+     */
+    double fill();
+
+private:
+    inline int creditsNoLock() const
+    { return int( _window ) - int( _lastSentId > _lastDoneId ? _lastSentId - _lastDoneId : 0 ); }
+
+private:
+    std::mutex _mutex;                  ///< Mutex thread
+    bool _active = false;               ///< Has kaliscope reported its state
+    boost::uint16_t _window = 0;        ///< Credit window
+    boost::uint64_t _lastSentId = 0;    ///< Last trigger sent
+    boost::uint64_t _lastDoneId = 0;    ///< Last trigger done
+};
+
+}
+
+#endif
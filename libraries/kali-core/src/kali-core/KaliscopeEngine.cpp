@@ -39,6 +39,8 @@ std::shared_ptr<tuttle::host::Graph> KaliscopeEngine::setProcessingGraph( const
  */
 void KaliscopeEngine::playWork()
 {
+    // Normal scheduling: the processing graph's threads are created from
+    // this one and would inherit a realtime policy on all the cores
     _stopped = false;
     try
     {
@@ -80,7 +82,18 @@ void KaliscopeEngine::playWork()
                     {
                         _videoPlayer->setOutputFilename( nFrame, std::ceil( timeDomain.max ), _outputFilePathPrefix, _outputFileExtension );
                     }
+                    signalFrameComputeStarted( nFrame );
+                    // Let the transport go as soon as the reader is done, processing and writing overlap with it
+                    const bool acquired = _videoPlayer->acquireFrame();
+                    if ( acquired )
+                    {
+                        signalExposureComplete( nFrame );
+                    }
                     image = _videoPlayer->getFrame();
+                    if ( !acquired && image )
+                    {
+                        signalExposureComplete( nFrame );
+                    }
                 }
                 else
                 {
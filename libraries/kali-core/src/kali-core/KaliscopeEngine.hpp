@@ -120,6 +120,8 @@ private:
 
 // Signals
 public:
+    boost::signals2::signal<void( const std::size_t nFrame )> signalFrameComputeStarted;                      ///< Signals that a frame is about to be computed
+    boost::signals2::signal<void( const std::size_t nFrame )> signalExposureComplete;                         ///< Signals that the input of a frame has been acquired (the film can move)
     boost::signals2::signal<void( const std::size_t nFrame, const DefaultImageT image )> signalFrameReady;   ///< Signals that a new frame is ready
 
 // Various
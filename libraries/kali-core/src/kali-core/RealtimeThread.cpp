@@ -0,0 +1,210 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "RealtimeThread.hpp"
+
+#include <mvp-player-core/Settings.hpp>
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+namespace kaliscope
+{
+
+/**
+ * @brief get the settings name of a thread role
+ */
+const char * threadRoleName( const EThreadRole role )
+{
+    switch( role )
+    {
+        case eThreadRoleSensor: return "sensor";
+        case eThreadRoleMotor: return "motor";
+        case eThreadRoleNetwork: return "network";
+        case eThreadRoleCount: break;
+    }
+    return "unknown";
+}
+
+/**
+ * @brief apply the settings of a role to the calling thread
+ * @return false if the settings could not be applied (missing privileges)
+ */
+bool setupThreadRole( const EThreadRole role )
+{
+    mvpplayer::Settings & settings = mvpplayer::Settings::getInstance();
+    const std::string name = threadRoleName( role );
+    const int priority = settings.get<int>( "realtime", name + "Priority", 0 );
+    const std::string cpus = settings.get<std::string>( "realtime", name + "Cpus", "" );
+#ifdef __linux__
+    bool success = true;
+
+    if ( priority > 0 )
+    {
+        sched_param param;
+        memset( &param, 0, sizeof( sched_param ) );
+        param.sched_priority = std::min( std::max( priority, sched_get_priority_min( SCHED_FIFO ) ), sched_get_priority_max( SCHED_FIFO ) );
+        const int err = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param );
+        if ( err )
+        {
+            std::cerr << "[Realtime] Unable to set SCHED_FIFO priority " << param.sched_priority << " on the " << name << " thread: " << strerror( err ) << std::endl;
+            success = false;
+        }
+    }
+
+    if ( !cpus.empty() )
+    {
+        std::vector<std::string> cpuList;
+        boost::algorithm::split( cpuList, cpus, boost::algorithm::is_any_of( ", " ), boost::algorithm::token_compress_on );
+        cpu_set_t cpuSet;
+        CPU_ZERO( &cpuSet );
+        try
+        {
+            for( const std::string & cpu: cpuList )
+            {
+                if ( !cpu.empty() )
+                {
+                    CPU_SET( boost::lexical_cast<int>( cpu ), &cpuSet );
+                }
+            }
+            const int err = pthread_setaffinity_np( pthread_self(), sizeof( cpu_set_t ), &cpuSet );
+            if ( err )
+            {
+                std::cerr << "[Realtime] Unable to pin the " << name << " thread on CPUs " << cpus << ": " << strerror( err ) << std::endl;
+                success = false;
+            }
+        }
+        catch( const boost::bad_lexical_cast & )
+        {
+            std::cerr << "[Realtime] Invalid CPU list for the " << name << " thread: " << cpus << std::endl;
+            success = false;
+        }
+    }
+    return success;
+#else
+    if ( priority > 0 || !cpus.empty() )
+    {
+        std::cerr << "[Realtime] Realtime priority and CPU pinning are only supported on Linux, the " << name << " thread keeps the normal scheduling." << std::endl;
+        return false;
+    }
+    return true;
+#endif
+}
+
+/**
+ * @brief lock the process memory if the settings ask for it
+ * @return false if the memory could not be locked
+ */
+bool setupMemoryLock()
+{
+    if ( !mvpplayer::Settings::getInstance().get<bool>( "realtime", "lockMemory", false ) )
+    {
+        return true;
+    }
+#ifdef __linux__
+    if ( mlockall( MCL_CURRENT | MCL_FUTURE ) )
+    {
+        std::cerr << "[Realtime] Unable to lock the process memory: " << strerror( errno ) << std::endl;
+        return false;
+    }
+    return true;
+#else
+    std::cerr << "[Realtime] Memory locking is only supported on Linux." << std::endl;
+    return false;
+#endif
+}
+
+ThreadJitterMonitor::ThreadJitterMonitor()
+{
+    for( Accumulator & accumulator: _lateness )
+    {
+        accumulator.count = 0;
+        accumulator.sum = 0;
+        accumulator.max = 0;
+        for( std::atomic<boost::uint32_t> & bin: accumulator.bins )
+        {
+            bin = 0;
+        }
+    }
+}
+
+/**
+ * @brief add a wake up lateness
+ * @param role thread role
+ * @param lateness microseconds
+ */
+void ThreadJitterMonitor::add( const EThreadRole role, const boost::int64_t lateness )
+{
+    Accumulator & accumulator = _lateness[role];
+    const boost::int64_t value = std::max<boost::int64_t>( lateness, 0 );
+    accumulator.bins[ std::min<boost::int64_t>( value, kNbBins - 1 ) ].fetch_add( 1, std::memory_order_relaxed );
+    accumulator.sum.fetch_add( value, std::memory_order_relaxed );
+    boost::int64_t max = accumulator.max.load( std::memory_order_relaxed );
+    while( value > max && !accumulator.max.compare_exchange_weak( max, value, std::memory_order_relaxed ) )
+    {}
+    accumulator.count.fetch_add( 1, std::memory_order_relaxed );
+}
+
+/**
+ * @brief get the jitter report and reset the monitor
+ * Wake ups added while reporting may be counted in the next report.
+ * @return the printable report, empty if nothing was measured
+ */
+std::string ThreadJitterMonitor::report()
+{
+    std::ostringstream os;
+    for( std::size_t r = 0; r < eThreadRoleCount; ++r )
+    {
+        Accumulator & accumulator = _lateness[r];
+        const boost::uint64_t count = accumulator.count.exchange( 0 );
+        if ( count == 0 )
+        {
+            continue;
+        }
+        const double mean = double( accumulator.sum.exchange( 0 ) ) / count;
+        const boost::int64_t max = accumulator.max.exchange( 0 );
+
+        // p99 is the bin holding the 99th percentile wake up
+        std::vector<boost::uint32_t> bins( kNbBins );
+        boost::uint64_t binned = 0;
+        for( std::size_t b = 0; b < kNbBins; ++b )
+        {
+            bins[b] = accumulator.bins[b].exchange( 0 );
+            binned += bins[b];
+        }
+        const boost::uint64_t rank = binned - binned / 100;
+        boost::uint64_t seen = 0;
+        std::size_t p99 = 0;
+        while( p99 < kNbBins - 1 && ( seen += bins[p99] ) < rank )
+        {
+            ++p99;
+        }
+
+        if ( os.tellp() == 0 )
+        {
+            os << "Wake up jitter (us):" << std::endl;
+        }
+        os << boost::format( "  %-8s %8d wake ups, mean %7.1f, p99 %s%5d, max %6d" )
+              % threadRoleName( EThreadRole( r ) ) % count % mean % ( p99 == kNbBins - 1 ? ">" : " " ) % p99 % max << std::endl;
+    }
+    return os.str();
+}
+
+}
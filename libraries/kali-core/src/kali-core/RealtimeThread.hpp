@@ -0,0 +1,94 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _KALI_CORE_REALTIMETHREAD_HPP_
+#define	_KALI_CORE_REALTIMETHREAD_HPP_
+
+#include <mvp-player-core/Singleton.hpp>
+
+#include <boost/cstdint.hpp>
+
+#include <atomic>
+#include <string>
+
+namespace kaliscope
+{
+
+/**
+ * @brief capture critical threads (Linux only, other platforms keep the normal scheduling)
+ * Threads inherit the scheduling of the thread that creates them: compute
+ * threads (the kaliscope engine and its processing graph) have no role.
+ * Each role is configured in the "realtime" settings section:
+ * - <role>Priority: SCHED_FIFO priority (1..99), 0 keeps the normal scheduling
+ * - <role>Cpus: comma separated list of the CPUs the thread runs on, empty for all
+ * - lockMemory: lock the process memory (no page fault on the capture path)
+ */
+enum EThreadRole
+{
+    eThreadRoleSensor = 0,      ///< (kalisync) gpio sensor watcher
+    eThreadRoleMotor,           ///< (kalisync) motor PWM
+    eThreadRoleNetwork,         ///< (both) binary event link
+    eThreadRoleCount
+};
+
+/**
+ * @brief get the settings name of a thread role
+ */
+const char * threadRoleName( const EThreadRole role );
+
+/**
+ * @brief apply the settings of a role to the calling thread
+ * @return false if the settings could not be applied (missing privileges)
+ */
+bool setupThreadRole( const EThreadRole role );
+
+/**
+ * @brief lock the process memory if the settings ask for it
+ * @return false if the memory could not be locked
+ */
+bool setupMemoryLock();
+
+/**
+ * @brief wake up lateness of the capture critical threads
+ * Threads that sleep for a known time report how late they woke up,
+ * which is the scheduling jitter seen by the capture chain.
+ * Adding is lock free and doesn't allocate (realtime threads, locked memory):
+ * latenesses are accumulated in a fixed histogram of 1us bins.
+ */
+class ThreadJitterMonitor : public mvpplayer::Singleton<ThreadJitterMonitor>
+{
+public:
+    ThreadJitterMonitor();
+
+    /**
+     * @brief add a wake up lateness
+     * @param role thread role
+     * @param lateness microseconds
+     */
+    void add( const EThreadRole role, const boost::int64_t lateness );
+
+    /**
+     * @brief get the jitter report and reset the monitor
+     * @return the printable report, empty if nothing was measured
+     */
+    std::string report();
+
+private:
+    static const std::size_t kNbBins = 1024;                        ///< Histogram bins (1us each, last one is overflow)
+
+    struct Accumulator
+    {
+        std::atomic<boost::uint64_t> count;                         ///< Number of wake ups
+        std::atomic<boost::uint64_t> sum;                           ///< Sum of lateness (microseconds)
+        std::atomic<boost::int64_t> max;                            ///< Max lateness (microseconds)
+        std::atomic<boost::uint32_t> bins[kNbBins];                 ///< Lateness histogram
+    };
+
+    Accumulator _lateness[eThreadRoleCount];                        ///< Wake up lateness per role
+};
+
+}
+
+#endif
@@ -236,6 +236,33 @@ DefaultImageT VideoPlayer::getFrame( const double nFrame )
     }
 }
 
+/**
+ * @brief compute the reader node only, so that the input is acquired
+ *        before the rest of the graph is processed
+ * @return true if the reader has been computed separately
+ */
+bool VideoPlayer::acquireFrame( const double nFrame )
+{
+    try
+    {
+        std::unique_lock<std::mutex> lock( _mutexPlayer );
+        if ( !_nodeRead || _nodeRead == _nodeFinal )
+        {
+            return false;
+        }
+        _currentPosition = nFrame;
+        // The reader output is kept in the output cache until the final node has been computed
+        // (a reader computed again by getFrame reads the frame twice, see acquireFrame's note)
+        _graph->compute( _outputCache, *_nodeRead, tuttle::host::ComputeOptions( nFrame ) );
+        return true;
+    }
+    catch( ... )
+    {
+        TUTTLE_LOG_CURRENT_EXCEPTION;
+        return false;
+    }
+}
+
 /**
  * @brief set output filename
  * @param filePath[in] input file path
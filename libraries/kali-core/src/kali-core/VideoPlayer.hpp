@@ -128,6 +128,25 @@ public:
     DefaultImageT getFrame()
     { return getFrame( _currentPosition ); }
 
+    /**
+     * @brief compute the reader node only, so that the input is acquired
+     *        before the rest of the graph is processed
+     * @param nFrame frame number in time domain
+     * @return true if the reader has been computed separately, false if the
+     *         reader is the final node (getFrame does the whole work) or on error
+     * @note the reader output stays in the output cache until getFrame( nFrame ) has been called.
+     *       getFrame only saves the reader's work if tuttle takes that output from the cache
+     *       instead of computing the reader again: the dcraw reader warns when it decodes
+     *       the same frame twice in a row.
+     */
+    bool acquireFrame( const double nFrame );
+
+    /**
+     * @brief acquire current frame
+     */
+    bool acquireFrame()
+    { return acquireFrame( _currentPosition ); }
+
     /**
      * @brief set current track position
      * @param[in] position position in percent (0-100), ms or frames
@@ -8,3 +8,7 @@
 #include <boost/archive/text_oarchive.hpp>
 
 #include "stateMachineEvents.hpp"
+
+BOOST_CLASS_EXPORT_IMPLEMENT( kaliscope::logic::EvCaptureTrace );
+BOOST_CLASS_EXPORT_IMPLEMENT( kaliscope::logic::EvCaptureProgress );
+BOOST_CLASS_EXPORT_IMPLEMENT( kaliscope::logic::EvFlowControl );
@@ -6,10 +6,14 @@
 #ifndef _KALISCOPE_STATEMACHINEEVENTS_HPP_
 #define	_KALISCOPE_STATEMACHINEEVENTS_HPP_
 
+#include "CaptureTracer.hpp"
+#include "FlowControl.hpp"
+
 #include <mvp-player-core/IEvent.hpp>
 
 #include <boost/statechart/event.hpp>
 #include <boost/statechart/transition.hpp>
+#include <boost/statechart/fifo_scheduler.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/serialization/export.hpp>
 #include <boost/serialization/serialization.hpp>
@@ -24,8 +28,187 @@ namespace kaliscope
 {
     
 static const std::string kFrameCapturedCustomStateAction( "kFrameCapturedCustomStateAction" );
+static const std::string kExposureCompleteCustomStateAction( "kExposureCompleteCustomStateAction" );
 static const std::string kCaptureStopCustomStateAction( "kCaptureStopCustomStateAction" );
 
+namespace logic
+{
+
+namespace sc = boost::statechart;
+
+/**
+ * @brief capture trace event
+ * Carries the timestamps and the correlation id of a frame capture
+ * between kalisync and kaliscope.
+ */
+struct EvCaptureTrace : mvpplayer::IEvent, sc::event< EvCaptureTrace >
+{
+private:
+    typedef EvCaptureTrace This;
+public:
+
+    EvCaptureTrace()
+    {}
+
+    EvCaptureTrace( const CaptureTrace & trace )
+    : _trace( trace )
+    {}
+
+    // This is needed to avoid a strange error on BOOST_CLASS_EXPORT_KEY
+    static void operator delete( void *p, const std::size_t n )
+    { ::operator delete(p); }
+
+    friend class boost::serialization::access;
+    template<class Archive>
+    void serialize(Archive & ar, const unsigned int version)
+    {
+        ar & boost::serialization::base_object<IEvent>( *this );
+        ar & _trace;
+    }
+
+    /**
+     * @brief not dispatched by the presenter, this event is sent explicitly to the other side
+     */
+    bool shallDispatch() const
+    { return false; }
+
+    /**
+     * @brief process this event (needed to avoid dynamic_casts)
+     * @param scheduler event scheduler
+     * @param processor event processor
+     */
+    void processSelf( boost::statechart::fifo_scheduler<> & scheduler, boost::statechart::fifo_scheduler<>::processor_handle & processor )
+    {
+        scheduler.queue_event( processor, boost::intrusive_ptr< This >( this ) );
+    }
+
+    const CaptureTrace & trace() const
+    { return _trace; }
+
+private:
+    CaptureTrace _trace;
+};
+
+/**
+ * @brief capture progress event
+ * Sent by kaliscope when the frame of a capture is exposed or computed
+ * (action is kExposureCompleteCustomStateAction or kFrameCapturedCustomStateAction),
+ * with the correlation id of the capture so that kalisync only releases
+ * the frame it holds.
+ */
+struct EvCaptureProgress : mvpplayer::IEvent, sc::event< EvCaptureProgress >
+{
+private:
+    typedef EvCaptureProgress This;
+public:
+
+    EvCaptureProgress()
+    : _correlationId( 0 )
+    {}
+
+    EvCaptureProgress( const std::string & action, const boost::uint64_t correlationId )
+    : _action( action )
+    , _correlationId( correlationId )
+    {}
+
+    // This is needed to avoid a strange error on BOOST_CLASS_EXPORT_KEY
+    static void operator delete( void *p, const std::size_t n )
+    { ::operator delete(p); }
+
+    friend class boost::serialization::access;
+    template<class Archive>
+    void serialize(Archive & ar, const unsigned int version)
+    {
+        ar & boost::serialization::base_object<IEvent>( *this );
+        ar & _action;
+        ar & _correlationId;
+    }
+
+    /**
+     * @brief not dispatched by the presenter, this event is sent explicitly to the other side
+     */
+    bool shallDispatch() const
+    { return false; }
+
+    /**
+     * @brief process this event (needed to avoid dynamic_casts)
+     * @param scheduler event scheduler
+     * @param processor event processor
+     */
+    void processSelf( boost::statechart::fifo_scheduler<> & scheduler, boost::statechart::fifo_scheduler<>::processor_handle & processor )
+    {
+        scheduler.queue_event( processor, boost::intrusive_ptr< This >( this ) );
+    }
+
+    const std::string & action() const
+    { return _action; }
+
+    boost::uint64_t correlationId() const
+    { return _correlationId; }
+
+private:
+    std::string _action;                ///< Custom state action of the progress
+    boost::uint64_t _correlationId;     ///< Capture the frame belongs to
+};
+
+/**
+ * @brief flow control event
+ * Sent by kaliscope to tell kalisync how full its queue is.
+ */
+struct EvFlowControl : mvpplayer::IEvent, sc::event< EvFlowControl >
+{
+private:
+    typedef EvFlowControl This;
+public:
+
+    EvFlowControl()
+    {}
+
+    EvFlowControl( const FlowState & state )
+    : _state( state )
+    {}
+
+    // This is needed to avoid a strange error on BOOST_CLASS_EXPORT_KEY
+    static void operator delete( void *p, const std::size_t n )
+    { ::operator delete(p); }
+
+    friend class boost::serialization::access;
+    template<class Archive>
+    void serialize(Archive & ar, const unsigned int version)
+    {
+        ar & boost::serialization::base_object<IEvent>( *this );
+        ar & _state;
+    }
+
+    /**
+     * @brief not dispatched by the presenter, this event is sent explicitly to the other side
+     */
+    bool shallDispatch() const
+    { return false; }
+
+    /**
+     * @brief process this event (needed to avoid dynamic_casts)
+     * @param scheduler event scheduler
+     * @param processor event processor
+     */
+    void processSelf( boost::statechart::fifo_scheduler<> & scheduler, boost::statechart::fifo_scheduler<>::processor_handle & processor )
+    {
+        scheduler.queue_event( processor, boost::intrusive_ptr< This >( this ) );
+    }
+
+    const FlowState & state() const
+    { return _state; }
+
+private:
+    FlowState _state;
+};
+
 }
 
+}
+
+BOOST_CLASS_EXPORT_KEY( kaliscope::logic::EvCaptureTrace );
+BOOST_CLASS_EXPORT_KEY( kaliscope::logic::EvCaptureProgress );
+BOOST_CLASS_EXPORT_KEY( kaliscope::logic::EvFlowControl );
+
 #endif
@@ -0,0 +1,311 @@
+/**
+ * Interleaved versus planar float processing of 4K frames.
+ *
+ * Each operation is run on interleaved RGBA images of each bit depth,
+ * once per pixel thru gil iterators (the conversions to and from float
+ * done by gil on each pixel, as the filters of the tree do), and once by
+ * the planarFloat row kernels used by ImagePlanarFloatFilterProcessor.
+ * The operations are a per channel gain and offset (light math) and a
+ * 3x3 color matrix (heavier math), both clamped to 0..1, alpha is kept.
+ * The best time of the repeats is reported for each path, as well as the
+ * largest difference between the two outputs (in channel units).
+ */
+
+#include <tuttle/plugin/planarFloat.hpp>
+
+#include <boost/gil.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace bpo = boost::program_options;
+namespace gil = boost::gil;
+
+namespace
+{
+
+using namespace tuttle::plugin;
+
+typedef std::chrono::steady_clock Clock;
+
+static const std::size_t kNbChannels = 4;
+static const std::size_t kChunkSize = 1024;    ///< Same as ImagePlanarFloatFilterProcessor
+
+inline float clamp01( float v )
+{
+	return planarFloat::saturate( v, 1.0f );
+}
+
+/**
+ * @brief per channel gain and offset
+ */
+struct GainOffset
+{
+	static const char* name() { return "gain"; }
+
+	template<class Pixel>
+	void operator()( const Pixel& src, Pixel& dst ) const
+	{
+		gil::rgba32f_pixel_t p;
+		gil::color_convert( src, p );
+		for( int c = 0; c < 3; ++c )
+		{
+			p[c] = clamp01( p[c] * 1.25f - 0.05f );
+		}
+		gil::color_convert( p, dst );
+	}
+
+	void operator()( float* const* planes, const std::size_t width, const std::size_t ) const
+	{
+		for( int c = 0; c < 3; ++c )
+		{
+			float* plane = planes[c];
+			for( std::size_t x = 0; x < width; ++x )
+			{
+				plane[x] = clamp01( plane[x] * 1.25f - 0.05f );
+			}
+		}
+	}
+};
+
+/**
+ * @brief 3x3 color matrix
+ */
+struct ColorMatrix
+{
+	static const char* name() { return "matrix"; }
+
+	float m[9] = { 1.20f, -0.15f, -0.05f,
+	               -0.10f, 1.15f, -0.05f,
+	               0.02f, -0.22f, 1.20f };
+
+	template<class Pixel>
+	void operator()( const Pixel& src, Pixel& dst ) const
+	{
+		gil::rgba32f_pixel_t p;
+		gil::color_convert( src, p );
+		const float r = p[0];
+		const float g = p[1];
+		const float b = p[2];
+		p[0] = clamp01( m[0] * r + m[1] * g + m[2] * b );
+		p[1] = clamp01( m[3] * r + m[4] * g + m[5] * b );
+		p[2] = clamp01( m[6] * r + m[7] * g + m[8] * b );
+		gil::color_convert( p, dst );
+	}
+
+	void operator()( float* const* planes, const std::size_t width, const std::size_t ) const
+	{
+		float* red = planes[0];
+		float* green = planes[1];
+		float* blue = planes[2];
+		for( std::size_t x = 0; x < width; ++x )
+		{
+			const float r = red[x];
+			const float g = green[x];
+			const float b = blue[x];
+			red[x] = clamp01( m[0] * r + m[1] * g + m[2] * b );
+			green[x] = clamp01( m[3] * r + m[4] * g + m[5] * b );
+			blue[x] = clamp01( m[6] * r + m[7] * g + m[8] * b );
+		}
+	}
+};
+
+/**
+ * @brief interleaved RGBA image
+ */
+template<class Pixel>
+struct Image
+{
+	typedef typename gil::channel_type<Pixel>::type Channel;
+	typedef typename gil::base_channel_type<Channel>::type RawChannel;
+	typedef typename gil::type_from_x_iterator<Pixel*>::view_t View;
+
+	Image( const std::size_t w, const std::size_t h )
+	: width( w )
+	, height( h )
+	, data( w * h * kNbChannels )
+	{}
+
+	View view()
+	{
+		return gil::interleaved_view( width, height, reinterpret_cast<Pixel*>( data.data() ), width * sizeof( Pixel ) );
+	}
+
+	RawChannel* row( const std::size_t y )
+	{
+		return data.data() + y * width * kNbChannels;
+	}
+
+	std::size_t width;
+	std::size_t height;
+	std::vector<RawChannel> data;
+};
+
+/// @brief source values, all the range of the channel
+/// @{
+inline void fill( boost::uint8_t& v, const boost::uint32_t r ) { v = boost::uint8_t( r >> 24 ); }
+inline void fill( boost::uint16_t& v, const boost::uint32_t r ) { v = boost::uint16_t( r >> 16 ); }
+inline void fill( float& v, const boost::uint32_t r ) { v = ( r >> 8 ) / float( 1 << 24 ); }
+/// @}
+
+inline double channelUnits( const boost::uint8_t* ) { return 1.0; }
+inline double channelUnits( const boost::uint16_t* ) { return 1.0; }
+inline double channelUnits( const float* ) { return 65535.0; }   ///< Float differences are given in 16 bits units
+
+/**
+ * @brief run a function on bands of rows, one band per thread
+ */
+template<class Function>
+void runBands( const std::size_t height, const std::size_t nbThreads, const Function& function )
+{
+	std::vector<std::thread> threads;
+	for( std::size_t i = 0; i < nbThreads; ++i )
+	{
+		threads.emplace_back( function, height * i / nbThreads, height * ( i + 1 ) / nbThreads );
+	}
+	for( std::thread& thread : threads )
+	{
+		thread.join();
+	}
+}
+
+template<class Pixel, class Op>
+void processInterleaved( Image<Pixel>& src, Image<Pixel>& dst, const Op& op, const std::size_t nbThreads )
+{
+	typedef typename Image<Pixel>::View View;
+	const View srcView = src.view();
+	const View dstView = dst.view();
+	runBands( src.height, nbThreads, [&]( const std::size_t y1, const std::size_t y2 )
+	{
+		for( std::size_t y = y1; y < y2; ++y )
+		{
+			typename View::x_iterator s = srcView.row_begin( y );
+			typename View::x_iterator d = dstView.row_begin( y );
+			for( std::size_t x = 0; x < src.width; ++x )
+			{
+				op( s[x], d[x] );
+			}
+		}
+	} );
+}
+
+template<class Pixel, class Op>
+void processPlanar( Image<Pixel>& src, Image<Pixel>& dst, const Op& op, const std::size_t nbThreads )
+{
+	runBands( src.height, nbThreads, [&]( const std::size_t y1, const std::size_t y2 )
+	{
+		std::vector<float> buffer( 2 * kNbChannels * kChunkSize );
+		void* work = &buffer[kNbChannels * kChunkSize];
+		float* planes[kNbChannels];
+		for( std::size_t c = 0; c < kNbChannels; ++c )
+		{
+			planes[c] = &buffer[c * kChunkSize];
+		}
+		for( std::size_t y = y1; y < y2; ++y )
+		{
+			planarFloat::processRow<kNbChannels, kChunkSize>( src.row( y ), dst.row( y ), src.width, planes, work, op );
+		}
+	} );
+}
+
+template<class Function>
+double bestTime( const std::size_t nbRepeats, const Function& function )
+{
+	double best = 0;
+	for( std::size_t i = 0; i < nbRepeats; ++i )
+	{
+		const Clock::time_point start = Clock::now();
+		function();
+		const double t = std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+		best = i == 0 ? t : std::min( best, t );
+	}
+	return best;
+}
+
+/**
+ * @brief benchmark an operation on a pixel type
+ * @return the largest difference between the two paths (channel units)
+ */
+template<class Pixel, class Op>
+double benchmark( const char* depthName, const std::size_t width, const std::size_t height, const std::size_t nbThreads, const std::size_t nbRepeats )
+{
+	typedef typename Image<Pixel>::RawChannel RawChannel;
+	const Op op = Op();
+	Image<Pixel> src( width, height );
+	Image<Pixel> interleaved( width, height );
+	Image<Pixel> planar( width, height );
+	boost::uint32_t random = 12345;
+	for( RawChannel& v : src.data )
+	{
+		random = random * 1664525u + 1013904223u;
+		fill( v, random );
+	}
+
+	const double interleavedTime = bestTime( nbRepeats, [&]() { processInterleaved( src, interleaved, op, nbThreads ); } );
+	const double planarTime = bestTime( nbRepeats, [&]() { processPlanar( src, planar, op, nbThreads ); } );
+
+	double maxDiff = 0;
+	for( std::size_t i = 0; i < src.data.size(); ++i )
+	{
+		maxDiff = std::max( maxDiff, std::abs( double( interleaved.data[i] ) - double( planar.data[i] ) ) );
+	}
+	maxDiff *= channelUnits( static_cast<const RawChannel*>( 0 ) );
+
+	std::printf( "%-8s %-7s interleaved %8.2f ms   planar %8.2f ms   planar speedup %5.2fx   max diff %g\n",
+	             depthName, Op::name(), interleavedTime, planarTime, interleavedTime / planarTime, maxDiff );
+	return maxDiff;
+}
+
+template<class Op>
+double benchmarkDepths( const std::size_t width, const std::size_t height, const std::size_t nbThreads, const std::size_t nbRepeats )
+{
+	double maxDiff = 0;
+	maxDiff = std::max( maxDiff, benchmark<gil::rgba8_pixel_t, Op>( "rgba8", width, height, nbThreads, nbRepeats ) );
+	maxDiff = std::max( maxDiff, benchmark<gil::rgba16_pixel_t, Op>( "rgba16", width, height, nbThreads, nbRepeats ) );
+	maxDiff = std::max( maxDiff, benchmark<gil::rgba32f_pixel_t, Op>( "rgba32f", width, height, nbThreads, nbRepeats ) );
+	return maxDiff;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+	bpo::options_description options( "Allowed options" );
+	options.add_options()
+		( "help", "Print this help" )
+		( "width", bpo::value<std::size_t>()->default_value( 4096 ), "Frame width" )
+		( "height", bpo::value<std::size_t>()->default_value( 2160 ), "Frame height" )
+		( "threads", bpo::value<std::size_t>()->default_value( 1 ), "Number of threads" )
+		( "repeat", bpo::value<std::size_t>()->default_value( 5 ), "Runs of each path, the best time is kept" );
+	bpo::variables_map vm;
+	bpo::store( bpo::parse_command_line( argc, argv, options ), vm );
+	bpo::notify( vm );
+	if( vm.count( "help" ) )
+	{
+		std::cout << options << std::endl;
+		return 0;
+	}
+	const std::size_t width = vm["width"].as<std::size_t>();
+	const std::size_t height = vm["height"].as<std::size_t>();
+	const std::size_t nbThreads = std::max<std::size_t>( 1, vm["threads"].as<std::size_t>() );
+	const std::size_t nbRepeats = std::max<std::size_t>( 1, vm["repeat"].as<std::size_t>() );
+
+	std::cout << width << "x" << height << " RGBA, " << nbThreads << " thread(s), best of " << nbRepeats << std::endl;
+	double maxDiff = 0;
+	maxDiff = std::max( maxDiff, benchmarkDepths<GainOffset>( width, height, nbThreads, nbRepeats ) );
+	maxDiff = std::max( maxDiff, benchmarkDepths<ColorMatrix>( width, height, nbThreads, nbRepeats ) );
+
+	// Both paths round the same float values, one unit is the most they may differ by
+	if( maxDiff > 1.0 )
+	{
+		std::cerr << "The interleaved and planar outputs differ by " << maxDiff << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,108 @@
+#ifndef _TUTTLE_PLUGIN_IMAGEPLANARFLOATFILTERPROCESSOR_HPP_
+#define _TUTTLE_PLUGIN_IMAGEPLANARFLOATFILTERPROCESSOR_HPP_
+
+#include "ImageGilFilterProcessor.hpp"
+#include "planarFloat.hpp"
+
+#include <boost/gil.hpp>
+#include <boost/static_assert.hpp>
+
+#include <vector>
+
+namespace tuttle {
+namespace plugin {
+
+/**
+ * @brief Filter processor working on planar float rows (structure of arrays).
+ *
+ * Opt-in alternative to per pixel processing thru gil iterators: each row of
+ * the processing window is converted once to one contiguous float array per
+ * channel (0..1 for integer images), processed in place by processPlanarRow,
+ * and converted back to the destination. Loops on the planes are plain float
+ * loops that compilers vectorize. Integer outputs are rounded and saturated,
+ * float outputs are stored as computed.
+ *
+ * It pays on 8 and 16 bits images, where gil converts each channel of each
+ * pixel to float and back. Float images have nothing to convert, splitting
+ * and interleaving the channels make them slower than gil iterators
+ * (benchmark/planarFloatBenchmark.cpp).
+ */
+template <class View>
+class ImagePlanarFloatFilterProcessor : public ImageGilFilterProcessor<View>
+{
+public:
+	typedef typename boost::gil::channel_type<View>::type Channel;
+	typedef typename boost::gil::base_channel_type<Channel>::type RawChannel;
+	static const std::size_t kNbChannels = boost::gil::num_channels<View>::value;
+	static const std::size_t kChunkSize = 1024; ///< Pixels converted at once
+
+	BOOST_STATIC_ASSERT_MSG( !boost::gil::is_planar<View>::value, "OFX images are interleaved" );
+
+public:
+	ImagePlanarFloatFilterProcessor( OFX::ImageEffect& effect, const EImageOrientation imageOrientation )
+		: ImageGilFilterProcessor<View>( effect, imageOrientation )
+	{}
+	virtual ~ImagePlanarFloatFilterProcessor() {}
+
+	void multiThreadProcessImages( const OfxRectI& procWindowRoW );
+
+protected:
+	/**
+	 * @brief process a part of a row, in place
+	 * @param[in, out] planes   one float array per channel (kNbChannels)
+	 * @param[in]      width    number of pixels
+	 * @param[in]      position first pixel (output clip coordinates)
+	 */
+	virtual void processPlanarRow( float* const* planes, const std::size_t width, const OfxPointI& position ) = 0;
+
+private:
+	/// @brief gives the chunks of a row to processPlanarRow
+	struct RowProcess
+	{
+		ImagePlanarFloatFilterProcessor* processor;
+		int x1;
+		int y;
+
+		void operator()( float* const* planes, const std::size_t width, const std::size_t offset )
+		{
+			const OfxPointI position = { x1 + int( offset ), y };
+			processor->processPlanarRow( planes, width, position );
+		}
+	};
+};
+
+template<class View>
+const std::size_t ImagePlanarFloatFilterProcessor<View>::kNbChannels;
+template<class View>
+const std::size_t ImagePlanarFloatFilterProcessor<View>::kChunkSize;
+
+template<class View>
+void ImagePlanarFloatFilterProcessor<View>::multiThreadProcessImages( const OfxRectI& procWindowRoW )
+{
+	const OfxRectI procWindowOutput = this->translateRoWToOutputClipCoordinates( procWindowRoW );
+	const std::size_t width = procWindowRoW.x2 - procWindowRoW.x1;
+
+	// Planes and conversion buffer of the thread
+	std::vector<float> buffer( 2 * kNbChannels * kChunkSize );
+	void* work = &buffer[kNbChannels * kChunkSize];
+	float* planes[kNbChannels];
+	for( std::size_t c = 0; c < kNbChannels; ++c )
+	{
+		planes[c] = &buffer[c * kChunkSize];
+	}
+
+	for( int y = procWindowOutput.y1; y < procWindowOutput.y2; ++y )
+	{
+		const RawChannel* src = reinterpret_cast<const RawChannel*>( &( *this->_srcView.x_at( procWindowOutput.x1, y ) )[0] );
+		RawChannel* dst = reinterpret_cast<RawChannel*>( &( *this->_dstView.x_at( procWindowOutput.x1, y ) )[0] );
+		RowProcess rowProcess = { this, procWindowOutput.x1, y };
+		planarFloat::processRow<kNbChannels, kChunkSize>( src, dst, width, planes, work, rowProcess );
+		if( this->progressForward( width ) )
+			return;
+	}
+}
+
+}
+}
+
+#endif
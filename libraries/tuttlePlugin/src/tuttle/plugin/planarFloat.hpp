@@ -0,0 +1,148 @@
+#ifndef _TUTTLE_PLUGIN_PLANARFLOAT_HPP_
+#define _TUTTLE_PLUGIN_PLANARFLOAT_HPP_
+
+#include <boost/cstdint.hpp>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace tuttle {
+namespace plugin {
+
+/**
+ * @brief row kernels of ImagePlanarFloatFilterProcessor, they don't depend on OFX
+ */
+namespace planarFloat {
+
+/// @brief channel to float (0..1 for integer channels), as boost::gil does it
+/// @{
+inline float toFloat( const boost::uint8_t v ) { return v / 255.0f; }
+inline float toFloat( const boost::uint16_t v ) { return v / 65535.0f; }
+inline float toFloat( const float v ) { return v; }
+/// @}
+
+/**
+ * @brief clamp to 0..upper, written so that the loops vectorize
+ */
+inline float saturate( float v, const float upper )
+{
+	v = v > 0.0f ? v : 0.0f;
+	return v < upper ? v : upper;
+}
+
+/// @brief float to integer channel range, rounded and saturated
+/// @{
+inline boost::int32_t quantize( const float v, const boost::uint8_t* ) { return static_cast<boost::int32_t>( saturate( v * 255.0f + 0.5f, 255.0f ) ); }
+inline boost::int32_t quantize( const float v, const boost::uint16_t* ) { return static_cast<boost::int32_t>( saturate( v * 65535.0f + 0.5f, 65535.0f ) ); }
+/// @}
+
+/**
+ * @brief convert an interleaved row to float planes
+ * The conversion runs on the interleaved data (contiguous, it vectorizes)
+ * before the channels are split.
+ */
+template<std::size_t nbChannels, typename Channel>
+void load( const Channel* src, void* work, float* const* planes, const std::size_t width )
+{
+	float* values = static_cast<float*>( work );
+	const std::size_t count = width * nbChannels;
+	for( std::size_t i = 0; i < count; ++i )
+	{
+		values[i] = toFloat( src[i] );
+	}
+	for( std::size_t c = 0; c < nbChannels; ++c )
+	{
+		float* plane = planes[c];
+		for( std::size_t x = 0; x < width; ++x )
+		{
+			plane[x] = values[x * nbChannels + c];
+		}
+	}
+}
+
+/**
+ * @brief float rows are split as they are
+ */
+template<std::size_t nbChannels>
+void load( const float* src, void*, float* const* planes, const std::size_t width )
+{
+	for( std::size_t c = 0; c < nbChannels; ++c )
+	{
+		float* plane = planes[c];
+		for( std::size_t x = 0; x < width; ++x )
+		{
+			plane[x] = src[x * nbChannels + c];
+		}
+	}
+}
+
+/**
+ * @brief convert float planes to an interleaved integer row
+ * The planes are quantized first (contiguous, it vectorizes) before the
+ * channels are interleaved.
+ */
+template<std::size_t nbChannels, typename Channel>
+void store( const float* const* planes, void* work, Channel* dst, const std::size_t width )
+{
+	boost::int32_t* values = static_cast<boost::int32_t*>( work );
+	for( std::size_t c = 0; c < nbChannels; ++c )
+	{
+		const float* plane = planes[c];
+		boost::int32_t* quantized = values + c * width;
+		for( std::size_t x = 0; x < width; ++x )
+		{
+			quantized[x] = quantize( plane[x], dst );
+		}
+	}
+	for( std::size_t c = 0; c < nbChannels; ++c )
+	{
+		const boost::int32_t* quantized = values + c * width;
+		for( std::size_t x = 0; x < width; ++x )
+		{
+			dst[x * nbChannels + c] = Channel( quantized[x] );
+		}
+	}
+}
+
+/**
+ * @brief float rows are stored as computed
+ */
+template<std::size_t nbChannels>
+void store( const float* const* planes, void*, float* dst, const std::size_t width )
+{
+	for( std::size_t c = 0; c < nbChannels; ++c )
+	{
+		const float* plane = planes[c];
+		for( std::size_t x = 0; x < width; ++x )
+		{
+			dst[x * nbChannels + c] = plane[x];
+		}
+	}
+}
+
+/**
+ * @brief convert an interleaved row to float planes by chunks, process them in place and store them back
+ * @param[in]     src    interleaved source row
+ * @param[out]    dst    interleaved destination row (may be src)
+ * @param[in]     width  number of pixels
+ * @param[in]     planes chunkSize floats per channel
+ * @param[in]     work   conversion buffer, nbChannels * chunkSize floats
+ * @param[in,out] op     called as op( planes, chunkWidth, offset ), offset being the first pixel of the chunk in the row
+ */
+template<std::size_t nbChannels, std::size_t chunkSize, typename Channel, class RowOp>
+void processRow( const Channel* src, Channel* dst, const std::size_t width, float* const* planes, void* work, RowOp& op )
+{
+	for( std::size_t x = 0; x < width; x += chunkSize )
+	{
+		const std::size_t chunkWidth = std::min( chunkSize, width - x );
+		load<nbChannels>( src + x * nbChannels, work, planes, chunkWidth );
+		op( planes, chunkWidth, x );
+		store<nbChannels>( planes, work, dst + x * nbChannels, chunkWidth );
+	}
+}
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,957 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "ColorNegInvertAlgorithm.hpp"
+
+#include <algorithm>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define COLORNEGINVERT_X86_KERNELS
+#include <immintrin.h>
+#elif defined( __ARM_NEON ) && defined( __aarch64__ )
+#define COLORNEGINVERT_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+namespace tuttle {
+namespace plugin {
+namespace colorNegInvert {
+
+namespace
+{
+
+// Pixels converted at once (work buffer on the stack)
+static const std::size_t kChunkSize = 512;
+// Channel pattern period of the vector kernels: lcm( 3 channels, 4 lanes )
+static const std::size_t kPatternSize = 12;
+
+/**
+ * @brief per channel constants repeated along an interleaved RGB row
+ */
+struct ReductionPattern
+{
+    alignas( 32 ) double filterColor[kPatternSize];
+    alignas( 32 ) double subFactor[kPatternSize];
+    alignas( 32 ) double factor[kPatternSize];
+};
+
+typedef void ( *ReduceFunction )( const float* in, float* out, const std::size_t count, const ReductionPattern& pattern, const bool invert );
+typedef void ( *YUVReduceFunction )( float* red, float* green, float* blue, const std::size_t count, const YUVReductionConstants& constants );
+
+/// @brief boost::gil channel conversions and multiplications
+/// @{
+inline float toFloat( const boost::uint8_t v ) { return v / 255.0f; }
+inline float toFloat( const boost::uint16_t v ) { return v / 65535.0f; }
+inline float toFloat( const float v ) { return v; }
+
+inline boost::uint8_t multiply( const boost::uint8_t a, const boost::uint8_t b )
+{
+    const boost::uint32_t tmp = boost::uint32_t( a ) * boost::uint32_t( b ) + 128;
+    return boost::uint8_t( ( tmp + ( tmp >> 8 ) ) >> 8 );
+}
+inline boost::uint16_t multiply( const boost::uint16_t a, const boost::uint16_t b ) { return boost::uint16_t( ( boost::uint32_t( a ) * boost::uint32_t( b ) ) / 65535 ); }
+inline float multiply( const float a, const float b ) { return a * b; }
+
+inline void fromFloat( const float v, boost::uint8_t & dst ) { dst = static_cast<boost::uint8_t>( v * 255.0f + 0.5f ); }
+inline void fromFloat( const float v, boost::uint16_t & dst ) { dst = static_cast<boost::uint16_t>( v * 65535.0f + 0.5f ); }
+inline void fromFloat( const float v, float & dst ) { dst = v; }
+
+inline boost::uint8_t maxValue( const boost::uint8_t* ) { return 255; }
+inline boost::uint16_t maxValue( const boost::uint16_t* ) { return 65535; }
+inline float maxValue( const float* ) { return 1.0f; }
+/// @}
+
+/**
+ * @brief reference computation of one channel
+ */
+template<bool invert>
+inline float reduceValue( const float x, const double filterColor, const double subFactor, const double factor )
+{
+    const double t = std::min( 1.0, std::max( 0.0, ( filterColor - x ) * subFactor ) * factor );
+    return float( invert ? 1.0 - t : t );
+}
+
+template<bool invert>
+void reduceScalarT( const float* in, float* out, const std::size_t count, const ReductionPattern& pattern, const std::size_t first = 0 )
+{
+    for( std::size_t i = first; i < count; ++i )
+    {
+        const std::size_t c = i % 3;
+        out[i] = reduceValue<invert>( in[i], pattern.filterColor[c], pattern.subFactor[c], pattern.factor[c] );
+    }
+}
+
+void reduceScalar( const float* in, float* out, const std::size_t count, const ReductionPattern& pattern, const bool invert )
+{
+    if ( invert )
+    { reduceScalarT<true>( in, out, count, pattern ); }
+    else
+    { reduceScalarT<false>( in, out, count, pattern ); }
+}
+
+inline float clampValue( const float x, const float lower, const float upper )
+{
+    return std::min( upper, std::max( lower, x ) );
+}
+
+/**
+ * @brief YUV reduction of planar RGB values, in place
+ */
+void yuvReduceScalar( float* red, float* green, float* blue, const std::size_t count, const YUVReductionConstants& c )
+{
+    for( std::size_t i = 0; i < count; ++i )
+    {
+        const float r = red[i], g = green[i], b = blue[i];
+        const float y = clampValue( c.forward[0][0] * r + c.forward[0][1] * g + c.forward[0][2] * b + c.offset[0], c.lower[0], c.upper[0] );
+        const float u = clampValue( c.forward[1][0] * r + c.forward[1][1] * g + c.forward[1][2] * b + c.offset[1], c.lower[1], c.upper[1] );
+        const float v = clampValue( c.forward[2][0] * r + c.forward[2][1] * g + c.forward[2][2] * b + c.offset[2], c.lower[2], c.upper[2] );
+        red[i] = c.backward[0][0] * y + c.backward[0][1] * u + c.backward[0][2] * v;
+        green[i] = c.backward[1][0] * y + c.backward[1][1] * u + c.backward[1][2] * v;
+        blue[i] = c.backward[2][0] * y + c.backward[2][1] * u + c.backward[2][2] * v;
+    }
+}
+
+#ifdef COLORNEGINVERT_X86_KERNELS
+
+// max/min operand order keeps the std::max( 0, t ) / std::min( 1, t ) results when t is NaN
+
+template<bool invert>
+__attribute__(( target( "sse2" ) ))
+inline __m128d reduceSSE2( const __m128d x, const double* filterColor, const double* subFactor, const double* factor )
+{
+    __m128d t = _mm_mul_pd( _mm_sub_pd( _mm_loadu_pd( filterColor ), x ), _mm_loadu_pd( subFactor ) );
+    t = _mm_mul_pd( _mm_max_pd( t, _mm_setzero_pd() ), _mm_loadu_pd( factor ) );
+    t = _mm_min_pd( t, _mm_set1_pd( 1.0 ) );
+    return invert ? _mm_sub_pd( _mm_set1_pd( 1.0 ), t ) : t;
+}
+
+template<bool invert>
+__attribute__(( target( "sse2" ) ))
+void reduceSSE2T( const float* in, float* out, const std::size_t count, const ReductionPattern& pattern )
+{
+    const std::size_t end = count - count % kPatternSize;
+    for( std::size_t i = 0; i < end; i += kPatternSize )
+    {
+        for( std::size_t k = 0; k < kPatternSize; k += 4 )
+        {
+            const __m128 x = _mm_loadu_ps( in + i + k );
+            const __m128d lo = reduceSSE2<invert>( _mm_cvtps_pd( x ), pattern.filterColor + k, pattern.subFactor + k, pattern.factor + k );
+            const __m128d hi = reduceSSE2<invert>( _mm_cvtps_pd( _mm_movehl_ps( x, x ) ), pattern.filterColor + k + 2, pattern.subFactor + k + 2, pattern.factor + k + 2 );
+            _mm_storeu_ps( out + i + k, _mm_movelh_ps( _mm_cvtpd_ps( lo ), _mm_cvtpd_ps( hi ) ) );
+        }
+    }
+    reduceScalarT<invert>( in, out, count, pattern, end );
+}
+
+__attribute__(( target( "sse2" ) ))
+void reduceSSE2( const float* in, float* out, const std::size_t count, const ReductionPattern& pattern, const bool invert )
+{
+    if ( invert )
+    { reduceSSE2T<true>( in, out, count, pattern ); }
+    else
+    { reduceSSE2T<false>( in, out, count, pattern ); }
+}
+
+__attribute__(( target( "sse2" ) ))
+inline __m128 dotSSE2( const float* m, const __m128 a, const __m128 b, const __m128 c )
+{
+    return _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( m[0] ), a ), _mm_mul_ps( _mm_set1_ps( m[1] ), b ) ), _mm_mul_ps( _mm_set1_ps( m[2] ), c ) );
+}
+
+__attribute__(( target( "sse2" ) ))
+void yuvReduceSSE2( float* red, float* green, float* blue, const std::size_t count, const YUVReductionConstants& c )
+{
+    const std::size_t end = count - count % 4;
+    for( std::size_t i = 0; i < end; i += 4 )
+    {
+        const __m128 r = _mm_loadu_ps( red + i ), g = _mm_loadu_ps( green + i ), b = _mm_loadu_ps( blue + i );
+        __m128 yuv[3];
+        for( std::size_t k = 0; k < 3; ++k )
+        {
+            const __m128 x = _mm_add_ps( dotSSE2( c.forward[k], r, g, b ), _mm_set1_ps( c.offset[k] ) );
+            yuv[k] = _mm_min_ps( _mm_set1_ps( c.upper[k] ), _mm_max_ps( _mm_set1_ps( c.lower[k] ), x ) );
+        }
+        _mm_storeu_ps( red + i, dotSSE2( c.backward[0], yuv[0], yuv[1], yuv[2] ) );
+        _mm_storeu_ps( green + i, dotSSE2( c.backward[1], yuv[0], yuv[1], yuv[2] ) );
+        _mm_storeu_ps( blue + i, dotSSE2( c.backward[2], yuv[0], yuv[1], yuv[2] ) );
+    }
+    yuvReduceScalar( red + end, green + end, blue + end, count - end, c );
+}
+
+template<bool invert>
+__attribute__(( target( "avx" ) ))
+inline __m256d reduceAVX( const __m256d x, const __m256d filterColor, const __m256d subFactor, const __m256d factor )
+{
+    __m256d t = _mm256_mul_pd( _mm256_sub_pd( filterColor, x ), subFactor );
+    t = _mm256_mul_pd( _mm256_max_pd( t, _mm256_setzero_pd() ), factor );
+    t = _mm256_min_pd( t, _mm256_set1_pd( 1.0 ) );
+    return invert ? _mm256_sub_pd( _mm256_set1_pd( 1.0 ), t ) : t;
+}
+
+template<bool invert>
+__attribute__(( target( "avx" ) ))
+void reduceAVXT( const float* in, float* out, const std::size_t count, const ReductionPattern& pattern )
+{
+    __m256d filterColor[3], subFactor[3], factor[3];
+    for( std::size_t k = 0; k < 3; ++k )
+    {
+        filterColor[k] = _mm256_load_pd( pattern.filterColor + 4 * k );
+        subFactor[k] = _mm256_load_pd( pattern.subFactor + 4 * k );
+        factor[k] = _mm256_load_pd( pattern.factor + 4 * k );
+    }
+    const std::size_t end = count - count % kPatternSize;
+    for( std::size_t i = 0; i < end; i += kPatternSize )
+    {
+        for( std::size_t k = 0; k < 3; ++k )
+        {
+            const __m256d x = _mm256_cvtps_pd( _mm_loadu_ps( in + i + 4 * k ) );
+            _mm_storeu_ps( out + i + 4 * k, _mm256_cvtpd_ps( reduceAVX<invert>( x, filterColor[k], subFactor[k], factor[k] ) ) );
+        }
+    }
+    reduceScalarT<invert>( in, out, count, pattern, end );
+}
+
+__attribute__(( target( "avx" ) ))
+void reduceAVX( const float* in, float* out, const std::size_t count, const ReductionPattern& pattern, const bool invert )
+{
+    if ( invert )
+    { reduceAVXT<true>( in, out, count, pattern ); }
+    else
+    { reduceAVXT<false>( in, out, count, pattern ); }
+}
+
+__attribute__(( target( "avx" ) ))
+inline __m256 dotAVX( const float* m, const __m256 a, const __m256 b, const __m256 c )
+{
+    return _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( m[0] ), a ), _mm256_mul_ps( _mm256_set1_ps( m[1] ), b ) ), _mm256_mul_ps( _mm256_set1_ps( m[2] ), c ) );
+}
+
+__attribute__(( target( "avx" ) ))
+void yuvReduceAVX( float* red, float* green, float* blue, const std::size_t count, const YUVReductionConstants& c )
+{
+    const std::size_t end = count - count % 8;
+    for( std::size_t i = 0; i < end; i += 8 )
+    {
+        const __m256 r = _mm256_loadu_ps( red + i ), g = _mm256_loadu_ps( green + i ), b = _mm256_loadu_ps( blue + i );
+        __m256 yuv[3];
+        for( std::size_t k = 0; k < 3; ++k )
+        {
+            const __m256 x = _mm256_add_ps( dotAVX( c.forward[k], r, g, b ), _mm256_set1_ps( c.offset[k] ) );
+            yuv[k] = _mm256_min_ps( _mm256_set1_ps( c.upper[k] ), _mm256_max_ps( _mm256_set1_ps( c.lower[k] ), x ) );
+        }
+        _mm256_storeu_ps( red + i, dotAVX( c.backward[0], yuv[0], yuv[1], yuv[2] ) );
+        _mm256_storeu_ps( green + i, dotAVX( c.backward[1], yuv[0], yuv[1], yuv[2] ) );
+        _mm256_storeu_ps( blue + i, dotAVX( c.backward[2], yuv[0], yuv[1], yuv[2] ) );
+    }
+    yuvReduceScalar( red + end, green + end, blue + end, count - end, c );
+}
+
+#endif
+
+#ifdef COLORNEGINVERT_NEON_KERNELS
+
+template<bool invert>
+inline float64x2_t reduceNEON( const float64x2_t x, const double* filterColor, const double* subFactor, const double* factor )
+{
+    const float64x2_t zero = vdupq_n_f64( 0.0 );
+    const float64x2_t one = vdupq_n_f64( 1.0 );
+    float64x2_t t = vmulq_f64( vsubq_f64( vld1q_f64( filterColor ), x ), vld1q_f64( subFactor ) );
+    // Compare and select, vmaxq/vminq would propagate NaN
+    t = vbslq_f64( vcgtq_f64( t, zero ), t, zero );
+    t = vmulq_f64( t, vld1q_f64( factor ) );
+    t = vbslq_f64( vcltq_f64( t, one ), t, one );
+    return invert ? vsubq_f64( one, t ) : t;
+}
+
+template<bool invert>
+void reduceNEONT( const float* in, float* out, const std::size_t count, const ReductionPattern& pattern )
+{
+    const std::size_t end = count - count % kPatternSize;
+    for( std::size_t i = 0; i < end; i += kPatternSize )
+    {
+        for( std::size_t k = 0; k < kPatternSize; k += 4 )
+        {
+            const float32x4_t x = vld1q_f32( in + i + k );
+            const float64x2_t lo = reduceNEON<invert>( vcvt_f64_f32( vget_low_f32( x ) ), pattern.filterColor + k, pattern.subFactor + k, pattern.factor + k );
+            const float64x2_t hi = reduceNEON<invert>( vcvt_high_f64_f32( x ), pattern.filterColor + k + 2, pattern.subFactor + k + 2, pattern.factor + k + 2 );
+            vst1q_f32( out + i + k, vcvt_high_f32_f64( vcvt_f32_f64( lo ), hi ) );
+        }
+    }
+    reduceScalarT<invert>( in, out, count, pattern, end );
+}
+
+void reduceNEON( const float* in, float* out, const std::size_t count, const ReductionPattern& pattern, const bool invert )
+{
+    if ( invert )
+    { reduceNEONT<true>( in, out, count, pattern ); }
+    else
+    { reduceNEONT<false>( in, out, count, pattern ); }
+}
+
+inline float32x4_t dotNEON( const float* m, const float32x4_t a, const float32x4_t b, const float32x4_t c )
+{
+    return vaddq_f32( vaddq_f32( vmulq_n_f32( a, m[0] ), vmulq_n_f32( b, m[1] ) ), vmulq_n_f32( c, m[2] ) );
+}
+
+void yuvReduceNEON( float* red, float* green, float* blue, const std::size_t count, const YUVReductionConstants& c )
+{
+    const std::size_t end = count - count % 4;
+    for( std::size_t i = 0; i < end; i += 4 )
+    {
+        const float32x4_t r = vld1q_f32( red + i ), g = vld1q_f32( green + i ), b = vld1q_f32( blue + i );
+        float32x4_t yuv[3];
+        for( std::size_t k = 0; k < 3; ++k )
+        {
+            const float32x4_t x = vaddq_f32( dotNEON( c.forward[k], r, g, b ), vdupq_n_f32( c.offset[k] ) );
+            yuv[k] = vminq_f32( vdupq_n_f32( c.upper[k] ), vmaxq_f32( vdupq_n_f32( c.lower[k] ), x ) );
+        }
+        vst1q_f32( red + i, dotNEON( c.backward[0], yuv[0], yuv[1], yuv[2] ) );
+        vst1q_f32( green + i, dotNEON( c.backward[1], yuv[0], yuv[1], yuv[2] ) );
+        vst1q_f32( blue + i, dotNEON( c.backward[2], yuv[0], yuv[1], yuv[2] ) );
+    }
+    yuvReduceScalar( red + end, green + end, blue + end, count - end, c );
+}
+
+#endif
+
+struct ReduceKernel
+{
+    ReduceFunction function;
+    YUVReduceFunction yuvFunction;
+    const char* name;
+};
+
+/**
+ * @brief select the best kernel supported by the cpu
+ */
+ReduceKernel selectReduceKernel()
+{
+#if defined( COLORNEGINVERT_X86_KERNELS )
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx" ) )
+    {
+        return ReduceKernel{ &reduceAVX, &yuvReduceAVX, "avx" };
+    }
+    if ( __builtin_cpu_supports( "sse2" ) )
+    {
+        return ReduceKernel{ &reduceSSE2, &yuvReduceSSE2, "sse2" };
+    }
+#elif defined( COLORNEGINVERT_NEON_KERNELS )
+    return ReduceKernel{ &reduceNEON, &yuvReduceNEON, "neon" };
+#endif
+    return ReduceKernel{ &reduceScalar, &yuvReduceScalar, "scalar" };
+}
+
+const ReduceKernel& reduceKernel()
+{
+    static const ReduceKernel kernel = selectReduceKernel();
+    return kernel;
+}
+
+void makePattern( const RGBReductionConstants& constants, ReductionPattern& pattern )
+{
+    for( std::size_t i = 0; i < kPatternSize; ++i )
+    {
+        pattern.filterColor[i] = constants.filterColor[i % 3];
+        pattern.subFactor[i] = constants.subFactor[i % 3];
+        pattern.factor[i] = constants.factor[i % 3];
+    }
+}
+
+/**
+ * @brief convert a row chunk to premultiplied float RGB
+ */
+template<typename Channel>
+void loadChunk( const Channel* src, float* work, const std::size_t width, const std::size_t nbChannels )
+{
+    if ( nbChannels == 3 )
+    {
+        for( std::size_t i = 0; i < 3 * width; ++i )
+        {
+            work[i] = toFloat( src[i] );
+        }
+    }
+    else
+    {
+        for( std::size_t x = 0; x < width; ++x, src += 4, work += 3 )
+        {
+            work[0] = toFloat( multiply( src[0], src[3] ) );
+            work[1] = toFloat( multiply( src[1], src[3] ) );
+            work[2] = toFloat( multiply( src[2], src[3] ) );
+        }
+    }
+}
+
+/**
+ * @brief convert a float RGB chunk to the destination row
+ */
+template<typename Channel>
+void storeChunk( const float* work, Channel* dst, const std::size_t width, const std::size_t nbChannels )
+{
+    if ( nbChannels == 3 )
+    {
+        for( std::size_t i = 0; i < 3 * width; ++i )
+        {
+            fromFloat( work[i], dst[i] );
+        }
+    }
+    else
+    {
+        const Channel alpha = maxValue( dst );
+        for( std::size_t x = 0; x < width; ++x, dst += 4, work += 3 )
+        {
+            fromFloat( work[0], dst[0] );
+            fromFloat( work[1], dst[1] );
+            fromFloat( work[2], dst[2] );
+            dst[3] = alpha;
+        }
+    }
+}
+
+inline const std::vector<boost::uint8_t>* lookupTables( const RGBReductionTables& tables, const boost::uint8_t* ) { return tables.lut8; }
+inline const std::vector<boost::uint16_t>* lookupTables( const RGBReductionTables& tables, const boost::uint16_t* ) { return tables.lut16; }
+
+/**
+ * @brief RGB reduction of a row thru the lookup tables
+ */
+template<typename Channel>
+void lookupRow( const Channel* src, Channel* dst, const std::size_t width, const std::size_t nbChannels, const RGBReductionTables& tables )
+{
+    const std::vector<Channel>* luts = lookupTables( tables, src );
+    const Channel* red = &luts[0][0];
+    const Channel* green = &luts[1][0];
+    const Channel* blue = &luts[2][0];
+    if ( nbChannels == 3 )
+    {
+        for( std::size_t x = 0; x < width; ++x, src += 3, dst += 3 )
+        {
+            const Channel r = src[0], g = src[1], b = src[2];
+            dst[0] = red[r];
+            dst[1] = green[g];
+            dst[2] = blue[b];
+        }
+    }
+    else
+    {
+        // Premultiplying by a maximum alpha keeps the value
+        const Channel alpha = maxValue( dst );
+        for( std::size_t x = 0; x < width; ++x, src += 4, dst += 4 )
+        {
+            const Channel a = src[3];
+            const Channel r = multiply( src[0], a ), g = multiply( src[1], a ), b = multiply( src[2], a );
+            dst[0] = red[r];
+            dst[1] = green[g];
+            dst[2] = blue[b];
+            dst[3] = alpha;
+        }
+    }
+}
+
+template<typename Channel>
+void rgbReductionRowT( const Channel* src, Channel* dst, const std::size_t width, const std::size_t nbChannels, const RGBReductionConstants& constants )
+{
+    ReductionPattern pattern;
+    makePattern( constants, pattern );
+    const ReduceFunction reduce = reduceKernel().function;
+
+    float work[3 * kChunkSize];
+    for( std::size_t x = 0; x < width; x += kChunkSize )
+    {
+        const std::size_t chunkWidth = std::min( kChunkSize, width - x );
+        loadChunk( src + x * nbChannels, work, chunkWidth, nbChannels );
+        reduce( work, work, 3 * chunkWidth, pattern, constants.invert );
+        storeChunk( work, dst + x * nbChannels, chunkWidth, nbChannels );
+    }
+}
+
+/**
+ * @brief clamp to 0..upper, written so that the loops vectorize
+ */
+inline float saturate( float v, const float upper )
+{
+    v = v > 0.0f ? v : 0.0f;
+    return v < upper ? v : upper;
+}
+
+/**
+ * @brief convert a row chunk to planar float RGB (0..1), weighted by the alpha
+ * The conversion runs on the interleaved chunk, which vectorizes, before the
+ * channels are split.
+ */
+template<typename Channel>
+void loadPlanarChunk( const Channel* src, float* work, float* red, float* green, float* blue, const std::size_t width, const std::size_t nbChannels )
+{
+    const std::size_t count = nbChannels * width;
+    for( std::size_t i = 0; i < count; ++i )
+    {
+        work[i] = toFloat( src[i] );
+    }
+    if ( nbChannels == 3 )
+    {
+        for( std::size_t x = 0; x < width; ++x, work += 3 )
+        {
+            red[x] = work[0];
+            green[x] = work[1];
+            blue[x] = work[2];
+        }
+    }
+    else
+    {
+        for( std::size_t x = 0; x < width; ++x, work += 4 )
+        {
+            red[x] = work[0] * work[3];
+            green[x] = work[1] * work[3];
+            blue[x] = work[2] * work[3];
+        }
+    }
+}
+
+/**
+ * @brief convert planar float RGB to the destination row, integers are saturated
+ * The planes are quantized first, which vectorizes, before the channels are interleaved.
+ */
+template<typename Channel>
+void storePlanarChunk( const float* red, const float* green, const float* blue, boost::int32_t* work, Channel* dst, const std::size_t width, const std::size_t nbChannels )
+{
+    const Channel alpha = maxValue( dst );
+    const float maximum = alpha;
+    boost::int32_t* quantizedRed = work;
+    boost::int32_t* quantizedGreen = work + kChunkSize;
+    boost::int32_t* quantizedBlue = work + 2 * kChunkSize;
+    for( std::size_t x = 0; x < width; ++x )
+    {
+        quantizedRed[x] = static_cast<boost::int32_t>( saturate( red[x] * maximum + 0.5f, maximum ) );
+        quantizedGreen[x] = static_cast<boost::int32_t>( saturate( green[x] * maximum + 0.5f, maximum ) );
+        quantizedBlue[x] = static_cast<boost::int32_t>( saturate( blue[x] * maximum + 0.5f, maximum ) );
+    }
+    if ( nbChannels == 3 )
+    {
+        for( std::size_t x = 0; x < width; ++x, dst += 3 )
+        {
+            dst[0] = Channel( quantizedRed[x] );
+            dst[1] = Channel( quantizedGreen[x] );
+            dst[2] = Channel( quantizedBlue[x] );
+        }
+    }
+    else
+    {
+        for( std::size_t x = 0; x < width; ++x, dst += 4 )
+        {
+            dst[0] = Channel( quantizedRed[x] );
+            dst[1] = Channel( quantizedGreen[x] );
+            dst[2] = Channel( quantizedBlue[x] );
+            dst[3] = alpha;
+        }
+    }
+}
+
+/**
+ * @brief float rows are stored as computed (not clamped)
+ */
+void storePlanarChunk( const float* red, const float* green, const float* blue, boost::int32_t*, float* dst, const std::size_t width, const std::size_t nbChannels )
+{
+    if ( nbChannels == 3 )
+    {
+        for( std::size_t x = 0; x < width; ++x, dst += 3 )
+        {
+            dst[0] = red[x];
+            dst[1] = green[x];
+            dst[2] = blue[x];
+        }
+    }
+    else
+    {
+        for( std::size_t x = 0; x < width; ++x, dst += 4 )
+        {
+            dst[0] = red[x];
+            dst[1] = green[x];
+            dst[2] = blue[x];
+            dst[3] = 1.0f;
+        }
+    }
+}
+
+template<typename Channel>
+void yuvReductionRowT( const Channel* src, Channel* dst, const std::size_t width, const std::size_t nbChannels, const YUVReductionConstants& constants )
+{
+    const YUVReduceFunction reduce = reduceKernel().yuvFunction;
+
+    alignas( 32 ) float red[kChunkSize];
+    alignas( 32 ) float green[kChunkSize];
+    alignas( 32 ) float blue[kChunkSize];
+    float work[4 * kChunkSize];
+    boost::int32_t quantized[3 * kChunkSize];
+    for( std::size_t x = 0; x < width; x += kChunkSize )
+    {
+        const std::size_t chunkWidth = std::min( kChunkSize, width - x );
+        loadPlanarChunk( src + x * nbChannels, work, red, green, blue, chunkWidth, nbChannels );
+        reduce( red, green, blue, chunkWidth, constants );
+        storePlanarChunk( red, green, blue, quantized, dst + x * nbChannels, chunkWidth, nbChannels );
+    }
+}
+
+/**
+ * @brief fill the tables by reducing a row holding every channel value
+ */
+template<typename Channel>
+void fillTables( const RGBReductionConstants& constants, std::vector<Channel>* luts )
+{
+    const std::size_t size = std::size_t( maxValue( static_cast<const Channel*>( nullptr ) ) ) + 1;
+    std::vector<Channel> row( 3 * size );
+    for( std::size_t v = 0; v < size; ++v )
+    {
+        row[3 * v] = row[3 * v + 1] = row[3 * v + 2] = Channel( v );
+    }
+    rgbReductionRowT( &row[0], &row[0], size, 3, constants );
+    for( std::size_t c = 0; c < 3; ++c )
+    {
+        luts[c].resize( size );
+        for( std::size_t v = 0; v < size; ++v )
+        {
+            luts[c][v] = row[3 * v + c];
+        }
+    }
+}
+
+/**
+ * @brief add a row to the histogram, the luminance weights are the YUV ones
+ */
+template<typename Channel>
+void accumulateMaskHistogramT( const Channel* src, const std::size_t width, const std::size_t nbChannels, MaskHistogram& histogram )
+{
+    static const float kLastBin = float( MaskHistogram::kNbBins - 1 );
+    boost::uint64_t* count = &histogram.count[0];
+    double* red = &histogram.sum[0][0];
+    double* green = &histogram.sum[1][0];
+    double* blue = &histogram.sum[2][0];
+    boost::uint64_t* redCount = &histogram.channelCount[0][0];
+    boost::uint64_t* greenCount = &histogram.channelCount[1][0];
+    boost::uint64_t* blueCount = &histogram.channelCount[2][0];
+
+    alignas( 32 ) float r[kChunkSize];
+    alignas( 32 ) float g[kChunkSize];
+    alignas( 32 ) float b[kChunkSize];
+    float work[4 * kChunkSize];
+    for( std::size_t x = 0; x < width; x += kChunkSize )
+    {
+        const std::size_t chunkWidth = std::min( kChunkSize, width - x );
+        loadPlanarChunk( src + x * nbChannels, work, r, g, b, chunkWidth, nbChannels );
+        for( std::size_t i = 0; i < chunkWidth; ++i )
+        {
+            const float y = r[i] * 0.299f + g[i] * 0.587f + b[i] * 0.114f;
+            const std::size_t bin = static_cast<std::size_t>( saturate( y * kLastBin + 0.5f, kLastBin ) );
+            ++count[bin];
+            red[bin] += r[i];
+            green[bin] += g[i];
+            blue[bin] += b[i];
+            ++redCount[static_cast<std::size_t>( saturate( r[i] * kLastBin + 0.5f, kLastBin ) )];
+            ++greenCount[static_cast<std::size_t>( saturate( g[i] * kLastBin + 0.5f, kLastBin ) )];
+            ++blueCount[static_cast<std::size_t>( saturate( b[i] * kLastBin + 0.5f, kLastBin ) )];
+        }
+    }
+    histogram.nbPixels += width;
+}
+
+}
+
+bool RGBReductionConstants::operator==( const RGBReductionConstants& other ) const
+{
+    return std::equal( filterColor, filterColor + 3, other.filterColor ) &&
+           std::equal( subFactor, subFactor + 3, other.subFactor ) &&
+           std::equal( factor, factor + 3, other.factor ) &&
+           invert == other.invert;
+}
+
+/**
+ * @brief build the RGB reduction constants
+ * @param filterColor[in] mask color (0..1)
+ * @param factor[in] channel contrast factors
+ * @param invert[in] invert the colors
+ */
+RGBReductionConstants makeRGBReductionConstants( const float filterColor[3], const float factor[3], const bool invert )
+{
+    RGBReductionConstants constants;
+    for( std::size_t c = 0; c < 3; ++c )
+    {
+        constants.filterColor[c] = filterColor[c];
+        constants.subFactor[c] = 1.0 + ( 1.0 / filterColor[c] );
+        constants.factor[c] = factor[c];
+    }
+    constants.invert = invert;
+    return constants;
+}
+
+/**
+ * @brief build the lookup tables of a bit depth, using the row kernels
+ * @param constants[in] render constants
+ * @param bitDepth[in] 8 or 16
+ */
+RGBReductionTables makeRGBReductionTables( const RGBReductionConstants& constants, const std::size_t bitDepth )
+{
+    RGBReductionTables tables;
+    tables.bitDepth = bitDepth;
+    if ( bitDepth == 8 )
+    {
+        fillTables( constants, tables.lut8 );
+    }
+    else if ( bitDepth == 16 )
+    {
+        fillTables( constants, tables.lut16 );
+    }
+    return tables;
+}
+
+void rgbReductionRow( const boost::uint8_t* src, boost::uint8_t* dst, const std::size_t width, const std::size_t nbChannels, const RGBReductionConstants& constants, const RGBReductionTables* tables )
+{
+    if ( tables && tables->bitDepth == 8 )
+    {
+        lookupRow( src, dst, width, nbChannels, *tables );
+    }
+    else
+    {
+        rgbReductionRowT( src, dst, width, nbChannels, constants );
+    }
+}
+
+void rgbReductionRow( const boost::uint16_t* src, boost::uint16_t* dst, const std::size_t width, const std::size_t nbChannels, const RGBReductionConstants& constants, const RGBReductionTables* tables )
+{
+    if ( tables && tables->bitDepth == 16 )
+    {
+        lookupRow( src, dst, width, nbChannels, *tables );
+    }
+    else
+    {
+        rgbReductionRowT( src, dst, width, nbChannels, constants );
+    }
+}
+
+void rgbReductionRow( const float* src, float* dst, const std::size_t width, const std::size_t nbChannels, const RGBReductionConstants& constants, const RGBReductionTables* )
+{
+    if ( nbChannels == 3 )
+    {
+        // No conversion, reduce straight into the destination
+        ReductionPattern pattern;
+        makePattern( constants, pattern );
+        reduceKernel().function( src, dst, 3 * width, pattern, constants.invert );
+    }
+    else
+    {
+        rgbReductionRowT( src, dst, width, nbChannels, constants );
+    }
+}
+
+/**
+ * @brief build the YUV reduction constants
+ * @param filterColor[in] mask color (0..1)
+ * @param factor[in] channel contrast factors (not negative)
+ */
+YUVReductionConstants makeYUVReductionConstants( const float filterColor[3], const float factor[3] )
+{
+    // terry RGB <-> YUV conversions
+    static const double kRGBToYUV[3][3] = {
+        { 0.299, 0.587, 0.114 },
+        { -0.299 * 0.492, -0.587 * 0.492, ( 1.0 - 0.114 ) * 0.492 },
+        { ( 1.0 - 0.299 ) * 0.877, -0.587 * 0.877, -0.114 * 0.877 } };
+    static const double kYUVToRGB[3][3] = {
+        { 1.0, 0.0, 1.13983 },
+        { 1.0, -0.39465, -0.58060 },
+        { 1.0, 2.03211, 0.0 } };
+    static const double kLower[3] = { 0.0, -0.436, -0.615 };
+    static const double kUpper[3] = { 1.0, 0.436, 0.615 };
+
+    // Mask color in YUV, rounded to float as the per pixel code does
+    const double r = filterColor[0], g = filterColor[1], b = filterColor[2];
+    const double y = r * 0.299 + g * 0.587 + b * 0.114;
+    const double ref[3] = { float( y ), float( ( b - y ) * 0.492 ), float( ( r - y ) * 0.877 ) };
+    // y - ( yRef - y ) doubles the luminance
+    const double scale[3] = { 2.0, 1.0, 1.0 };
+
+    YUVReductionConstants constants;
+    for( std::size_t k = 0; k < 3; ++k )
+    {
+        const double f = std::max( double( factor[k] ), 0.0 );
+        for( std::size_t c = 0; c < 3; ++c )
+        {
+            constants.forward[k][c] = float( kRGBToYUV[k][c] * scale[k] * f );
+            constants.backward[k][c] = float( kYUVToRGB[k][c] );
+        }
+        constants.offset[k] = float( -ref[k] * f );
+        constants.lower[k] = float( kLower[k] * f );
+        constants.upper[k] = float( kUpper[k] );
+    }
+    return constants;
+}
+
+void yuvReductionRow( const boost::uint8_t* src, boost::uint8_t* dst, const std::size_t width, const std::size_t nbChannels, const YUVReductionConstants& constants )
+{
+    yuvReductionRowT( src, dst, width, nbChannels, constants );
+}
+
+void yuvReductionRow( const boost::uint16_t* src, boost::uint16_t* dst, const std::size_t width, const std::size_t nbChannels, const YUVReductionConstants& constants )
+{
+    yuvReductionRowT( src, dst, width, nbChannels, constants );
+}
+
+void yuvReductionRow( const float* src, float* dst, const std::size_t width, const std::size_t nbChannels, const YUVReductionConstants& constants )
+{
+    yuvReductionRowT( src, dst, width, nbChannels, constants );
+}
+
+MaskHistogram::MaskHistogram()
+: count( kNbBins, 0 )
+, nbPixels( 0 )
+{
+    for( std::size_t c = 0; c < 3; ++c )
+    {
+        sum[c].assign( kNbBins, 0.0 );
+        channelCount[c].assign( kNbBins, 0 );
+    }
+}
+
+void MaskHistogram::clear()
+{
+    std::fill( count.begin(), count.end(), 0 );
+    for( std::size_t c = 0; c < 3; ++c )
+    {
+        std::fill( sum[c].begin(), sum[c].end(), 0.0 );
+        std::fill( channelCount[c].begin(), channelCount[c].end(), 0 );
+    }
+    nbPixels = 0;
+}
+
+void MaskHistogram::merge( const MaskHistogram& other )
+{
+    for( std::size_t i = 0; i < kNbBins; ++i )
+    {
+        count[i] += other.count[i];
+        sum[0][i] += other.sum[0][i];
+        sum[1][i] += other.sum[1][i];
+        sum[2][i] += other.sum[2][i];
+        channelCount[0][i] += other.channelCount[0][i];
+        channelCount[1][i] += other.channelCount[1][i];
+        channelCount[2][i] += other.channelCount[2][i];
+    }
+    nbPixels += other.nbPixels;
+}
+
+void accumulateMaskHistogram( const boost::uint8_t* src, const std::size_t width, const std::size_t nbChannels, MaskHistogram& histogram )
+{
+    accumulateMaskHistogramT( src, width, nbChannels, histogram );
+}
+
+void accumulateMaskHistogram( const boost::uint16_t* src, const std::size_t width, const std::size_t nbChannels, MaskHistogram& histogram )
+{
+    accumulateMaskHistogramT( src, width, nbChannels, histogram );
+}
+
+void accumulateMaskHistogram( const float* src, const std::size_t width, const std::size_t nbChannels, MaskHistogram& histogram )
+{
+    accumulateMaskHistogramT( src, width, nbChannels, histogram );
+}
+
+/**
+ * @brief estimate the mask color from the brightest pixels
+ * @param histogram[in] histogram of the analyzed pixels
+ * @param maskColor[out] mask color (0..1)
+ * @param lowPercentile[in] lower bound of the averaged band (0..1)
+ * @param highPercentile[in] upper bound of the averaged band (0..1)
+ * @return false if the histogram is empty
+ */
+bool estimateMaskColor( const MaskHistogram& histogram, float maskColor[3], const double lowPercentile, const double highPercentile )
+{
+    if ( histogram.nbPixels == 0 )
+    {
+        return false;
+    }
+    const double total = double( histogram.nbPixels );
+    const double high = std::min( std::max( highPercentile, 0.0 ), 1.0 );
+    const double low = std::min( std::max( lowPercentile, 0.0 ), high );
+    // Pixels to skip from the top, then to average (at least one)
+    double skip = total * ( 1.0 - high );
+    double band = std::max( total * ( high - low ), 1.0 );
+
+    double weight = 0.0;
+    double color[3] = { 0.0, 0.0, 0.0 };
+    for( std::size_t i = MaskHistogram::kNbBins; i-- > 0 && band > 0.0; )
+    {
+        double available = double( histogram.count[i] );
+        if ( available <= 0.0 )
+        {
+            continue;
+        }
+        const double skipped = std::min( skip, available );
+        skip -= skipped;
+        available -= skipped;
+        // Band bounds fall inside bins: take a part of the bin mean
+        const double taken = std::min( band, available );
+        if ( taken > 0.0 )
+        {
+            const double ratio = taken / double( histogram.count[i] );
+            for( std::size_t c = 0; c < 3; ++c )
+            {
+                color[c] += histogram.sum[c][i] * ratio;
+            }
+            weight += taken;
+            band -= taken;
+        }
+    }
+    if ( weight <= 0.0 )
+    {
+        return false;
+    }
+    for( std::size_t c = 0; c < 3; ++c )
+    {
+        maskColor[c] = float( color[c] / weight );
+    }
+    return true;
+}
+
+/**
+ * @brief estimate the channel contrast factors of the RGB reduction
+ * @param histogram[in] histogram of the analyzed pixels
+ * @param maskColor[in] mask color (0..1)
+ * @param factor[out] channel contrast factors, in 0..maxFactor
+ * @param percentile[in] part of the darkest pixels ignored (0..1)
+ * @param maxFactor[in] maximum factor
+ * @return false if the histogram is empty
+ */
+bool estimateChannelFactors( const MaskHistogram& histogram, const float maskColor[3], float factor[3], const double percentile, const double maxFactor )
+{
+    if ( histogram.nbPixels == 0 )
+    {
+        return false;
+    }
+    const double skip = double( histogram.nbPixels ) * std::min( std::max( percentile, 0.0 ), 1.0 );
+    for( std::size_t c = 0; c < 3; ++c )
+    {
+        // Lowest channel value above the percentile
+        const std::vector<boost::uint64_t>& count = histogram.channelCount[c];
+        std::size_t bin = 0;
+        double seen = double( count[0] );
+        while( seen <= skip && bin + 1 < MaskHistogram::kNbBins )
+        {
+            seen += double( count[++bin] );
+        }
+        const double darkest = double( bin ) / double( MaskHistogram::kNbBins - 1 );
+
+        // Reduced value of the darkest pixels, as in the RGB reduction
+        const double filterColor = std::max( double( maskColor[c] ), 1e-6 );
+        const double reduced = ( filterColor - darkest ) * ( 1.0 + 1.0 / filterColor );
+        factor[c] = float( reduced > 0.0 ? std::min( 1.0 / reduced, maxFactor ) : 1.0 );
+    }
+    return true;
+}
+
+/**
+ * @brief name of the instruction set used by the row kernels (avx, sse2, neon or scalar)
+ */
+const char* rgbReductionKernelName()
+{
+    return reduceKernel().name;
+}
+
+}
+}
+}
@@ -6,10 +6,180 @@
 #ifndef _TUTTLE_PLUGIN_COLORNEGINVERT_ALGORITHM_HPP_
 #define _TUTTLE_PLUGIN_COLORNEGINVERT_ALGORITHM_HPP_
 
+#include <boost/cstdint.hpp>
+
+#include <cstddef>
+#include <vector>
+
 namespace tuttle {
 namespace plugin {
 namespace colorNegInvert {
 
+/**
+ * @brief per render constants of the RGB reduction
+ * Each channel is computed as:
+ *   t = min( 1, max( 0, ( filterColor - x ) * subFactor ) * factor )
+ *   out = invert ? 1 - t : t
+ * in double precision, x being the channel value converted to float (0..1)
+ * as boost::gil does it (RGBA is premultiplied by its alpha).
+ */
+struct RGBReductionConstants
+{
+    double filterColor[3];  ///< Mask color (0..1)
+    double subFactor[3];    ///< 1 + 1 / mask color
+    double factor[3];       ///< Channel contrast factor
+    bool invert;            ///< Invert the colors
+
+    bool operator==( const RGBReductionConstants& other ) const;
+};
+
+/**
+ * @brief per channel lookup tables of the RGB reduction for integer inputs
+ * Each output channel only depends on the (premultiplied) input channel,
+ * so 8 and 16 bits rows are reduced with one table read per channel.
+ */
+struct RGBReductionTables
+{
+    std::size_t bitDepth;                   ///< 8 or 16
+    std::vector<boost::uint8_t> lut8[3];    ///< 8 bits tables (256 entries)
+    std::vector<boost::uint16_t> lut16[3];  ///< 16 bits tables (65536 entries)
+};
+
+/**
+ * @brief build the RGB reduction constants
+ * @param filterColor[in] mask color (0..1)
+ * @param factor[in] channel contrast factors
+ * @param invert[in] invert the colors
+ */
+RGBReductionConstants makeRGBReductionConstants( const float filterColor[3], const float factor[3], const bool invert );
+
+/**
+ * @brief build the lookup tables of a bit depth, using the row kernels
+ * @param constants[in] render constants
+ * @param bitDepth[in] 8 or 16
+ */
+RGBReductionTables makeRGBReductionTables( const RGBReductionConstants& constants, const std::size_t bitDepth );
+
+/**
+ * @brief RGB reduction of an interleaved row
+ * The output matches the per pixel boost::gil path bit for bit, the alpha
+ * channel of RGBA rows is set to the maximum value.
+ * @param src[in] source row
+ * @param dst[out] destination row (may be the source row)
+ * @param width[in] number of pixels
+ * @param nbChannels[in] 3 (RGB) or 4 (RGBA)
+ * @param constants[in] render constants
+ * @param tables[in] lookup tables of the row bit depth, used for integer rows if not null
+ */
+void rgbReductionRow( const boost::uint8_t* src, boost::uint8_t* dst, const std::size_t width, const std::size_t nbChannels, const RGBReductionConstants& constants, const RGBReductionTables* tables = nullptr );
+void rgbReductionRow( const boost::uint16_t* src, boost::uint16_t* dst, const std::size_t width, const std::size_t nbChannels, const RGBReductionConstants& constants, const RGBReductionTables* tables = nullptr );
+void rgbReductionRow( const float* src, float* dst, const std::size_t width, const std::size_t nbChannels, const RGBReductionConstants& constants, const RGBReductionTables* tables = nullptr );
+
+/**
+ * @brief per render constants of the YUV reduction
+ * The per pixel reduction converts RGB to YUV, subtracts the mask color,
+ * clamps and scales each component and converts back to RGB:
+ *   y' = min( 1, max( 0, y - ( yRef - y ) ) * factor[0] )
+ *   u' = min( 0.436, max( -0.436, u - uRef ) * factor[1] )
+ *   v' = min( 0.615, max( -0.615, v - vRef ) * factor[2] )
+ * The factors are not negative, so the scaling goes before the lower
+ * clamp and the whole reduction is an affine transform, a clamp and a
+ * matrix: rgb' = backward * clamp( forward * rgb + offset, lower, upper ).
+ */
+struct YUVReductionConstants
+{
+    float forward[3][3];    ///< RGB to reduced YUV (scaled, luminance doubled)
+    float offset[3];        ///< Mask color part of the reduced YUV
+    float lower[3];         ///< Reduced YUV lower bounds
+    float upper[3];         ///< Reduced YUV upper bounds
+    float backward[3][3];   ///< YUV to RGB
+};
+
+/**
+ * @brief build the YUV reduction constants
+ * @param filterColor[in] mask color (0..1)
+ * @param factor[in] channel contrast factors (not negative)
+ */
+YUVReductionConstants makeYUVReductionConstants( const float filterColor[3], const float factor[3] );
+
+/**
+ * @brief YUV reduction of an interleaved row, evaluated in float
+ * RGBA is weighted by its alpha, the output alpha is set to the maximum value.
+ * @param src[in] source row
+ * @param dst[out] destination row (may be the source row)
+ * @param width[in] number of pixels
+ * @param nbChannels[in] 3 (RGB) or 4 (RGBA)
+ * @param constants[in] render constants
+ */
+void yuvReductionRow( const boost::uint8_t* src, boost::uint8_t* dst, const std::size_t width, const std::size_t nbChannels, const YUVReductionConstants& constants );
+void yuvReductionRow( const boost::uint16_t* src, boost::uint16_t* dst, const std::size_t width, const std::size_t nbChannels, const YUVReductionConstants& constants );
+void yuvReductionRow( const float* src, float* dst, const std::size_t width, const std::size_t nbChannels, const YUVReductionConstants& constants );
+
+/**
+ * @brief luminance histogram used to estimate the mask color
+ * Each bin holds the number of pixels of its luminance and the sum of their
+ * RGB values, so that the mask color is averaged over a luminance band.
+ * Histograms of image parts (threads, tiles or frames of a roll) are merged.
+ */
+struct MaskHistogram
+{
+    static const std::size_t kNbBins = 1024;
+
+    MaskHistogram();
+
+    void clear();
+
+    void merge( const MaskHistogram& other );
+
+    std::vector<boost::uint64_t> count;     ///< Number of pixels of each bin
+    std::vector<double> sum[3];             ///< RGB sums of each bin
+    std::vector<boost::uint64_t> channelCount[3]; ///< Per channel value histograms
+    boost::uint64_t nbPixels;               ///< Total number of pixels
+};
+
+/**
+ * @brief add the pixels of an interleaved row to a mask histogram
+ * RGBA is weighted by its alpha, as in the reductions.
+ * @param src[in] source row
+ * @param width[in] number of pixels
+ * @param nbChannels[in] 3 (RGB) or 4 (RGBA)
+ * @param histogram[in, out] histogram
+ */
+void accumulateMaskHistogram( const boost::uint8_t* src, const std::size_t width, const std::size_t nbChannels, MaskHistogram& histogram );
+void accumulateMaskHistogram( const boost::uint16_t* src, const std::size_t width, const std::size_t nbChannels, MaskHistogram& histogram );
+void accumulateMaskHistogram( const float* src, const std::size_t width, const std::size_t nbChannels, MaskHistogram& histogram );
+
+/**
+ * @brief estimate the mask color from the brightest pixels
+ * The mask is the brightest part of a negative (unexposed film). The pixels
+ * above the high percentile (light leaks, dust holes, scratches) are ignored
+ * and the mask color is the mean color of the pixels between the low and the
+ * high luminance percentiles.
+ * @param histogram[in] histogram of the analyzed pixels
+ * @param maskColor[out] mask color (0..1)
+ * @param lowPercentile[in] lower bound of the averaged band (0..1)
+ * @param highPercentile[in] upper bound of the averaged band (0..1)
+ * @return false if the histogram is empty
+ */
+bool estimateMaskColor( const MaskHistogram& histogram, float maskColor[3], const double lowPercentile = 0.99, const double highPercentile = 0.999 );
+
+/**
+ * @brief estimate the channel contrast factors of the RGB reduction
+ * The densest part of the negative (lowest channel value, ignoring the
+ * pixels below the percentile) is scaled to the maximum value.
+ * @param histogram[in] histogram of the analyzed pixels
+ * @param maskColor[in] mask color (0..1)
+ * @param factor[out] channel contrast factors, in 0..maxFactor
+ * @param percentile[in] part of the darkest pixels ignored (0..1)
+ * @param maxFactor[in] maximum factor
+ * @return false if the histogram is empty
+ */
+bool estimateChannelFactors( const MaskHistogram& histogram, const float maskColor[3], float factor[3], const double percentile = 0.005, const double maxFactor = 3.0 );
+
+/**
+ * @brief name of the instruction set used by the row kernels (avx, sse2, neon or scalar)
+ */
+const char* rgbReductionKernelName();
 
 }
 }
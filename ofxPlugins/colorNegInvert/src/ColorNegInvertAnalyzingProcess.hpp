@@ -6,30 +6,30 @@
 #ifndef _TUTTLE_PLUGIN_COLORNEGINVERTANALYZING_PROCESS_HPP_
 #define _TUTTLE_PLUGIN_COLORNEGINVERTANALYZING_PROCESS_HPP_
 
-#include <tuttle/plugin/ImageGilFilterProcessor.hpp>
-#include <boost/atomic.hpp>
+#include "ColorNegInvertProcess.hpp"
+
+#include <ofxsMultiThread.h>
 
 namespace tuttle {
 namespace plugin {
 namespace colorNegInvert {
 
 /**
- * @brief ColorNegInvert process
- *
+ * @brief ColorNegInvert analyzing process
+ * Renders as the ColorNegInvert process and builds the mask histogram of the
+ * source on the way: each thread fills its own histogram, merged at the end.
  */
 template<class View>
-class ColorNegInvertAnalyzingProcess : public ImageGilFilterProcessor<View>
+class ColorNegInvertAnalyzingProcess : public ColorNegInvertProcess<View>
 {
 public:
 	typedef typename View::value_type Pixel;
 	typedef typename boost::gil::channel_type<View>::type Channel;
 	typedef float Scalar;
 protected:
-    ColorNegInvertPlugin&    _plugin;            ///< Rendering plugin
-    ColorNegInvertProcessParams<Scalar> _params; ///< parameters
-    boost::atomic<double> _redFilterColor;
-    boost::atomic<double> _greenFilterColor;
-    boost::atomic<double> _blueFilterColor;
+    OFX::MultiThread::Mutex _histogramMutex;    ///< Threads merge their histogram
+    MaskHistogram _histogram;                   ///< Histogram of the source
+    AnalyzedArea _area;                         ///< Analyzed frame and window
 
 public:
     ColorNegInvertAnalyzingProcess( ColorNegInvertPlugin& effect );
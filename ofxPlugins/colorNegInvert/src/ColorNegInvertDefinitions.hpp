@@ -27,6 +27,29 @@ static const std::string kParamAnalyzeLabel( "Analyse orange mask" );
 static const std::string kParamApplyParameters( "Apply" );
 static const std::string kParamAnalyzeHint( "Use this button on an image supposed to be white to get the right mask color (you need to click twice: one to get the color, one to apply)" );
 
+static const std::string kParamAnalyzeRoll( "Analyse the whole roll" );
+static const std::string kParamAnalyzeRollLabel( "Analyse the whole roll" );
+static const std::string kParamAnalyzeRollHint( "While analysing, accumulate the statistics of every rendered frame instead of using the current one only: play or scrub the roll, then apply" );
+static const bool kParamDefaultAnalyzeRollValue( false );
+
+static const std::string kParamAnalyzeRollReset( "Reset roll analysis" );
+static const std::string kParamAnalyzeRollResetLabel( "Reset roll analysis" );
+static const std::string kParamAnalyzeRollResetHint( "Forget the statistics accumulated over the roll" );
+
+static const std::string kParamCalibrateRoll( "Calibrate on the roll" );
+static const std::string kParamCalibrateRollLabel( "Calibrate on the roll" );
+static const std::string kParamCalibrateRollHint( "Sample frames across the whole source and set the mask color and the channel contrasts. The host waits until it is done (it can be cancelled): each sampled frame is rendered upstream at full resolution, a full decode per frame with a raw reader" );
+
+static const std::string kParamCalibrationFrames( "Calibration frames" );
+static const std::string kParamCalibrationFramesLabel( "Calibration frames" );
+static const std::string kParamCalibrationFramesHint( "Number of frames sampled across the source by the calibration" );
+static const int kParamDefaultCalibrationFrames( 24 );
+
+static const std::string kParamCalibrationStep( "Calibration subsampling" );
+static const std::string kParamCalibrationStepLabel( "Calibration subsampling" );
+static const std::string kParamCalibrationStepHint( "The calibration analyzes one pixel every n rows and columns of the rendered frames (the frames are still rendered whole)" );
+static const int kParamDefaultCalibrationStep( 4 );
+
 static const std::string kParamFilterForceNewRender( "Force new render" );
 
 static const std::string kParamMaximumValue( "Maximum channel value" );
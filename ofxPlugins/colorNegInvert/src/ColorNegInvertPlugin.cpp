@@ -11,10 +11,77 @@
 #include <boost/format.hpp>
 #include <boost/gil.hpp>
 
+#include <cmath>
+#include <memory>
+#include <set>
+#include <vector>
+
 namespace tuttle {
 namespace plugin {
 namespace colorNegInvert {
 
+namespace
+{
+
+/**
+ * @brief add one pixel every step rows and columns of an image to a mask histogram
+ */
+template<typename Channel>
+void accumulateImage( OFX::Image& image, const std::size_t nbChannels, const int step, MaskHistogram& histogram )
+{
+    const OfxRectI bounds = image.getBounds();
+    std::vector<Channel> row;
+    for( int y = bounds.y1; y < bounds.y2; y += step )
+    {
+        const Channel* src = static_cast<const Channel*>( image.getPixelAddress( bounds.x1, y ) );
+        if ( !src )
+        {
+            continue;
+        }
+        row.clear();
+        for( int x = bounds.x1; x < bounds.x2; x += step, src += step * nbChannels )
+        {
+            row.insert( row.end(), src, src + nbChannels );
+        }
+        if ( !row.empty() )
+        {
+            accumulateMaskHistogram( &row[0], row.size() / nbChannels, nbChannels, histogram );
+        }
+    }
+}
+
+void accumulateImage( OFX::Image& image, const int step, MaskHistogram& histogram )
+{
+    std::size_t nbChannels = 0;
+    switch( image.getPixelComponents() )
+    {
+        case OFX::ePixelComponentRGBA:
+            nbChannels = 4;
+            break;
+        case OFX::ePixelComponentRGB:
+            nbChannels = 3;
+            break;
+        default:
+            return;
+    }
+    switch( image.getPixelDepth() )
+    {
+        case OFX::eBitDepthUByte:
+            accumulateImage<boost::uint8_t>( image, nbChannels, step, histogram );
+            break;
+        case OFX::eBitDepthUShort:
+            accumulateImage<boost::uint16_t>( image, nbChannels, step, histogram );
+            break;
+        case OFX::eBitDepthFloat:
+            accumulateImage<float>( image, nbChannels, step, histogram );
+            break;
+        default:
+            break;
+    }
+}
+
+}
+
 
 ColorNegInvertPlugin::ColorNegInvertPlugin( OfxImageEffectHandle handle )
 : ImageEffectGilPlugin( handle )
@@ -22,6 +89,7 @@ ColorNegInvertPlugin::ColorNegInvertPlugin( OfxImageEffectHandle handle )
 , _redFilterColorToApply( 0.0 )
 , _greenFilterColorToApply( 0.0 )
 , _blueFilterColorToApply( 0.0 )
+, _tablesConstants()
 {
     _paramAlgo = fetchChoiceParam( kParamAlgorithm );
     _paramMaximumValue = fetchIntParam( kParamMaximumValue );
@@ -35,6 +103,9 @@ ColorNegInvertPlugin::ColorNegInvertPlugin( OfxImageEffectHandle handle )
     _paramBlueFactor = fetchDoubleParam( kParamBlueFactor );
 
     _paramColorInvert = fetchBooleanParam( kParamColorInvert );
+    _paramAnalyzeRoll = fetchBooleanParam( kParamAnalyzeRoll );
+    _paramCalibrationFrames = fetchIntParam( kParamCalibrationFrames );
+    _paramCalibrationStep = fetchIntParam( kParamCalibrationStep );
     _paramAnalyzeButton = fetchPushButtonParam( kParamAnalyzeButton );
     _paramForceNewRender = fetchIntParam( kParamFilterForceNewRender );
 
@@ -58,6 +129,7 @@ ColorNegInvertProcessParams<ColorNegInvertPlugin::Scalar> ColorNegInvertPlugin::
     params.fGreenFactor = _paramGreenFactor->getValue() / 100.0f;
     params.fBlueFactor = _paramBlueFactor->getValue() / 100.0f;
     params.bInvert = _paramColorInvert->getValue();
+    params.renderScale = renderScale;
     return params;
 }
 
@@ -79,10 +151,28 @@ void ColorNegInvertPlugin::changedParam( const OFX::InstanceChangedArgs &args, c
     else if ( paramName == kParamAnalyzeButton && _analyze == false )
     {
         _analyze = true;
+        {
+            OFX::MultiThread::AutoMutex lock( _rollMutex );
+            _frameHistogram.clear();
+            _frameAreas.clear();
+        }
         _paramForceNewRender->setValue( !_paramForceNewRender->getValue() );
         _paramAnalyzeButton->setLabels( kParamApplyParameters, kParamApplyParameters, kParamApplyParameters );
         _paramAnalyzeButton->setHint( "Click another time to apply parameters" );
     }
+    else if ( paramName == kParamCalibrateRoll )
+    {
+        if ( !calibrateRoll() )
+        {
+            sendMessage( OFX::Message::eMessageError, kParamCalibrateRollLabel, "No source frame could be analyzed" );
+        }
+    }
+    else if ( paramName == kParamAnalyzeRollReset )
+    {
+        OFX::MultiThread::AutoMutex lock( _rollMutex );
+        _rollHistogram.clear();
+        _rollAreas.clear();
+    }
     else if ( paramName == kParamMaximumValue )
     {
         _paramRedFilterColor->setRange( 0, _paramMaximumValue->getValue() );
@@ -94,6 +184,83 @@ void ColorNegInvertPlugin::changedParam( const OFX::InstanceChangedArgs &args, c
     }
 }
 
+/**
+ * @brief calibrate the mask color and the channel contrasts on frames sampled across the source
+ * Frames can only be fetched in the render and the instance changed actions, so
+ * the calibration runs in the instance changed action of the button: the host
+ * waits for it. Each frame is rendered whole by the upstream nodes, only the
+ * analysis reads one pixel every few rows and columns.
+ * @return false if no frame could be analyzed
+ */
+bool ColorNegInvertPlugin::calibrateRoll()
+{
+    const OfxRangeD range = _clipSrc->getFrameRange();
+    const int nbFrames = std::max( _paramCalibrationFrames->getValue(), 1 );
+    const int step = std::max( _paramCalibrationStep->getValue(), 1 );
+    const double length = std::max( range.max - range.min, 0.0 );
+
+    // Middle of each part of the roll, a short roll gives less frames than asked
+    std::set<double> times;
+    for( int i = 0; i < nbFrames; ++i )
+    {
+        times.insert( std::floor( range.min + length * ( i + 0.5 ) / nbFrames + 0.5 ) );
+    }
+
+    MaskHistogram histogram;
+    std::size_t nbFetched = 0;
+    progressStart( kParamCalibrateRollLabel );
+    for( const double time: times )
+    {
+        std::unique_ptr<OFX::Image> src( _clipSrc->fetchImage( time ) );
+        if ( src )
+        {
+            accumulateImage( *src, step, histogram );
+        }
+        if ( progressUpdate( double( ++nbFetched ) / times.size() ) )
+        {
+            break;
+        }
+    }
+    progressEnd();
+
+    float maskColor[3];
+    float factor[3];
+    if ( !estimateMaskColor( histogram, maskColor ) || !estimateChannelFactors( histogram, maskColor, factor ) )
+    {
+        return false;
+    }
+    const double vmax = _paramMaximumValue->getValue();
+    _paramRedFilterColor->setValue( maskColor[0] * vmax );
+    _paramGreenFilterColor->setValue( maskColor[1] * vmax );
+    _paramBlueFilterColor->setValue( maskColor[2] * vmax );
+    _paramRedFactor->setValue( factor[0] * 100.0 );
+    _paramGreenFactor->setValue( factor[1] * 100.0 );
+    _paramBlueFactor->setValue( factor[2] * 100.0 );
+    return true;
+}
+
+/**
+ * @brief get the RGB reduction lookup tables, built once per parameter change
+ * @param constants[in] render constants
+ * @param bitDepth[in] 8 or 16
+ */
+std::shared_ptr<const RGBReductionTables> ColorNegInvertPlugin::getRGBReductionTables( const RGBReductionConstants& constants, const std::size_t bitDepth )
+{
+    OFX::MultiThread::AutoMutex lock( _tablesMutex );
+    if ( !( _tablesConstants == constants ) )
+    {
+        _tablesConstants = constants;
+        _tables[0].reset();
+        _tables[1].reset();
+    }
+    std::shared_ptr<const RGBReductionTables> & tables = _tables[bitDepth == 8 ? 0 : 1];
+    if ( !tables )
+    {
+        tables = std::make_shared<RGBReductionTables>( makeRGBReductionTables( constants, bitDepth ) );
+    }
+    return tables;
+}
+
 /**
  * @brief update parameters with the filter color
  */    
@@ -105,6 +272,48 @@ void ColorNegInvertPlugin::notifyRGBFilterColor( const double r, const double g,
     _blueFilterColorToApply = b * vmax;
 }
 
+/**
+ * @brief estimate the filter color from the histogram of an analyzed frame
+ * Each tile estimates from the tiles of its frame rendered so far: the last
+ * tile gives the estimate of the whole frame.
+ * @param histogram[in] histogram of the analyzed area
+ * @param area[in] analyzed area
+ */
+void ColorNegInvertPlugin::notifyMaskHistogram( const MaskHistogram& histogram, const AnalyzedArea& area )
+{
+    float maskColor[3];
+    bool estimated = false;
+    if ( _paramAnalyzeRoll->getValue() )
+    {
+        OFX::MultiThread::AutoMutex lock( _rollMutex );
+        // Frames are rendered again on parameter changes, count them once
+        if ( _rollAreas.insert( area ).second )
+        {
+            _rollHistogram.merge( histogram );
+        }
+        estimated = estimateMaskColor( _rollHistogram, maskColor );
+    }
+    else
+    {
+        OFX::MultiThread::AutoMutex lock( _rollMutex );
+        // Tiles of a frame are accumulated, the first tile of another frame starts over
+        if ( !_frameAreas.empty() && std::get<0>( *_frameAreas.begin() ) != std::get<0>( area ) )
+        {
+            _frameHistogram.clear();
+            _frameAreas.clear();
+        }
+        if ( _frameAreas.insert( area ).second )
+        {
+            _frameHistogram.merge( histogram );
+        }
+        estimated = estimateMaskColor( _frameHistogram, maskColor );
+    }
+    if ( estimated )
+    {
+        notifyRGBFilterColor( maskColor[0], maskColor[1], maskColor[2] );
+    }
+}
+
 bool ColorNegInvertPlugin::isIdentity( const OFX::RenderArguments& args, OFX::Clip*& identityClip, double& identityTime )
 {
     return false;
@@ -7,9 +7,16 @@
 #define _TUTTLE_PLUGIN_COLORNEGINVERT_PLUGIN_HPP_
 
 #include "ColorNegInvertDefinitions.hpp"
+#include "ColorNegInvertAlgorithm.hpp"
 
 #include <tuttle/plugin/ImageEffectGilPlugin.hpp>
 
+#include <ofxsMultiThread.h>
+
+#include <memory>
+#include <set>
+#include <tuple>
+
 namespace tuttle {
 namespace plugin {
 namespace colorNegInvert {
@@ -25,8 +32,14 @@ struct ColorNegInvertProcessParams
     float fGreenFactor;
     float fBlueFactor;
     bool bInvert;
+    OfxPointD renderScale;  ///< The colors do not depend on it, the analyzed areas do
 };
 
+/**
+ * @brief frame time and full resolution render window of an analyzed area
+ */
+typedef std::tuple<double, int, int, int, int> AnalyzedArea;
+
 /**
  * @brief ColorNegInvert plugin
  */
@@ -50,6 +63,28 @@ public:
      * @brief display/update the filter color
      */    
     void notifyRGBFilterColor( const double r, const double g, const double b );
+
+    /**
+     * @brief estimate the filter color from the histogram of an analyzed frame
+     * The histogram is accumulated with the ones of the other tiles of the
+     * frame, and in roll mode with the ones of the other frames.
+     * @param histogram[in] histogram of the analyzed area
+     * @param area[in] analyzed area
+     */
+    void notifyMaskHistogram( const MaskHistogram& histogram, const AnalyzedArea& area );
+
+    /**
+     * @brief calibrate the mask color and the channel contrasts on frames sampled across the source
+     * @return false if no frame could be analyzed
+     */
+    bool calibrateRoll();
+
+    /**
+     * @brief get the RGB reduction lookup tables, built once per parameter change
+     * @param constants[in] render constants
+     * @param bitDepth[in] 8 or 16
+     */
+    std::shared_ptr<const RGBReductionTables> getRGBReductionTables( const RGBReductionConstants& constants, const std::size_t bitDepth );
 private:
     bool _analyze;              ///< Analyze color of the mask (set this on an image supposed to be white)
     double _redFilterColorToApply;
@@ -68,6 +103,19 @@ private:
     OFX::DoubleParam*	_paramGreenFactor;
     OFX::DoubleParam*	_paramBlueFactor;
     OFX::BooleanParam*	_paramColorInvert;
+    OFX::BooleanParam*	_paramAnalyzeRoll;
+    OFX::IntParam*	_paramCalibrationFrames;
+    OFX::IntParam*	_paramCalibrationStep;
+
+    OFX::MultiThread::Mutex _tablesMutex;                       ///< Renders may run concurrently
+    RGBReductionConstants _tablesConstants;                     ///< Constants of the cached tables
+    std::shared_ptr<const RGBReductionTables> _tables[2];       ///< Cached 8 and 16 bits tables
+
+    OFX::MultiThread::Mutex _rollMutex;                         ///< Renders may run concurrently
+    MaskHistogram _rollHistogram;                               ///< Histogram accumulated over the roll
+    std::set<AnalyzedArea> _rollAreas;                          ///< Areas of the roll histogram
+    MaskHistogram _frameHistogram;                              ///< Histogram accumulated over the tiles of the analyzed frame
+    std::set<AnalyzedArea> _frameAreas;                         ///< Areas of the frame histogram, all at the same time
 };
 
 }
@@ -14,7 +14,7 @@ namespace tuttle {
 namespace plugin {
 namespace colorNegInvert {
 
-static const bool kSupportTiles = false;
+static const bool kSupportTiles = true;
 
 
 /**
@@ -42,6 +42,7 @@ void ColorNegInvertPluginFactory::describe( OFX::ImageEffectDescriptor& desc )
 
     // plugin flags
     desc.setSupportsTiles( kSupportTiles );
+    desc.setSupportsMultiResolution( true );
     desc.setRenderThreadSafety( OFX::eRenderFullySafe );
 }
 
@@ -142,6 +143,36 @@ void ColorNegInvertPluginFactory::describeInContext( OFX::ImageEffectDescriptor&
     analyze->setLabel( kParamAnalyzeLabel );
     analyze->setHint( kParamAnalyzeHint );
 
+    OFX::BooleanParamDescriptor* analyzeRoll = desc.defineBooleanParam( kParamAnalyzeRoll );
+    analyzeRoll->setLabels( kParamAnalyzeRollLabel, kParamAnalyzeRollLabel, kParamAnalyzeRollLabel );
+    analyzeRoll->setHint( kParamAnalyzeRollHint );
+    analyzeRoll->setDefault( kParamDefaultAnalyzeRollValue );
+    analyzeRoll->setEvaluateOnChange( false );
+
+    OFX::PushButtonParamDescriptor* analyzeRollReset = desc.definePushButtonParam( kParamAnalyzeRollReset );
+    analyzeRollReset->setLabel( kParamAnalyzeRollResetLabel );
+    analyzeRollReset->setHint( kParamAnalyzeRollResetHint );
+
+    OFX::PushButtonParamDescriptor* calibrateRoll = desc.definePushButtonParam( kParamCalibrateRoll );
+    calibrateRoll->setLabel( kParamCalibrateRollLabel );
+    calibrateRoll->setHint( kParamCalibrateRollHint );
+
+    OFX::IntParamDescriptor* calibrationFrames = desc.defineIntParam( kParamCalibrationFrames );
+    calibrationFrames->setLabels( kParamCalibrationFramesLabel, kParamCalibrationFramesLabel, kParamCalibrationFramesLabel );
+    calibrationFrames->setHint( kParamCalibrationFramesHint );
+    calibrationFrames->setDefault( kParamDefaultCalibrationFrames );
+    calibrationFrames->setRange( 1, 1000 );
+    calibrationFrames->setDisplayRange( 1, 100 );
+    calibrationFrames->setEvaluateOnChange( false );
+
+    OFX::IntParamDescriptor* calibrationStep = desc.defineIntParam( kParamCalibrationStep );
+    calibrationStep->setLabels( kParamCalibrationStepLabel, kParamCalibrationStepLabel, kParamCalibrationStepLabel );
+    calibrationStep->setHint( kParamCalibrationStepHint );
+    calibrationStep->setDefault( kParamDefaultCalibrationStep );
+    calibrationStep->setRange( 1, 64 );
+    calibrationStep->setDisplayRange( 1, 16 );
+    calibrationStep->setEvaluateOnChange( false );
+
     OFX::IntParamDescriptor* forceNewRender = desc.defineIntParam( kParamFilterForceNewRender );
     forceNewRender->setLabel( "Force new render" );
     forceNewRender->setEnabled( false );
@@ -6,6 +6,8 @@
 #ifndef _TUTTLE_PLUGIN_COLORNEGINVERT_PROCESS_HPP_
 #define _TUTTLE_PLUGIN_COLORNEGINVERT_PROCESS_HPP_
 
+#include "ColorNegInvertAlgorithm.hpp"
+
 #include <tuttle/plugin/ImageGilFilterProcessor.hpp>
 
 namespace tuttle {
@@ -26,6 +28,9 @@ public:
 protected:
     ColorNegInvertPlugin&    _plugin;            ///< Rendering plugin
     ColorNegInvertProcessParams<Scalar> _params; ///< parameters
+    RGBReductionConstants _rgbReductionConstants; ///< RGB reduction row kernel constants
+    std::shared_ptr<const RGBReductionTables> _rgbReductionTables; ///< RGB reduction lookup tables (integer views)
+    YUVReductionConstants _yuvReductionConstants; ///< YUV reduction row kernel constants
 
 public:
     ColorNegInvertProcess( ColorNegInvertPlugin& effect );
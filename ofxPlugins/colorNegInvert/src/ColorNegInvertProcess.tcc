@@ -7,9 +7,9 @@
 #include "ColorNegInvertPlugin.hpp"
 
 #include <boost/gil.hpp>
-#include <terry/colorspace/layout/all.hpp>
+#include <boost/static_assert.hpp>
 
-typedef boost::gil::scoped_channel_value<float, boost::gil::float_point_zero<float>, boost::gil::float_point_one<float>> bits32f;
+#include <limits>
 
 namespace tuttle {
 namespace plugin {
@@ -27,6 +27,18 @@ void ColorNegInvertProcess<View>::setup( const OFX::RenderArguments& args )
 {
     ImageGilFilterProcessor<View>::setup( args );
     _params = _plugin.getProcessParams( args.renderScale );
+
+    const float filterColor[3] = { _params.fRedFilterColor, _params.fGreenFilterColor, _params.fBlueFilterColor };
+    const float factor[3] = { _params.fRedFactor, _params.fGreenFactor, _params.fBlueFactor };
+    _rgbReductionConstants = makeRGBReductionConstants( filterColor, factor, _params.bInvert );
+    _yuvReductionConstants = makeYUVReductionConstants( filterColor, factor );
+
+    // 8 and 16 bits channels go thru lookup tables
+    typedef typename boost::gil::base_channel_type<Channel>::type RawChannel;
+    if ( _params._algo == eParamAlgoRGBReduction && std::numeric_limits<RawChannel>::is_integer )
+    {
+        _rgbReductionTables = _plugin.getRGBReductionTables( _rgbReductionConstants, 8 * sizeof( RawChannel ) );
+    }
 }
 
 /**
@@ -36,84 +48,35 @@ void ColorNegInvertProcess<View>::setup( const OFX::RenderArguments& args )
 template<class View>
 void ColorNegInvertProcess<View>::multiThreadProcessImages( const OfxRectI& procWindowRoW )
 {
-    using namespace boost::gil;
-    ColorNegInvertProcessParams<ColorNegInvertPlugin::Scalar> params = _plugin.getProcessParams();
     OfxRectI procWindowOutput = this->translateRoWToOutputClipCoordinates( procWindowRoW );
     const OfxPointI procWindowSize = {
             procWindowRoW.x2 - procWindowRoW.x1,
             procWindowRoW.y2 - procWindowRoW.y1 };
 
-    const double redFactor = params.fRedFactor;
-    const double greenFactor = params.fGreenFactor;
-    const double blueFactor = params.fBlueFactor;
+    typedef typename boost::gil::base_channel_type<Channel>::type RawChannel;
+    BOOST_STATIC_ASSERT_MSG( !boost::gil::is_planar<View>::value, "ColorNegInvert row kernels work on interleaved views" );
     if ( _params._algo == eParamAlgoYUVReduction )
     {
-        using namespace terry::color::layout;
-        typedef pixel<bits32f, boost::gil::layout< terry::color::layout::yuv_t> > YUVWorkPixT;
-        YUVWorkPixT wpix;
-        rgb32f_pixel_t rgbRefFilterPix( params.fRedFilterColor, params.fGreenFilterColor, params.fBlueFilterColor );
-        YUVWorkPixT yuvRefFilterPix;
-        color_convert( rgbRefFilterPix, yuvRefFilterPix );
-        const double yRef = get_color( yuvRefFilterPix, y_t() );
-        const double uRef = get_color( yuvRefFilterPix, u_t() );
-        const double vRef = get_color( yuvRefFilterPix, v_t() );
-
         for( int y = procWindowOutput.y1; y < procWindowOutput.y2; ++y )
         {
             typename View::x_iterator src_it = this->_srcView.x_at( procWindowOutput.x1, y );
             typename View::x_iterator dst_it = this->_dstView.x_at( procWindowOutput.x1, y );
-            for( int x = procWindowOutput.x1; x < procWindowOutput.x2; ++x, ++src_it, ++dst_it )
-            {
-                color_convert( *src_it, wpix );
-                const double y = get_color( wpix, y_t() );
-                const double u = get_color( wpix, u_t() );
-                const double v = get_color( wpix, v_t() );
-                get_color( wpix, yuv::y_t() ) = std::min( 1.0, std::max( 0.0, y - ( yRef - y ) ) * redFactor );
-                get_color( wpix, yuv::u_t() ) = std::min( 0.436, std::max( -0.436, u - uRef ) * greenFactor );
-                get_color( wpix, yuv::v_t() ) = std::min( 0.615, std::max( -0.615, v - vRef ) * blueFactor );
-                color_convert( wpix, *dst_it );
-            }
+            yuvReductionRow( reinterpret_cast<const RawChannel*>( &( *src_it )[0] ),
+                             reinterpret_cast<RawChannel*>( &( *dst_it )[0] ),
+                             procWindowSize.x, boost::gil::num_channels<View>::value, _yuvReductionConstants );
             if( this->progressForward( procWindowSize.x ) )
                 return;
         }
     }
     else if ( _params._algo == eParamAlgoRGBReduction )
     {
-        rgb32f_pixel_t rgbRefFilterPix( params.fRedFilterColor, params.fGreenFilterColor, params.fBlueFilterColor );
-        rgb32f_pixel_t wpix;
-        // Red part in params.fRedFilterColor
-        const double subRedFactor = 1.0 + ( 1.0 / params.fRedFilterColor );
-        // Green part in params.fGreenFilterColor
-        const double subGreenFactor = 1.0 + ( 1.0 / params.fGreenFilterColor );
-        // Blue part in params.fBlueFilterColor
-        const double subBlueFactor = 1.0 + ( 1.0 / params.fBlueFilterColor );
-        const double vmin = channel_traits<bits32f>::min_value();
-        const double vmax = channel_traits<bits32f>::max_value();
         for( int y = procWindowOutput.y1; y < procWindowOutput.y2; ++y )
         {
             typename View::x_iterator src_it = this->_srcView.x_at( procWindowOutput.x1, y );
             typename View::x_iterator dst_it = this->_dstView.x_at( procWindowOutput.x1, y );
-            for( int x = procWindowOutput.x1; x < procWindowOutput.x2; ++x, ++src_it, ++dst_it )
-            {
-                color_convert( *src_it, wpix );
-                const double r = get_color( wpix, red_t() );
-                const double g = get_color( wpix, green_t() );
-                const double b = get_color( wpix, blue_t() );
-                if ( params.bInvert )
-                {
-                    get_color( wpix, red_t() )   = vmax - std::min( vmax, std::max( vmin, ( params.fRedFilterColor - r ) * subRedFactor ) * redFactor );
-                    get_color( wpix, green_t() ) = vmax - std::min( vmax, std::max( vmin, ( params.fGreenFilterColor - g ) * subGreenFactor ) * greenFactor );
-                    get_color( wpix, blue_t() )  = vmax - std::min( vmax, std::max( vmin, ( params.fBlueFilterColor - b ) * subBlueFactor ) * blueFactor );
-                    color_convert( wpix, *dst_it );
-                }
-                else
-                {
-                    get_color( wpix, red_t() )   = std::min( vmax, std::max( vmin, ( params.fRedFilterColor - r ) * subRedFactor ) * redFactor );
-                    get_color( wpix, green_t() ) = std::min( vmax, std::max( vmin, ( params.fGreenFilterColor - g ) * subGreenFactor ) * greenFactor );
-                    get_color( wpix, blue_t() )  = std::min( vmax, std::max( vmin, ( params.fBlueFilterColor - b ) * subBlueFactor ) * blueFactor );
-                }
-                color_convert( wpix, *dst_it );
-            }
+            rgbReductionRow( reinterpret_cast<const RawChannel*>( &( *src_it )[0] ),
+                             reinterpret_cast<RawChannel*>( &( *dst_it )[0] ),
+                             procWindowSize.x, boost::gil::num_channels<View>::value, _rgbReductionConstants, _rgbReductionTables.get() );
             if( this->progressForward( procWindowSize.x ) )
                 return;
         }
@@ -0,0 +1,510 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#include "SyntheticDng.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dcraw
+{
+namespace benchmark
+{
+
+namespace
+{
+
+typedef std::vector<boost::uint8_t> Bytes;
+
+enum ETiffType
+{
+    eTiffTypeByte = 1,
+    eTiffTypeAscii = 2,
+    eTiffTypeShort = 3,
+    eTiffTypeLong = 4,
+    eTiffTypeRational = 5,
+    eTiffTypeSRational = 10
+};
+
+/**
+ * @brief an IFD entry, its values packed in little endian
+ */
+struct TiffEntry
+{
+    boost::uint16_t tag;
+    boost::uint16_t type;
+    boost::uint32_t count;
+    Bytes data;
+};
+
+inline void put16le( Bytes & out, const boost::uint16_t v )
+{
+    out.push_back( v & 0xff );
+    out.push_back( v >> 8 );
+}
+
+inline void put32le( Bytes & out, const boost::uint32_t v )
+{
+    put16le( out, v & 0xffff );
+    put16le( out, v >> 16 );
+}
+
+inline void put16be( Bytes & out, const boost::uint16_t v )
+{
+    out.push_back( v >> 8 );
+    out.push_back( v & 0xff );
+}
+
+TiffEntry tiffEntry( const boost::uint16_t tag, const ETiffType type, const std::vector<boost::uint32_t> & values )
+{
+    TiffEntry entry = { tag, boost::uint16_t( type ), boost::uint32_t( values.size() ), Bytes() };
+    for( const boost::uint32_t value: values )
+    {
+        switch( type )
+        {
+            case eTiffTypeShort: put16le( entry.data, value ); break;
+            case eTiffTypeLong: put32le( entry.data, value ); break;
+            default: entry.data.push_back( value ); break;
+        }
+    }
+    return entry;
+}
+
+TiffEntry tiffAscii( const boost::uint16_t tag, const std::string & value )
+{
+    TiffEntry entry = { tag, eTiffTypeAscii, boost::uint32_t( value.size() + 1 ), Bytes( value.begin(), value.end() ) };
+    entry.data.push_back( 0 );
+    return entry;
+}
+
+TiffEntry tiffRational( const boost::uint16_t tag, const ETiffType type, const std::vector<std::pair<int, int> > & values )
+{
+    TiffEntry entry = { tag, boost::uint16_t( type ), boost::uint32_t( values.size() ), Bytes() };
+    for( const std::pair<int, int> & value: values )
+    {
+        put32le( entry.data, boost::uint32_t( value.first ) );
+        put32le( entry.data, boost::uint32_t( value.second ) );
+    }
+    return entry;
+}
+
+/**
+ * @brief sensor values: smooth gradients, dark patches and noise
+ */
+std::vector<boost::uint16_t> sensorValues( const SyntheticDng & dng )
+{
+    std::mt19937 random( dng.seed );
+    const int maxValue = ( 1 << dng.bits ) - 1;
+    std::uniform_int_distribution<int> noise( 0, maxValue / 40 );
+    std::vector<boost::uint16_t> values( std::size_t( dng.width ) * dng.height );
+    for( int y = 0; y < dng.height; ++y )
+    {
+        for( int x = 0; x < dng.width; ++x )
+        {
+            const int c = ( y & 1 ) * 2 + ( x & 1 );
+            double base = 0.5 + 0.4 * std::sin( x * 0.05 + y * 0.03 + c );
+            if( ( x / 37 + y / 23 ) % 5 == 0 )
+                base *= 0.3;
+            values[std::size_t( y ) * dng.width + x] = std::min( int( base * maxValue * 0.9 ) + noise( random ), maxValue );
+        }
+    }
+    return values;
+}
+
+/**
+ * @brief JPEG entropy coded data writer (0xff bytes are stuffed)
+ */
+class JpegBitWriter
+{
+public:
+    JpegBitWriter( Bytes & out )
+    : _out( out )
+    {}
+
+    void put( const boost::uint32_t value, const int nbBits )
+    {
+        _bits = ( _bits << nbBits ) | ( value & ( ( 1u << nbBits ) - 1 ) );
+        _nbBits += nbBits;
+        while( _nbBits >= 8 )
+        {
+            _nbBits -= 8;
+            const boost::uint8_t byte = ( _bits >> _nbBits ) & 0xff;
+            _out.push_back( byte );
+            if( byte == 0xff )
+                _out.push_back( 0 );
+        }
+    }
+
+    /**
+     * @brief pad the last byte with ones
+     */
+    void flush()
+    {
+        if( _nbBits )
+            put( ( 1u << ( 8 - _nbBits ) ) - 1, 8 - _nbBits );
+    }
+
+private:
+    Bytes & _out;
+    boost::uint64_t _bits = 0;
+    int _nbBits = 0;
+};
+
+/**
+ * @brief bits of the magnitude of a difference
+ */
+inline int category( int diff )
+{
+    diff = std::abs( diff );
+    int nbBits = 0;
+    for( ; diff; diff >>= 1 )
+        ++nbBits;
+    return nbBits;
+}
+
+/**
+ * @brief Huffman code lengths of the categories (index 17 is a dummy symbol, so that no code is all ones)
+ */
+std::vector<int> huffmanLengths( const std::vector<boost::uint64_t> & frequencies )
+{
+    typedef std::pair<boost::uint64_t, int> Node;   // weight, node index
+    std::vector<std::vector<int> > nodeSymbols;
+    std::priority_queue<Node, std::vector<Node>, std::greater<Node> > queue;
+    std::vector<int> lengths( 18, 0 );
+    for( int s = 0; s < 18; ++s )
+    {
+        if( s == 17 || frequencies[s] )
+        {
+            queue.push( Node( s < 17 ? frequencies[s] + 1 : 1, int( nodeSymbols.size() ) ) );
+            nodeSymbols.push_back( std::vector<int>( 1, s ) );
+        }
+    }
+    while( queue.size() > 1 )
+    {
+        const Node a = queue.top();
+        queue.pop();
+        const Node b = queue.top();
+        queue.pop();
+        std::vector<int> symbols = nodeSymbols[a.second];
+        symbols.insert( symbols.end(), nodeSymbols[b.second].begin(), nodeSymbols[b.second].end() );
+        for( const int s: symbols )
+            ++lengths[s];
+        queue.push( Node( a.first + b.first, int( nodeSymbols.size() ) ) );
+        nodeSymbols.push_back( symbols );
+    }
+    // JPEG codes are 16 bits long at most: 5 bits for every symbol is enough
+    if( *std::max_element( lengths.begin(), lengths.end() ) > 16 )
+    {
+        for( int & length: lengths )
+            length = length ? 5 : 0;
+    }
+    return lengths;
+}
+
+/**
+ * @brief encode a tile as a lossless JPEG
+ * Differences are computed with the predictions of dcraw's ljpeg_row:
+ * the first column of each row is predicted from the row above, the
+ * first row from its left neighbor, the predictor is used elsewhere.
+ */
+Bytes encodeTile( const std::vector<boost::uint16_t> & values, const SyntheticDng & dng, const int x0, const int y0 )
+{
+    const int tw = dng.tileWidth;
+    const int th = dng.tileHeight;
+    const int restart = dng.restartRows * tw;
+
+    // Pixels of the tile, edge tiles repeat the last row and column
+    std::vector<int> diffs;
+    diffs.reserve( std::size_t( tw ) * th );
+    std::vector<int> row( tw ), previous( tw );
+    int verticalPrediction = 0;
+    for( int jrow = 0; jrow < th; ++jrow )
+    {
+        if( jrow == 0 || ( restart && ( jrow * tw ) % restart == 0 ) )
+            verticalPrediction = 1 << ( dng.bits - 1 );
+        const int y = std::min( y0 + jrow, dng.height - 1 );
+        for( int col = 0; col < tw; ++col )
+            row[col] = values[std::size_t( y ) * dng.width + std::min( x0 + col, dng.width - 1 )];
+        for( int col = 0; col < tw; ++col )
+        {
+            int prediction;
+            if( col )
+            {
+                prediction = row[col - 1];
+            }
+            else
+            {
+                prediction = verticalPrediction;
+                verticalPrediction = row[0];
+            }
+            if( jrow && col )
+            {
+                const int a = row[col - 1], b = previous[col], c = previous[col - 1];
+                switch( dng.predictor )
+                {
+                    case 1: prediction = a; break;
+                    case 2: prediction = b; break;
+                    case 3: prediction = c; break;
+                    case 4: prediction = a + b - c; break;
+                    case 5: prediction = a + ( ( b - c ) >> 1 ); break;
+                    case 6: prediction = b + ( ( a - c ) >> 1 ); break;
+                    case 7: prediction = ( a + b ) >> 1; break;
+                }
+            }
+            diffs.push_back( row[col] - prediction );
+        }
+        std::swap( row, previous );
+    }
+
+    // Canonical Huffman codes of the categories
+    std::vector<boost::uint64_t> frequencies( 17, 0 );
+    for( const int diff: diffs )
+        ++frequencies[category( diff )];
+    const std::vector<int> lengths = huffmanLengths( frequencies );
+    std::vector<std::pair<int, int> > order;     // length, symbol
+    for( int s = 0; s < 18; ++s )
+    {
+        if( lengths[s] )
+            order.push_back( std::make_pair( lengths[s], s ) );
+    }
+    std::sort( order.begin(), order.end() );
+    std::vector<boost::uint32_t> codes( 18, 0 );
+    std::vector<boost::uint8_t> counts( 17, 0 ), symbols;
+    boost::uint32_t code = 0;
+    int lastLength = order.front().first;
+    for( const std::pair<int, int> & entry: order )
+    {
+        code <<= entry.first - lastLength;
+        lastLength = entry.first;
+        codes[entry.second] = code++;
+        ++counts[entry.first];
+        symbols.push_back( entry.second );
+    }
+
+    Bytes jpeg;
+    const auto segment = [&jpeg]( const boost::uint16_t marker, const Bytes & payload )
+    {
+        put16be( jpeg, marker );
+        put16be( jpeg, payload.size() + 2 );
+        jpeg.insert( jpeg.end(), payload.begin(), payload.end() );
+    };
+    put16be( jpeg, 0xffd8 );
+    {
+        Bytes frame;
+        frame.push_back( dng.bits );
+        put16be( frame, th );
+        put16be( frame, tw );
+        const boost::uint8_t component[] = { 1, 1, 0x11, 0 };
+        frame.insert( frame.end(), component, component + 4 );
+        segment( 0xffc3, frame );
+    }
+    {
+        Bytes table( 1, 0 );
+        table.insert( table.end(), counts.begin() + 1, counts.end() );
+        table.insert( table.end(), symbols.begin(), symbols.end() );
+        segment( 0xffc4, table );
+    }
+    if( restart )
+    {
+        Bytes interval;
+        put16be( interval, restart );
+        segment( 0xffdd, interval );
+    }
+    {
+        const boost::uint8_t scan[] = { 1, 1, 0, boost::uint8_t( dng.predictor ), 0, 0 };
+        segment( 0xffda, Bytes( scan, scan + 6 ) );
+    }
+
+    JpegBitWriter writer( jpeg );
+    int nbRestarts = 0;
+    for( std::size_t i = 0; i < diffs.size(); ++i )
+    {
+        if( restart && i && i % restart == 0 )
+        {
+            writer.flush();
+            jpeg.push_back( 0xff );
+            jpeg.push_back( 0xd0 + ( nbRestarts++ & 7 ) );
+        }
+        const int diff = diffs[i];
+        const int s = category( diff );
+        writer.put( codes[s], lengths[s] );
+        if( s )
+            writer.put( diff > 0 ? diff : diff + ( 1 << s ) - 1, s );
+    }
+    writer.flush();
+    put16be( jpeg, 0xffd9 );
+    return jpeg;
+}
+
+}
+
+/**
+ * @brief get a printable name of a color filter layout
+ */
+const char * cfaLayoutName( const ECfaLayout layout )
+{
+    switch( layout )
+    {
+        case eCfaLayoutRGGB: return "RGGB";
+        case eCfaLayoutGRBG: return "GRBG";
+        case eCfaLayoutGBRG: return "GBRG";
+        case eCfaLayoutBGGR: return "BGGR";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief write a synthetic DNG
+ * @return false if the file can't be written
+ */
+bool writeSyntheticDng( const boost::filesystem::path & path, const SyntheticDng & dng )
+{
+    static const boost::uint32_t cfaPatterns[][4] =
+    {
+        { 0, 1, 1, 2 },     // RGGB
+        { 1, 0, 2, 1 },     // GRBG
+        { 1, 2, 0, 1 },     // GBRG
+        { 2, 1, 1, 0 }      // BGGR
+    };
+
+    const std::vector<boost::uint16_t> values = sensorValues( dng );
+
+    // Image data: one uncompressed strip or lossless JPEG tiles
+    std::vector<Bytes> blocks;
+    if( dng.losslessJpeg )
+    {
+        for( int y = 0; y < dng.height; y += dng.tileHeight )
+            for( int x = 0; x < dng.width; x += dng.tileWidth )
+                blocks.push_back( encodeTile( values, dng, x, y ) );
+        // dcraw reads 4 tiles as a Sinar 4 shot image
+        if( blocks.size() == 4 )
+            return false;
+    }
+    else
+    {
+        blocks.push_back( Bytes() );
+        blocks.back().reserve( values.size() * 2 );
+        for( const boost::uint16_t value: values )
+            put16le( blocks.back(), value );
+    }
+    std::vector<boost::uint32_t> blockSizes;
+    for( const Bytes & block: blocks )
+        blockSizes.push_back( block.size() );
+
+    std::vector<TiffEntry> entries;
+    entries.push_back( tiffEntry( 254, eTiffTypeLong, { 0 } ) );
+    entries.push_back( tiffEntry( 256, eTiffTypeLong, { boost::uint32_t( dng.width ) } ) );
+    entries.push_back( tiffEntry( 257, eTiffTypeLong, { boost::uint32_t( dng.height ) } ) );
+    entries.push_back( tiffEntry( 258, eTiffTypeShort, { boost::uint32_t( dng.losslessJpeg ? dng.bits : 16 ) } ) );
+    entries.push_back( tiffEntry( 259, eTiffTypeShort, { boost::uint32_t( dng.losslessJpeg ? 7 : 1 ) } ) );
+    entries.push_back( tiffEntry( 262, eTiffTypeShort, { 32803 } ) );
+    entries.push_back( tiffAscii( 271, "Kaliscope" ) );
+    entries.push_back( tiffAscii( 272, "Synthetic" ) );
+    if( dng.orientation != 1 )
+        entries.push_back( tiffEntry( 274, eTiffTypeShort, { boost::uint32_t( dng.orientation ) } ) );
+    entries.push_back( tiffEntry( 277, eTiffTypeShort, { 1 } ) );
+    if( dng.losslessJpeg )
+    {
+        entries.push_back( tiffEntry( 322, eTiffTypeLong, { boost::uint32_t( dng.tileWidth ) } ) );
+        entries.push_back( tiffEntry( 323, eTiffTypeLong, { boost::uint32_t( dng.tileHeight ) } ) );
+        entries.push_back( tiffEntry( 324, eTiffTypeLong, std::vector<boost::uint32_t>( blocks.size(), 0 ) ) );
+        entries.push_back( tiffEntry( 325, eTiffTypeLong, blockSizes ) );
+    }
+    else
+    {
+        entries.push_back( tiffEntry( 273, eTiffTypeLong, { 0 } ) );
+        entries.push_back( tiffEntry( 278, eTiffTypeLong, { boost::uint32_t( dng.height ) } ) );
+        entries.push_back( tiffEntry( 279, eTiffTypeLong, blockSizes ) );
+        entries.push_back( tiffEntry( 284, eTiffTypeShort, { 1 } ) );
+    }
+    entries.push_back( tiffEntry( 33421, eTiffTypeShort, { 2, 2 } ) );
+    const boost::uint32_t *pattern = cfaPatterns[dng.cfa];
+    entries.push_back( tiffEntry( 33422, eTiffTypeByte, std::vector<boost::uint32_t>( pattern, pattern + 4 ) ) );
+    entries.push_back( tiffEntry( 50706, eTiffTypeByte, { 1, 4, 0, 0 } ) );
+    entries.push_back( tiffAscii( 50708, "Kaliscope Synthetic" ) );
+    entries.push_back( tiffEntry( 50714, eTiffTypeLong, { 64 } ) );
+    entries.push_back( tiffEntry( 50717, eTiffTypeLong, { boost::uint32_t( ( 1 << dng.bits ) - 1 ) } ) );
+    entries.push_back( tiffRational( 50721, eTiffTypeSRational, { { 8000, 10000 }, { -2000, 10000 }, { -1000, 10000 },
+                                                                  { -3000, 10000 }, { 11000, 10000 }, { 2000, 10000 },
+                                                                  { -500, 10000 }, { 1500, 10000 }, { 6000, 10000 } } ) );
+    entries.push_back( tiffRational( 50728, eTiffTypeRational, { { 5, 10 }, { 1, 1 }, { 7, 10 } } ) );
+    entries.push_back( tiffEntry( 50778, eTiffTypeShort, { 21 } ) );
+    std::sort( entries.begin(), entries.end(), []( const TiffEntry & a, const TiffEntry & b ) { return a.tag < b.tag; } );
+
+    // Layout: header, IFD, values longer than 4 bytes, image data
+    const boost::uint32_t ifdOffset = 8;
+    boost::uint32_t offset = ifdOffset + 2 + 12 * entries.size() + 4;
+    std::vector<boost::uint32_t> valueOffsets;
+    for( const TiffEntry & entry: entries )
+    {
+        valueOffsets.push_back( offset );
+        if( entry.data.size() > 4 )
+            offset += ( entry.data.size() + 1 ) & ~1;
+    }
+    std::vector<boost::uint32_t> blockOffsets;
+    for( const Bytes & block: blocks )
+    {
+        blockOffsets.push_back( offset );
+        offset += block.size();
+    }
+    for( TiffEntry & entry: entries )
+    {
+        if( entry.tag == 273 || entry.tag == 324 )
+            entry.data = tiffEntry( entry.tag, eTiffTypeLong, blockOffsets ).data;
+    }
+
+    Bytes file;
+    file.push_back( 'I' );
+    file.push_back( 'I' );
+    put16le( file, 42 );
+    put32le( file, ifdOffset );
+    put16le( file, entries.size() );
+    for( std::size_t i = 0; i < entries.size(); ++i )
+    {
+        const TiffEntry & entry = entries[i];
+        put16le( file, entry.tag );
+        put16le( file, entry.type );
+        put32le( file, entry.count );
+        if( entry.data.size() > 4 )
+        {
+            put32le( file, valueOffsets[i] );
+        }
+        else
+        {
+            Bytes inlined( entry.data );
+            inlined.resize( 4, 0 );
+            file.insert( file.end(), inlined.begin(), inlined.end() );
+        }
+    }
+    put32le( file, 0 );
+    for( const TiffEntry & entry: entries )
+    {
+        if( entry.data.size() > 4 )
+        {
+            file.insert( file.end(), entry.data.begin(), entry.data.end() );
+            if( entry.data.size() & 1 )
+                file.push_back( 0 );
+        }
+    }
+
+    boost::filesystem::ofstream out( path, std::ios::binary );
+    out.write( reinterpret_cast<const char*>( file.data() ), file.size() );
+    for( const Bytes & block: blocks )
+        out.write( reinterpret_cast<const char*>( block.data() ), block.size() );
+    return out.good();
+}
+
+}
+}
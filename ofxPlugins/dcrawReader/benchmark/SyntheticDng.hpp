@@ -0,0 +1,66 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+#ifndef _DCRAW_BENCHMARK_SYNTHETICDNG_HPP_
+#define	_DCRAW_BENCHMARK_SYNTHETICDNG_HPP_
+
+#include <boost/filesystem/path.hpp>
+
+namespace dcraw
+{
+namespace benchmark
+{
+
+/**
+ * @brief color filter layouts of the synthetic sensors
+ */
+enum ECfaLayout
+{
+    eCfaLayoutRGGB = 0,
+    eCfaLayoutGRBG,
+    eCfaLayoutGBRG,
+    eCfaLayoutBGGR
+};
+
+/**
+ * @brief get a printable name of a color filter layout
+ */
+const char * cfaLayoutName( const ECfaLayout layout );
+
+/**
+ * @brief synthetic DNG description
+ * The same seed gives the same sensor values whatever the compression,
+ * so a lossless JPEG file decodes to the same image as its uncompressed twin.
+ */
+struct SyntheticDng
+{
+    SyntheticDng( const int w = 600, const int h = 400 )
+    : width( w )
+    , height( h )
+    {}
+
+    int width;
+    int height;
+    int bits = 12;                          ///< Sensor bit depth
+    ECfaLayout cfa = eCfaLayoutRGGB;        ///< Color filter layout
+    int orientation = 1;                    ///< TIFF orientation (1, 3, 6 or 8)
+    bool losslessJpeg = false;              ///< Lossless JPEG tiles, uncompressed 16 bits strip otherwise
+    int tileWidth = 256;                    ///< Lossless JPEG tile size
+    int tileHeight = 256;
+    int predictor = 1;                      ///< Lossless JPEG predictor (1..7)
+    int restartRows = 0;                    ///< Tile rows between restart markers, 0 for none
+    unsigned int seed = 1;                  ///< Sensor noise seed
+};
+
+/**
+ * @brief write a synthetic DNG
+ * @return false if the file can't be written
+ */
+bool writeSyntheticDng( const boost::filesystem::path & path, const SyntheticDng & dng );
+
+}
+}
+
+#endif
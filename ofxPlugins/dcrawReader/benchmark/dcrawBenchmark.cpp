@@ -0,0 +1,513 @@
+/* Copyright (C) 2015 Eloi DU BOIS - All Rights Reserved
+ * The license for this file is available here:
+ * https://github.com/edubois/kaliscope/blob/master/LICENSE
+ */
+
+/**
+ * Benchmark and regression checks of the dcraw decoder on synthetic DNGs.
+ *
+ * The benchmark decodes 3:2 sensors of the given sizes (12, 24 and 45
+ * megapixels by default), uncompressed and lossless JPEG, with each
+ * interpolation quality and at half size. It reports the time of each
+ * decoding stage and a hash of the 16 bits output. The hashes can be
+ * saved and checked against a later build (--saveHashes, --checkHashes):
+ * optimizations must not change a single pixel. dcrawBenchmarkReference
+ * is built on the previous lossless JPEG decoder (NO_LJPEG_TABLES), its
+ * saved hashes give both decoders' load_raw times on the same files.
+ *
+ * The checks (--check) decode small images and compare decodes that must
+ * give the same pixels: threaded and serial interpolations, concurrent
+ * and reused decoders, lossless JPEG files and their uncompressed twins,
+ * the 8 bits, 16 bits and float outputs, the flips, the half size and
+ * the crop dimensions.
+ */
+
+#include "SyntheticDng.hpp"
+
+#include <dcraw.hpp>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bpo = boost::program_options;
+namespace bfs = boost::filesystem;
+
+namespace
+{
+
+using namespace dcraw::benchmark;
+
+typedef std::chrono::steady_clock Clock;
+
+/// Interpolation qualities, then the half size decode
+static const int kHalfSizeMode = 4;
+static const char * kModeNames[] = { "linear", "vng", "ppg", "ahd", "half" };
+
+/**
+ * @brief decoded image, 16 bits RGB
+ */
+struct Decoded
+{
+    bool valid = false;
+    int width = 0;
+    int height = 0;
+    boost::uint64_t hash = 0;                   ///< FNV-1a of the pixels
+    dcraw::DecodeTimings timings = dcraw::DecodeTimings();
+    double output = 0;                          ///< Output conversion (microseconds)
+};
+
+inline double elapsed( const Clock::time_point start )
+{
+    return std::chrono::duration<double, std::micro>( Clock::now() - start ).count();
+}
+
+template<typename T>
+boost::uint64_t hashRow( boost::uint64_t hash, const std::vector<T> & row )
+{
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>( row.data() );
+    for( std::size_t i = 0; i < row.size() * sizeof( T ); ++i )
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief decode a file
+ * @param mode interpolation quality, or kHalfSizeMode
+ * @param nbThreads interpolation threads, 0 for one per core
+ */
+Decoded decodeFile( dcraw::Decoder & decoder, const bfs::path & file, const int mode, const int nbThreads, const int crop[4] = NULL )
+{
+    Decoded decoded;
+    decoder.setNumberOfThreads( nbThreads );
+    decoder.setHalfSize( mode == kHalfSizeMode );
+    if( crop )
+        decoder.setCrop( crop[0], crop[1], crop[2], crop[3] );
+    else
+        decoder.setCrop( 0, 0, 0, 0 );
+    if( !decoder.openRaw( file ) || !decoder.decode( mode == kHalfSizeMode ? 0 : mode ) )
+    {
+        decoder.cleanup();
+        return decoded;
+    }
+    decoder.readDimensions( decoded.width, decoded.height );
+
+    const Clock::time_point start = Clock::now();
+    std::vector<boost::uint16_t> row( decoded.width * 3 );
+    decoded.hash = 14695981039346656037ull;
+    for( int y = 0; y < decoded.height; ++y )
+    {
+        decoder.readRow( y, row.data(), 3 );
+        decoded.hash = hashRow( decoded.hash, row );
+    }
+    decoded.output = elapsed( start );
+    decoded.timings = decoder.timings();
+    decoded.valid = true;
+    decoder.cleanup();
+    return decoded;
+}
+
+Decoded decodeFile( const bfs::path & file, const int mode, const int nbThreads, const int crop[4] = NULL )
+{
+    dcraw::Decoder decoder;
+    return decodeFile( decoder, file, mode, nbThreads, crop );
+}
+
+/**
+ * @brief generate a synthetic DNG once
+ */
+bfs::path syntheticFile( const bfs::path & directory, const SyntheticDng & dng )
+{
+    const std::string name = ( boost::format( "synthetic_%dx%d_%s_%dbits_o%d_%s.dng" )
+        % dng.width % dng.height % cfaLayoutName( dng.cfa ) % dng.bits % dng.orientation
+        % ( dng.losslessJpeg ? ( boost::format( "ljpeg%dx%d_p%d_r%d" ) % dng.tileWidth % dng.tileHeight % dng.predictor % dng.restartRows ).str() : std::string( "raw" ) ) ).str();
+    const bfs::path file = directory / name;
+    if( !bfs::exists( file ) )
+    {
+        const Clock::time_point start = Clock::now();
+        if( !writeSyntheticDng( file, dng ) )
+        {
+            throw std::runtime_error( "Unable to write " + file.string() );
+        }
+        std::cout << boost::format( "Generated %s (%.1fs)" ) % name % ( elapsed( start ) / 1e6 ) << std::endl;
+    }
+    return file;
+}
+
+/**
+ * @brief results of the regression checks
+ */
+class Checks
+{
+public:
+    /**
+     * @brief check a condition
+     */
+    void expect( const bool condition, const std::string & what )
+    {
+        ++_nbChecks;
+        if( !condition )
+        {
+            ++_nbFailures;
+            std::cout << "  FAILED: " << what << std::endl;
+        }
+    }
+
+    /**
+     * @brief print the result of a group of checks
+     */
+    void report( const std::string & group )
+    {
+        std::cout << boost::format( "%-24s %s (%d checks)" ) % group % ( _nbFailures == _reportedFailures ? "ok" : "FAILED" ) % ( _nbChecks - _reportedChecks ) << std::endl;
+        _reportedChecks = _nbChecks;
+        _reportedFailures = _nbFailures;
+    }
+
+    inline bool success() const
+    { return _nbFailures == 0; }
+
+private:
+    std::size_t _nbChecks = 0;
+    std::size_t _nbFailures = 0;
+    std::size_t _reportedChecks = 0;
+    std::size_t _reportedFailures = 0;
+};
+
+/**
+ * @brief the interpolations give the same pixels whatever the number of threads
+ */
+void checkThreads( const bfs::path & directory, Checks & checks )
+{
+    const int sizes[][2] = { { 517, 61 }, { 601, 403 } };
+    const ECfaLayout layouts[] = { eCfaLayoutRGGB, eCfaLayoutGRBG, eCfaLayoutBGGR };
+    for( const auto & size: sizes )
+    {
+        for( const ECfaLayout layout: layouts )
+        {
+            SyntheticDng dng( size[0], size[1] );
+            dng.cfa = layout;
+            const bfs::path file = syntheticFile( directory, dng );
+            for( int quality = 0; quality < 4; ++quality )
+            {
+                const Decoded serial = decodeFile( file, quality, 1 );
+                checks.expect( serial.valid, file.filename().string() + " can't be decoded" );
+                for( const int nbThreads: { 2, 3, 7, 16 } )
+                {
+                    const Decoded threaded = decodeFile( file, quality, nbThreads );
+                    checks.expect( threaded.hash == serial.hash,
+                        ( boost::format( "%s %s: %d threads differ from serial" ) % file.filename().string() % kModeNames[quality] % nbThreads ).str() );
+                }
+            }
+        }
+    }
+    checks.report( "threads" );
+}
+
+/**
+ * @brief concurrent decoders don't share state, a reused decoder gives the pixels of a new one
+ */
+void checkDecoders( const bfs::path & directory, Checks & checks )
+{
+    const bfs::path big = syntheticFile( directory, SyntheticDng( 1024, 683 ) );
+    const bfs::path small = syntheticFile( directory, SyntheticDng( 517, 61 ) );
+    for( int quality = 0; quality < 4; ++quality )
+    {
+        const Decoded reference = decodeFile( big, quality, 1 );
+        std::vector<Decoded> results( 8 );
+        std::vector<std::thread> threads;
+        for( Decoded & result: results )
+            threads.push_back( std::thread( [&result, &big, quality]() { result = decodeFile( big, quality, 1 ); } ) );
+        for( std::thread & thread: threads )
+            thread.join();
+        for( const Decoded & result: results )
+            checks.expect( result.hash == reference.hash, std::string( "concurrent decoder differs, " ) + kModeNames[quality] );
+    }
+    checks.report( "concurrent decoders" );
+
+    dcraw::Decoder decoder;
+    const Decoded bigReference = decodeFile( big, 3, 0 );
+    const Decoded smallReference = decodeFile( small, 3, 0 );
+    checks.expect( decodeFile( decoder, big, 3, 0 ).hash == bigReference.hash, "first decode of a reused decoder differs" );
+    checks.expect( decodeFile( decoder, small, 3, 0 ).hash == smallReference.hash, "reused decoder differs on a smaller file" );
+    checks.expect( decodeFile( decoder, big, 3, 0 ).hash == bigReference.hash, "reused decoder differs on a bigger file" );
+    checks.expect( decodeFile( decoder, big, kHalfSizeMode, 0 ).hash == decodeFile( big, kHalfSizeMode, 0 ).hash, "reused decoder differs at half size" );
+    checks.report( "decoder reuse" );
+}
+
+/**
+ * @brief lossless JPEG files decode to the pixels of their uncompressed twin
+ */
+void checkLosslessJpeg( const bfs::path & directory, Checks & checks )
+{
+    for( const int bits: { 12, 14 } )
+    {
+        SyntheticDng raw( 600, 401 );
+        raw.bits = bits;
+        const Decoded reference = decodeFile( syntheticFile( directory, raw ), 0, 0 );
+        for( const int predictor: { 1, 6, 7 } )
+        {
+            for( const int restartRows: { 0, 2 } )
+            {
+                SyntheticDng ljpeg = raw;
+                ljpeg.losslessJpeg = true;
+                ljpeg.tileWidth = 256;
+                ljpeg.tileHeight = 128;
+                ljpeg.predictor = predictor;
+                ljpeg.restartRows = restartRows;
+                const bfs::path file = syntheticFile( directory, ljpeg );
+                checks.expect( decodeFile( file, 0, 0 ).hash == reference.hash, file.filename().string() + " differs from the uncompressed file" );
+            }
+        }
+    }
+    checks.report( "lossless jpeg" );
+}
+
+/**
+ * @brief the 8 bits, float and getRawData outputs match the 16 bits output
+ */
+void checkOutputs( const bfs::path & directory, Checks & checks )
+{
+    const bfs::path file = syntheticFile( directory, SyntheticDng( 601, 403 ) );
+    dcraw::Decoder decoder;
+    decoder.setNumberOfThreads( 0 );
+    if( !decoder.openRaw( file ) || !decoder.decode( 3 ) )
+    {
+        checks.expect( false, file.filename().string() + " can't be decoded" );
+        return;
+    }
+    int width = 0, height = 0;
+    decoder.readDimensions( width, height );
+    std::vector<boost::uint16_t> row16( width * 3 );
+    std::vector<boost::uint8_t> row8( width * 3 );
+    std::vector<float> rowFloat( width * 3 );
+    bool same8 = true, sameFloat = true;
+    for( int y = 0; y < height; ++y )
+    {
+        decoder.readRow( y, row16.data(), 3 );
+        decoder.readRow( y, row8.data(), 3 );
+        decoder.readRow( y, rowFloat.data(), 3 );
+        for( int i = 0; i < width * 3; ++i )
+        {
+            same8 = same8 && row8[i] == row16[i] >> 8;
+            sameFloat = sameFloat && rowFloat[i] == row16[i] / 65535.0f;
+        }
+    }
+    checks.expect( same8, "8 bits output is not the 16 bits output" );
+    checks.expect( sameFloat, "float output is not the 16 bits output" );
+    decoder.cleanup();
+
+    // getRawData decodes again, with its own decode call
+    const Decoded reference = decodeFile( file, 3, 0 );
+    dcraw::Decoder rawDataDecoder;
+    rawDataDecoder.setNumberOfThreads( 0 );
+    rawDataDecoder.openRaw( file );
+    const boost::shared_array<ushort> rawData = rawDataDecoder.getRawData( 3 );
+    rawDataDecoder.readDimensions( width, height );
+    boost::uint64_t hash = 14695981039346656037ull;
+    for( int y = 0; y < height && rawData; ++y )
+        hash = hashRow( hash, std::vector<boost::uint16_t>( &rawData[y * width * 3], &rawData[( y + 1 ) * width * 3] ) );
+    checks.expect( rawData && hash == reference.hash, "getRawData differs from the row output" );
+    rawDataDecoder.cleanup();
+    checks.report( "outputs" );
+}
+
+/**
+ * @brief header, half size and crop dimensions of flipped images, flipped pixels
+ */
+void checkGeometry( const bfs::path & directory, Checks & checks )
+{
+    SyntheticDng dng( 601, 403 );
+    const Decoded upright = decodeFile( syntheticFile( directory, dng ), 0, 0 );
+    for( const int orientation: { 1, 3, 6, 8 } )
+    {
+        dng.orientation = orientation;
+        const bfs::path file = syntheticFile( directory, dng );
+        const std::string name = file.filename().string();
+        dcraw::Header header;
+        checks.expect( dcraw::readHeader( file, header ), name + " header can't be read" );
+        const bool swapped = orientation >= 5;
+        const int width = swapped ? dng.height : dng.width;
+        const int height = swapped ? dng.width : dng.height;
+
+        const Decoded full = decodeFile( file, 0, 0 );
+        checks.expect( header.width == width && header.height == height && header.croppable, name + " wrong header" );
+        checks.expect( full.width == width && full.height == height, name + " wrong decoded size" );
+
+        const Decoded half = decodeFile( file, kHalfSizeMode, 0 );
+        checks.expect( half.width == ( width + 1 ) / 2 && half.height == ( height + 1 ) / 2, name + " wrong half size" );
+
+        // The crop rectangle is in output pixels, after the flip, it is clamped to the image
+        const int crop[4] = { 100, 50, width, 120 };
+        const Decoded cropped = decodeFile( file, 0, 0, crop );
+        checks.expect( cropped.width == width - 100 && cropped.height == 120, name + " wrong crop size" );
+    }
+
+    // A half turn reads the upright pixels backwards
+    dng.orientation = 3;
+    dcraw::Decoder decoder;
+    std::vector<boost::uint16_t> turned( dng.width * 3 ), straight( dng.width * 3 );
+    bool same = decoder.openRaw( syntheticFile( directory, dng ) ) && decoder.decode( 0 );
+    dcraw::Decoder uprightDecoder;
+    dng.orientation = 1;
+    same = same && uprightDecoder.openRaw( syntheticFile( directory, dng ) ) && uprightDecoder.decode( 0 );
+    for( int y = 0; y < dng.height && same; ++y )
+    {
+        decoder.readRow( y, turned.data(), 3 );
+        uprightDecoder.readRow( dng.height - 1 - y, straight.data(), 3 );
+        for( int x = 0; x < dng.width && same; ++x )
+            for( int c = 0; c < 3; ++c )
+                same = same && turned[x * 3 + c] == straight[( dng.width - 1 - x ) * 3 + c];
+    }
+    checks.expect( same && upright.valid, "half turned image is not the upright one backwards" );
+    checks.report( "geometry" );
+}
+
+/**
+ * @brief time the decoding stages of the benchmark images
+ * @param[in,out] hashes output hashes, by image and mode
+ */
+void benchmark( const bfs::path & directory, const std::vector<double> & sizes, const int nbRounds, const int nbThreads,
+                std::map<std::string, boost::uint64_t> & hashes )
+{
+    std::cout << boost::format( "%-58s %-6s %9s %9s %9s %9s %9s %9s %9s  %s" )
+        % "image" % "mode" % "identify" % "load_raw" % "scale" % "interp" % "convert" % "output" % "total" % "hash" << std::endl;
+    for( const double megapixels: sizes )
+    {
+        // 3:2 sensors, even sizes
+        const int height = int( std::sqrt( megapixels * 1e6 / 1.5 ) ) & ~1;
+        const int width = int( height * 1.5 ) & ~1;
+        for( const bool losslessJpeg: { false, true } )
+        {
+            SyntheticDng dng( width, height );
+            dng.losslessJpeg = losslessJpeg;
+            const bfs::path file = syntheticFile( directory, dng );
+            for( int mode = 0; mode <= kHalfSizeMode; ++mode )
+            {
+                // Best time of each stage
+                Decoded best;
+                for( int round = 0; round < nbRounds; ++round )
+                {
+                    const Decoded decoded = decodeFile( file, mode, nbThreads );
+                    if( !decoded.valid )
+                    {
+                        throw std::runtime_error( "Unable to decode " + file.string() );
+                    }
+                    if( !best.valid )
+                    {
+                        best = decoded;
+                        continue;
+                    }
+                    best.timings.identify = std::min( best.timings.identify, decoded.timings.identify );
+                    best.timings.loadRaw = std::min( best.timings.loadRaw, decoded.timings.loadRaw );
+                    best.timings.scale = std::min( best.timings.scale, decoded.timings.scale );
+                    best.timings.interpolate = std::min( best.timings.interpolate, decoded.timings.interpolate );
+                    best.timings.convert = std::min( best.timings.convert, decoded.timings.convert );
+                    best.output = std::min( best.output, decoded.output );
+                }
+                const dcraw::DecodeTimings & t = best.timings;
+                const double total = t.identify + t.loadRaw + t.scale + t.interpolate + t.convert + best.output;
+                std::cout << boost::format( "%-58s %-6s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f  %016x" )
+                    % file.filename().string() % kModeNames[mode]
+                    % ( t.identify / 1e3 ) % ( t.loadRaw / 1e3 ) % ( t.scale / 1e3 ) % ( t.interpolate / 1e3 )
+                    % ( t.convert / 1e3 ) % ( best.output / 1e3 ) % ( total / 1e3 ) % best.hash << std::endl;
+                hashes[file.filename().string() + " " + kModeNames[mode]] = best.hash;
+            }
+        }
+    }
+    std::cout << "Times in milliseconds, best of " << nbRounds << " decodes." << std::endl;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    bpo::options_description options( "Allowed options" );
+    options.add_options()
+        ( "help", "Print this help" )
+        ( "dir", bpo::value<std::string>()->default_value( ( bfs::temp_directory_path() / "dcrawBenchmark" ).string() ), "Directory of the generated DNGs (kept for the next runs)" )
+        ( "sizes", bpo::value<std::vector<double> >()->multitoken(), "Benchmark image sizes in megapixels (default: 12 24 45)" )
+        ( "rounds", bpo::value<int>()->default_value( 3 ), "Decodes of each image and mode, the best times are reported" )
+        ( "threads", bpo::value<int>()->default_value( 0 ), "Interpolation threads, 0 for one per core" )
+        ( "check", "Run the regression checks instead of the benchmark" )
+        ( "saveHashes", bpo::value<std::string>(), "Save the output hashes of the benchmark images in a file" )
+        ( "checkHashes", bpo::value<std::string>(), "Compare the output hashes of the benchmark images with a saved file" );
+    bpo::variables_map vm;
+    bpo::store( bpo::parse_command_line( argc, argv, options ), vm );
+    bpo::notify( vm );
+    if( vm.count( "help" ) )
+    {
+        std::cout << options << std::endl;
+        return 0;
+    }
+
+    try
+    {
+        const bfs::path directory = vm["dir"].as<std::string>();
+        bfs::create_directories( directory );
+
+        if( vm.count( "check" ) )
+        {
+            Checks checks;
+            checkThreads( directory, checks );
+            checkDecoders( directory, checks );
+            checkLosslessJpeg( directory, checks );
+            checkOutputs( directory, checks );
+            checkGeometry( directory, checks );
+            return checks.success() ? 0 : 1;
+        }
+
+        std::vector<double> sizes = { 12, 24, 45 };
+        if( vm.count( "sizes" ) )
+            sizes = vm["sizes"].as<std::vector<double> >();
+        std::map<std::string, boost::uint64_t> hashes;
+        benchmark( directory, sizes, std::max( vm["rounds"].as<int>(), 1 ), vm["threads"].as<int>(), hashes );
+
+        if( vm.count( "saveHashes" ) )
+        {
+            bfs::ofstream out( vm["saveHashes"].as<std::string>() );
+            for( const auto & hash: hashes )
+                out << hash.first << " " << hash.second << std::endl;
+        }
+        if( vm.count( "checkHashes" ) )
+        {
+            bfs::ifstream in( vm["checkHashes"].as<std::string>() );
+            std::string image, mode;
+            boost::uint64_t hash;
+            std::size_t nbCompared = 0, nbDifferent = 0;
+            while( in >> image >> mode >> hash )
+            {
+                const std::map<std::string, boost::uint64_t>::const_iterator it = hashes.find( image + " " + mode );
+                if( it == hashes.end() )
+                    continue;
+                ++nbCompared;
+                if( it->second != hash )
+                {
+                    ++nbDifferent;
+                    std::cout << "Output changed: " << image << " " << mode << std::endl;
+                }
+            }
+            std::cout << nbCompared << " hashes compared, " << nbDifferent << " different." << std::endl;
+            return nbCompared && !nbDifferent ? 0 : 1;
+        }
+    }
+    catch( const std::exception & e )
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 2;
+    }
+    return 0;
+}
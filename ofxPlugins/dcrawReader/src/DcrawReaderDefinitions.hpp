@@ -13,11 +13,28 @@ namespace tuttle {
 namespace plugin {
 namespace dcrawReader {
 
+enum EParamPreview
+{
+    eParamPreviewAuto,
+    eParamPreviewFullSize,
+    eParamPreviewHalfSize
+};
+
 static const std::string kParamInterpolationQuality( "Interpolation quality" );
 static const std::string kParamInterpolationQualityLinear( "0 (Linear interpolation)" );
 static const std::string kParamInterpolationQualityVNG( "1 (Interpolation using a Threshold-based variable number of gradients)" );
 static const std::string kParamInterpolationQualityPPG( "2 (Patterned Pixel Grouping Interpolation by Alain Desbiolles)" );
 static const std::string kParamAlgorithmYUVReductionAHD( "3 (Adaptive Homogeneity-Directed interpolation)" );
+static const std::string kParamLinearOutput( "Linear output" );
+static const std::string kParamPreview( "Preview" );
+static const std::string kParamPreviewAuto( "Auto (half size at render scales up to 0.5)" );
+static const std::string kParamPreviewFullSize( "Full size" );
+static const std::string kParamPreviewHalfSize( "Half size (2x2 blocks, no interpolation)" );
+static const std::string kParamCrop( "Crop" );
+static const std::string kParamCropLeft( "Crop left" );
+static const std::string kParamCropTop( "Crop top" );
+static const std::string kParamCropWidth( "Crop width" );
+static const std::string kParamCropHeight( "Crop height" );
 
 }
 }
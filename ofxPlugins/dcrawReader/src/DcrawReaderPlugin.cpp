@@ -9,39 +9,175 @@
 
 
 #include <boost/gil/gil_all.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <algorithm>
 
 namespace tuttle {
 namespace plugin {
 namespace dcrawReader {
 
+/// Idle decoders kept for the next frames (each one holds the buffers of a full frame)
+static const std::size_t kMaxIdleDecoders = 2;
 
 DcrawReaderPlugin::DcrawReaderPlugin( OfxImageEffectHandle handle )
 : ReaderPlugin( handle )
+, _decodersInUse( 0 )
+, _nbDecodes( 0 )
+, _nbRepeatedDecodes( 0 )
 {
+    _lastDecodedWindow.x1 = _lastDecodedWindow.y1 = _lastDecodedWindow.x2 = _lastDecodedWindow.y2 = 0;
+    _lastDecodedScale.x = _lastDecodedScale.y = 0;
     _paramInterpQuality = fetchChoiceParam( kParamInterpolationQuality );
+    _paramLinearOutput = fetchBooleanParam( kParamLinearOutput );
+    _paramPreview = fetchChoiceParam( kParamPreview );
+    _paramCrop = fetchBooleanParam( kParamCrop );
+    _paramCropLeft = fetchIntParam( kParamCropLeft );
+    _paramCropTop = fetchIntParam( kParamCropTop );
+    _paramCropWidth = fetchIntParam( kParamCropWidth );
+    _paramCropHeight = fetchIntParam( kParamCropHeight );
 }
 
-DcrawReaderProcessParams DcrawReaderPlugin::getProcessParams( const OfxTime time ) const
+DcrawReaderProcessParams DcrawReaderPlugin::getProcessParams( const OfxTime time, const OfxPointD& renderScale ) const
 {
     DcrawReaderProcessParams params;
     params._filepath = getAbsoluteFilenameAt( time );
         params._interpolationQuality  = _paramInterpQuality->getValue();
+        params._linearOutput  = _paramLinearOutput->getValue();
+    switch( static_cast<EParamPreview>( _paramPreview->getValue() ) )
+    {
+        case eParamPreviewAuto:
+            // A half size image has enough pixels for the render
+            params._halfSize = renderScale.x <= 0.5 && renderScale.y <= 0.5;
+            break;
+        case eParamPreviewFullSize:
+            params._halfSize = false;
+            break;
+        case eParamPreviewHalfSize:
+            params._halfSize = true;
+            break;
+    }
+    params._crop = _paramCrop->getValue();
+    params._cropLeft = _paramCropLeft->getValue();
+    params._cropTop = _paramCropTop->getValue();
+    params._cropWidth = _paramCropWidth->getValue();
+    params._cropHeight = _paramCropHeight->getValue();
     return params;
 }
 
 void DcrawReaderPlugin::changedParam( const OFX::InstanceChangedArgs &args, const std::string &paramName )
 {
     ReaderPlugin::changedParam( args, paramName );
+    if( paramName == kTuttlePluginFilename )
+    {
+        // New roll, the previous headers and buffers won't be used anymore
+        {
+            OFX::MultiThread::AutoMutex lock( _headersMutex );
+            _headers.clear();
+        }
+        clearDecoders();
+    }
+    if( ( paramName == kTuttlePluginFilename || paramName == kParamCrop ) && _paramCrop->getValue() )
+    {
+        dcraw::Header header;
+        if( getRawHeader( getAbsoluteFilenameAt( args.time ), header ) && !header.croppable )
+        {
+            sendMessage( OFX::Message::eMessageMessage, kParamCrop, "The crop is not supported on this image (rotated or stretched sensor image), the whole image is read." );
+        }
+    }
+}
+
+bool DcrawReaderPlugin::getRawHeader( const std::string& filename, dcraw::Header& header )
+{
+    boost::system::error_code error;
+    const boost::uintmax_t size = boost::filesystem::file_size( filename, error );
+    if( error )
+        return false;
+    const std::time_t lastWriteTime = boost::filesystem::last_write_time( filename, error );
+    if( error )
+        return false;
+
+    {
+        OFX::MultiThread::AutoMutex lock( _headersMutex );
+        std::map<std::string, CachedHeader>::const_iterator it = _headers.find( filename );
+        if( it != _headers.end() && it->second._size == size && it->second._lastWriteTime == lastWriteTime )
+        {
+            header = it->second._header;
+            return true;
+        }
+    }
+
+    // Parse the file without blocking the other requests
+    if( !dcraw::readHeader( filename, header ) )
+        return false;
+
+    CachedHeader cached;
+    cached._size = size;
+    cached._lastWriteTime = lastWriteTime;
+    cached._header = header;
+    OFX::MultiThread::AutoMutex lock( _headersMutex );
+    _headers[filename] = cached;
+    return true;
+}
+
+boost::shared_ptr<dcraw::Decoder> DcrawReaderPlugin::acquireDecoder()
+{
+    OFX::MultiThread::AutoMutex lock( _decodersMutex );
+    ++_decodersInUse;
+    if( _decoders.empty() )
+        return boost::shared_ptr<dcraw::Decoder>( new dcraw::Decoder() );
+    boost::shared_ptr<dcraw::Decoder> decoder = _decoders.back();
+    _decoders.pop_back();
+    return decoder;
+}
+
+void DcrawReaderPlugin::releaseDecoder( const boost::shared_ptr<dcraw::Decoder>& decoder )
+{
+    OFX::MultiThread::AutoMutex lock( _decodersMutex );
+    --_decodersInUse;
+    if( _decoders.size() < kMaxIdleDecoders )
+        _decoders.push_back( decoder );
+}
+
+void DcrawReaderPlugin::clearDecoders()
+{
+    OFX::MultiThread::AutoMutex lock( _decodersMutex );
+    _decoders.clear();
+}
+
+int DcrawReaderPlugin::decoderThreads()
+{
+    OFX::MultiThread::AutoMutex lock( _decodersMutex );
+    return std::max( 1, int( OFX::MultiThread::getNumCPUs() / std::max<std::size_t>( _decodersInUse, 1 ) ) );
 }
 
 bool DcrawReaderPlugin::getRegionOfDefinition( const OFX::RegionOfDefinitionArguments& args, OfxRectD& rod )
 {
-    int iwidth = 0, iheight = 0;
-    dcraw::readDimensions( getAbsoluteFilenameAt( args.time ), iwidth, iheight );
+    const std::string filename = getAbsoluteFilenameAt( args.time );
+    dcraw::Header header;
+    if( !getRawHeader( filename, header ) )
+    {
+        BOOST_THROW_EXCEPTION( exception::FileNotExist( filename ) );
+    }
+    int width = header.width;
+    int height = header.height;
+    const DcrawReaderProcessParams params = getProcessParams( args.time );
+    // Images which are not croppable are decoded whole
+    if( params._crop && header.croppable )
+    {
+        // The part of the image inside the crop rectangle (output pixels, after the flip)
+        width = std::max( 0, std::min( params._cropLeft + params._cropWidth, width ) - params._cropLeft );
+        height = std::max( 0, std::min( params._cropTop + params._cropHeight, height ) - params._cropTop );
+        if( width == 0 || height == 0 )
+        {
+            BOOST_THROW_EXCEPTION( exception::Value()
+                << exception::user() + "The crop rectangle is outside of the image." );
+        }
+    }
     rod.x1 = 0;
-    rod.x2 = iwidth * this->_clipDst->getPixelAspectRatio();
+    rod.x2 = width * this->_clipDst->getPixelAspectRatio();
     rod.y1 = 0;
-    rod.y2 = iheight;
+    rod.y2 = height;
     return true;
 }
 
@@ -54,11 +190,42 @@ void DcrawReaderPlugin::getClipPreferences( OFX::ClipPreferencesSetter& clipPref
     clipPreferences.setPixelAspectRatio( *this->_clipDst, 1.0 );
 }
 
+/**
+ * @brief count a decode, report the frames decoded twice in a row
+ * @param[in] filename decoded file
+ * @param[in] args render arguments
+ */
+void DcrawReaderPlugin::countDecode( const std::string& filename, const OFX::RenderArguments& args )
+{
+    OFX::MultiThread::AutoMutex lock( _decodesMutex );
+    ++_nbDecodes;
+    const OfxRectI& window = args.renderWindow;
+    if( filename == _lastDecodedFile &&
+        window.x1 == _lastDecodedWindow.x1 && window.y1 == _lastDecodedWindow.y1 &&
+        window.x2 == _lastDecodedWindow.x2 && window.y2 == _lastDecodedWindow.y2 &&
+        args.renderScale.x == _lastDecodedScale.x && args.renderScale.y == _lastDecodedScale.y )
+    {
+        if( ++_nbRepeatedDecodes == 1 )
+        {
+            TUTTLE_LOG_WARNING( "[DcrawReader] " << filename << " decoded twice in a row: the host computes the reader again instead of using its output" );
+        }
+    }
+    _lastDecodedFile = filename;
+    _lastDecodedWindow = window;
+    _lastDecodedScale = args.renderScale;
+}
+
 void DcrawReaderPlugin::beginSequenceRender( const OFX::BeginSequenceRenderArguments& args )
 {
     ReaderPlugin::beginSequenceRender( args );
 }
 
+void DcrawReaderPlugin::endSequenceRender( const OFX::EndSequenceRenderArguments& args )
+{
+    ReaderPlugin::endSequenceRender( args );
+    clearDecoders();
+}
+
 /**
  * @brief The overridden render function
  * @param[in]   args     Rendering parameters
@@ -66,6 +233,7 @@ void DcrawReaderPlugin::beginSequenceRender( const OFX::BeginSequenceRenderArgum
 void DcrawReaderPlugin::render( const OFX::RenderArguments& args )
 {
     ReaderPlugin::render( args );
+    countDecode( getAbsoluteFilenameAt( args.time ), args );
 
     // instantiate the render code based on the pixel depth of the dst clip
     OFX::EBitDepth bitDepth         = _clipDst->getPixelDepth();
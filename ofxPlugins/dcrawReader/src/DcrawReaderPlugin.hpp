@@ -7,10 +7,19 @@
 #define _TUTTLE_PLUGIN_DCRAWREADER_PLUGIN_HPP_
 
 #include "DcrawReaderDefinitions.hpp"
+#include "dcraw.hpp"
 
 #include <tuttle/plugin/context/ReaderPlugin.hpp>
 
+#include <ofxsMultiThread.h>
+
 #include <boost/filesystem/path.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <ctime>
+#include <map>
+#include <vector>
 
 namespace tuttle {
 namespace plugin {
@@ -20,6 +29,13 @@ struct DcrawReaderProcessParams
 {
     boost::filesystem::path _filepath;
     int _interpolationQuality;
+    bool _linearOutput;
+    bool _halfSize;     ///< Half size decoding, without interpolation
+    bool _crop;         ///< Decode the crop rectangle only
+    int _cropLeft;      ///< Crop rectangle, in full size image pixels
+    int _cropTop;
+    int _cropWidth;
+    int _cropHeight;
 };
 
 /**
@@ -31,16 +47,116 @@ public:
     DcrawReaderPlugin( OfxImageEffectHandle handle );
 
 public:
-    DcrawReaderProcessParams getProcessParams( const OfxTime time ) const;
+    DcrawReaderProcessParams getProcessParams( const OfxTime time, const OfxPointD& renderScale = OFX::kNoRenderScale ) const;
     void changedParam( const OFX::InstanceChangedArgs &args, const std::string &paramName );
     bool getRegionOfDefinition( const OFX::RegionOfDefinitionArguments& args, OfxRectD& rod );
     void getClipPreferences( OFX::ClipPreferencesSetter& clipPreferences );
     void beginSequenceRender( const OFX::BeginSequenceRenderArguments& args );
+    void endSequenceRender( const OFX::EndSequenceRenderArguments& args );
     void render( const OFX::RenderArguments &args );
 
+    /**
+     * @brief header of a raw file
+     * Each file is parsed once, files are identified by path, size and
+     * modification time.
+     * @param[in] filename raw file
+     * @param[out] header raw header
+     * @return false if the file can't be read
+     */
+    bool getRawHeader( const std::string& filename, dcraw::Header& header );
+
+    /**
+     * @brief decoder of a render
+     * Decoders keep their buffers from a frame to the next, each one is
+     * used by a single render at a time and given back by releaseDecoder
+     * (see DcrawDecoderGuard). A few idle decoders are kept, they are freed
+     * at the end of a sequence render and when the file changes.
+     */
+    boost::shared_ptr<dcraw::Decoder> acquireDecoder();
+    void releaseDecoder( const boost::shared_ptr<dcraw::Decoder>& decoder );
+
+    /**
+     * @brief free the idle decoders and their buffers
+     */
+    void clearDecoders();
+
+    /**
+     * @brief count a decode, report the frames decoded twice in a row
+     * A host computing the reader node again, instead of reusing its output,
+     * pays a full decode per extra compute: the first repeat is logged.
+     * @param[in] filename decoded file
+     * @param[in] args render arguments
+     */
+    void countDecode( const std::string& filename, const OFX::RenderArguments& args );
+
+    /**
+     * @brief number of threads of a decoder
+     * The plugin is fully thread safe: the host may run several renders at
+     * once, the cores are shared between the decoders in use.
+     */
+    int decoderThreads();
+
 public:
     OFX::ChoiceParam*	_paramInterpQuality;        ///< Interpolation quality
+    OFX::BooleanParam*	_paramLinearOutput;         ///< Output without gamma curve
+    OFX::ChoiceParam*	_paramPreview;              ///< Half size decoding mode
+    OFX::BooleanParam*	_paramCrop;                 ///< Decode a part of the image only
+    OFX::IntParam*	_paramCropLeft;             ///< Crop rectangle
+    OFX::IntParam*	_paramCropTop;
+    OFX::IntParam*	_paramCropWidth;
+    OFX::IntParam*	_paramCropHeight;
     std::size_t _lastFrame;     ///< Last frame index
+
+private:
+    struct CachedHeader
+    {
+        boost::uintmax_t _size;       ///< File size
+        std::time_t _lastWriteTime;   ///< File modification time
+        dcraw::Header _header;        ///< Raw header
+    };
+
+    OFX::MultiThread::Mutex _headersMutex;              ///< Renders may run concurrently
+    std::map<std::string, CachedHeader> _headers;       ///< Raw headers of the files, by path
+
+    OFX::MultiThread::Mutex _decodersMutex;             ///< Renders may run concurrently
+    std::vector<boost::shared_ptr<dcraw::Decoder> > _decoders;  ///< Idle decoders
+    std::size_t _decodersInUse;                         ///< Decoders acquired by renders
+
+    OFX::MultiThread::Mutex _decodesMutex;              ///< Renders may run concurrently
+    std::string _lastDecodedFile;                       ///< File, window and scale of the last decode
+    OfxRectI _lastDecodedWindow;
+    OfxPointD _lastDecodedScale;
+    std::size_t _nbDecodes;                             ///< Decodes of the plugin instance
+    std::size_t _nbRepeatedDecodes;                     ///< Decodes of the same frame as the previous one
+};
+
+/**
+ * @brief decoder acquired for a scope, given back to the plugin on exit (also on error)
+ */
+class DcrawDecoderGuard
+{
+public:
+    DcrawDecoderGuard( DcrawReaderPlugin& plugin )
+    : _plugin( plugin )
+    , _decoder( plugin.acquireDecoder() )
+    {}
+
+    ~DcrawDecoderGuard()
+    { _plugin.releaseDecoder( _decoder ); }
+
+    dcraw::Decoder& operator*() const
+    { return *_decoder; }
+
+    dcraw::Decoder* operator->() const
+    { return _decoder.get(); }
+
+private:
+    DcrawDecoderGuard( const DcrawDecoderGuard& );
+    DcrawDecoderGuard& operator=( const DcrawDecoderGuard& );
+
+private:
+    DcrawReaderPlugin& _plugin;
+    boost::shared_ptr<dcraw::Decoder> _decoder;
 };
 
 }
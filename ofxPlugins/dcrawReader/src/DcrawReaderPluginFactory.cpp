@@ -39,9 +39,10 @@ void DcrawReaderPluginFactory::describe( OFX::ImageEffectDescriptor& desc )
 	desc.addSupportedBitDepth( OFX::eBitDepthFloat );
 
 	// plugin flags
-	desc.setRenderThreadSafety( OFX::eRenderInstanceSafe );
+	// each render decodes with its own dcraw::Decoder, frames may be read concurrently
+	desc.setRenderThreadSafety( OFX::eRenderFullySafe );
 	desc.setHostFrameThreading( false );
-	desc.setSupportsMultiResolution( false );
+	desc.setSupportsMultiResolution( true );
 	desc.setSupportsMultipleClipDepths( true );
 	desc.setSupportsMultipleClipPARs( true );
 	desc.setSupportsTiles( kSupportTiles );
@@ -69,6 +70,59 @@ void DcrawReaderPluginFactory::describeInContext( OFX::ImageEffectDescriptor& de
     paramInterpolationQuality->appendOption( kParamAlgorithmYUVReductionAHD );
     paramInterpolationQuality->setDefault( 3 );
 
+    OFX::BooleanParamDescriptor* paramLinearOutput = desc.defineBooleanParam( kParamLinearOutput );
+    paramLinearOutput->setLabel( "Linear output" );
+    paramLinearOutput->setHint( "Float outputs without the DCRaw gamma curve (linear values, white level at 1)" );
+    paramLinearOutput->setDefault( false );
+
+    OFX::ChoiceParamDescriptor* paramPreview = desc.defineChoiceParam( kParamPreview );
+    paramPreview->setLabel( "Preview" );
+    paramPreview->setHint( "Half size decoding: each 2x2 block of the sensor gives one pixel, without interpolation. Much faster than a full decoding, used to scrub a roll." );
+    paramPreview->appendOption( kParamPreviewAuto );
+    paramPreview->appendOption( kParamPreviewFullSize );
+    paramPreview->appendOption( kParamPreviewHalfSize );
+    paramPreview->setDefault( eParamPreviewAuto );
+
+    OFX::GroupParamDescriptor *groupCropParams = desc.defineGroupParam( "Crop" );
+
+    OFX::BooleanParamDescriptor* paramCrop = desc.defineBooleanParam( kParamCrop );
+    paramCrop->setLabel( "Crop" );
+    paramCrop->setHint( "Decode a part of the image only: the rest of the sensor is not processed. The automatic brightness is computed on the part. Not supported on rotated (Fuji) or stretched sensor images, which are read whole." );
+    paramCrop->setParent( *groupCropParams );
+    paramCrop->setDefault( false );
+
+    OFX::IntParamDescriptor* paramCropLeft = desc.defineIntParam( kParamCropLeft );
+    paramCropLeft->setLabel( "Left" );
+    paramCropLeft->setHint( "Left of the part, in pixels of the full size image" );
+    paramCropLeft->setParent( *groupCropParams );
+    paramCropLeft->setDefault( 0 );
+    paramCropLeft->setRange( 0, std::numeric_limits<int>::max() );
+    paramCropLeft->setDisplayRange( 0, 8192 );
+
+    OFX::IntParamDescriptor* paramCropTop = desc.defineIntParam( kParamCropTop );
+    paramCropTop->setLabel( "Top" );
+    paramCropTop->setHint( "Top of the part, in pixels of the full size image" );
+    paramCropTop->setParent( *groupCropParams );
+    paramCropTop->setDefault( 0 );
+    paramCropTop->setRange( 0, std::numeric_limits<int>::max() );
+    paramCropTop->setDisplayRange( 0, 8192 );
+
+    OFX::IntParamDescriptor* paramCropWidth = desc.defineIntParam( kParamCropWidth );
+    paramCropWidth->setLabel( "Width" );
+    paramCropWidth->setHint( "Width of the part, clamped to the image" );
+    paramCropWidth->setParent( *groupCropParams );
+    paramCropWidth->setDefault( 1920 );
+    paramCropWidth->setRange( 1, std::numeric_limits<int>::max() );
+    paramCropWidth->setDisplayRange( 1, 8192 );
+
+    OFX::IntParamDescriptor* paramCropHeight = desc.defineIntParam( kParamCropHeight );
+    paramCropHeight->setLabel( "Height" );
+    paramCropHeight->setHint( "Height of the part, clamped to the image" );
+    paramCropHeight->setParent( *groupCropParams );
+    paramCropHeight->setDefault( 1080 );
+    paramCropHeight->setRange( 1, std::numeric_limits<int>::max() );
+    paramCropHeight->setDisplayRange( 1, 8192 );
+
     describeReaderParamsInContext( desc, context );
 }
 
@@ -16,6 +16,7 @@ DcrawReaderProcess<View>::DcrawReaderProcess( DcrawReaderPlugin &instance )
 : ImageGilProcessor<View>( instance, eImageOrientationFromTopToBottom )
 , _plugin( instance )
 {
+    // The whole frame is decoded at once, the decoder runs its own threads
     this->setNoMultiThreading();
 }
 
@@ -24,7 +25,7 @@ void DcrawReaderProcess<View>::setup( const OFX::RenderArguments& args )
 {
     using namespace boost::gil;
     ImageGilProcessor<View>::setup( args );
-    _params = _plugin.getProcessParams( args.time );
+    _params = _plugin.getProcessParams( args.time, args.renderScale );
 }
 
 /**
@@ -41,7 +42,18 @@ void DcrawReaderProcess<View>::multiThreadProcessImages( const OfxRectI& procWin
 template<class View>
 View& DcrawReaderProcess<View>::readFrame( View& dst )
 {
-    dcraw::readRaw( _params._filepath, dst, _params._interpolationQuality );
+    // The decoder and its buffers are reused from a frame to the next
+    DcrawDecoderGuard decoder( _plugin );
+    // The interpolation is parallelized by the decoder, on its share of the cores
+    decoder->setNumberOfThreads( _plugin.decoderThreads() );
+    decoder->setHalfSize( _params._halfSize );
+    // The decoders are reused, the crop is always set
+    if( _params._crop )
+        decoder->setCrop( _params._cropLeft, _params._cropTop, _params._cropWidth, _params._cropHeight );
+    else
+        decoder->setCrop( 0, 0, 0, 0 );
+    // Rows are decoded directly in the output view
+    dcraw::readRaw( *decoder, _params._filepath, dst, _params._interpolationQuality, _params._linearOutput );
     return dst;
 }
 
@@ -45,6 +45,17 @@
 #include <string.h>
 #include <time.h>
 #include <sys/types.h>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/* SSE2 is there on every x86-64, and the float arithmetic of the scalar
+   code then is the SSE one:  the vector color stages give the same values */
+#if defined(__SSE2_MATH__) || defined(_M_X64)
+#define DCRAW_SSE2
+#include <emmintrin.h>
+#endif
 
 inline size_t p_strnlen(const char *s, size_t maxlen) {
   const char *end = (const char *)memchr(s, 0, maxlen);
@@ -106,68 +117,297 @@ typedef unsigned long long UINT64;
 #define ushort unsigned short
 #endif
 
-/*
-   All global variables are defined here, and all functions that
-   access them are prefixed with "CLASS".  Note that a thread-safe
-   C++ class cannot have non-const static local variables.
- */
-FILE *ifp, *ofp;
-short order;
-const char *ifname;
-char *meta_data, xtrans[6][6], xtrans_abs[6][6];
-char cdesc[5], desc[512], make[64], model[64], model2[64], artist[64];
-float flash_used, canon_ev, iso_speed, shutter, aperture, focal_len;
-time_t timestamp;
-off_t strip_offset, data_offset;
-off_t thumb_offset, meta_offset, profile_offset;
-unsigned shot_order, kodak_cbpp, exif_cfa, unique_id;
-unsigned thumb_length, meta_length, profile_length;
-unsigned thumb_misc, *oprof, fuji_layout, shot_select=0, multi_out=0;
-unsigned tiff_nifds, tiff_samples, tiff_bps, tiff_compress;
-unsigned black, maximum, mix_green, raw_color, zero_is_bad;
-unsigned zero_after_ff, is_raw, dng_version, is_foveon, data_error;
-unsigned tile_width, tile_length, gpsdata[32], load_flags;
-unsigned flip, tiff_flip, filters, colors;
-ushort raw_height, raw_width, height, width, top_margin, left_margin;
-ushort shrink, iheight, iwidth, fuji_width, thumb_width, thumb_height;
-ushort *raw_image, (*image)[4], cblack[4102];
-ushort white[8][8], curve[0x10000], cr2_slice[3], sraw_mul[4];
-double pixel_aspect, aber[4]={1,1,1,1}, gamm[6]={ 0.45,4.5,0,0,0,0 };
-float bright=1, user_mul[4]={0,0,0,0}, threshold=0;
-int mask[8][4];
-int half_size=0, four_color_rgb=0, document_mode=0, highlight=0;
-int verbose=0, use_auto_wb=0, use_camera_wb=0, use_camera_matrix=1;
-int output_color=1, output_bps=8, output_tiff=0, med_passes=0;
-int no_auto_bright=0;
-unsigned greybox[4] = { 0, 0, UINT_MAX, UINT_MAX };
-float cam_mul[4], pre_mul[4], cmatrix[3][4], rgb_cam[3][4];
 const double xyz_rgb[3][3] = {			/* XYZ from RGB */
   { 0.412453, 0.357580, 0.180423 },
   { 0.212671, 0.715160, 0.072169 },
   { 0.019334, 0.119193, 0.950227 } };
 const float d65_white[3] = { 0.950456, 1, 1.088754 };
-int histogram[4][0x2000];
-void (*write_thumb)(), (*write_fun)();
-void (*load_raw)(), (*thumb_load_raw)();
-jmp_buf failure;
 
 struct decode {
   struct decode *branch[2];
   int leaf;
-} first_decode[2048], *second_decode, *free_decode;
+};
 
 struct tiff_ifd {
   int width, height, bps, comp, phint, offset, flip, samples, bytes;
   int tile_width, tile_length;
   float shutter;
-} tiff_ifd[10];
+};
 
 struct ph1 {
   int format, key_off, tag_21a;
   int black, split_col, black_col, split_row, black_row;
   float tag_210;
-} ph1;
-#define CLASS
+};
+
+struct jhead;
+struct tiff_hdr;
+
+namespace dcraw
+{
+
+/*
+   All the decoder state is held by a DecoderContext, and all functions
+   that access it are its members, prefixed with "CLASS".  A context
+   belongs to one decode at a time, so several raw files are decoded
+   concurrently with one context each.  Non-const static local variables
+   are not allowed: the state of the bit readers is a member too.
+ */
+struct DecoderContext
+{
+  FILE *ifp, *ofp;
+  short order;
+  const char *ifname;
+  std::string filename;
+  char *meta_data, xtrans[6][6], xtrans_abs[6][6];
+  char cdesc[5], desc[512], make[64], model[64], model2[64], artist[64];
+  float flash_used, canon_ev, iso_speed, shutter, aperture, focal_len;
+  time_t timestamp;
+  off_t strip_offset, data_offset;
+  off_t thumb_offset, meta_offset, profile_offset;
+  unsigned shot_order, kodak_cbpp, exif_cfa, unique_id;
+  unsigned thumb_length, meta_length, profile_length;
+  unsigned thumb_misc, *oprof, fuji_layout, shot_select=0, multi_out=0;
+  unsigned tiff_nifds, tiff_samples, tiff_bps, tiff_compress;
+  unsigned black, maximum, mix_green, raw_color, zero_is_bad;
+  unsigned zero_after_ff, is_raw, dng_version, is_foveon, data_error;
+  unsigned tile_width, tile_length, gpsdata[32], load_flags;
+  unsigned flip, tiff_flip, filters, colors;
+  ushort raw_height, raw_width, height, width, top_margin, left_margin;
+  ushort shrink, iheight, iwidth, fuji_width, thumb_width, thumb_height;
+  ushort *raw_image, (*image)[4], cblack[4102];
+  ushort white[8][8], curve[0x10000], cr2_slice[3], sraw_mul[4];
+  double pixel_aspect, aber[4]={1,1,1,1}, gamm[6]={ 0.45,4.5,0,0,0,0 };
+  float bright=1, user_mul[4]={0,0,0,0}, threshold=0;
+  int mask[8][4];
+  int half_size=0, four_color_rgb=0, document_mode=0, highlight=0;
+  int verbose=0, use_auto_wb=0, use_camera_wb=0, use_camera_matrix=1;
+  int output_color=1, output_bps=8, output_tiff=0, med_passes=0;
+  int no_auto_bright=0;
+  int nthreads=0;
+  int crop_left=0, crop_top=0, crop_width=0, crop_height=0;
+  int output_white;
+  std::vector<uchar> byte_curve;
+  std::vector<float> float_curve, linear_curve;
+  void *raw_buffer=0, *image_buffer=0;
+  size_t raw_buffer_size=0, image_buffer_size=0;
+  DecodeTimings timings = DecodeTimings();
+  unsigned greybox[4] = { 0, 0, UINT_MAX, UINT_MAX };
+  float cam_mul[4], pre_mul[4], cmatrix[3][4], rgb_cam[3][4];
+  int histogram[4][0x2000];
+  void (DecoderContext::*write_thumb)(), (DecoderContext::*write_fun)();
+  void (DecoderContext::*load_raw)(), (DecoderContext::*thumb_load_raw)();
+  jmp_buf failure;
+  struct decode first_decode[2048], *second_decode, *free_decode;
+  struct tiff_ifd tiff_ifd[10];
+  struct ph1 ph1;
+
+  /* Formerly static local variables */
+  UINT64 getbithuff_bitbuf;
+  int getbithuff_vbits, getbithuff_reset;
+  UINT64 ph1_bithuff_bitbuf;
+  int ph1_bithuff_vbits;
+  uchar pana_bits_buf[0x4000];
+  int pana_bits_vbits;
+  unsigned sony_decrypt_pad[128], sony_decrypt_p;
+  float ljpeg_idct_cs[106];
+  float cielab_cbrt[0x10000], cielab_xyz_cam[3][4];
+#ifndef NO_JPEG
+  uchar jpeg_buffer[4096];
+#endif
+
+  int fcol (int row, int col);
+  void merror (void *ptr, const char *where);
+  void derror();
+  ushort sget2 (uchar *s);
+  ushort get2();
+  unsigned sget4 (uchar *s);
+  unsigned get4();
+  unsigned getint (int type);
+  float int_to_float (int i);
+  double getreal (int type);
+  void read_shorts (ushort *pixel, int count);
+  void cubic_spline (const int *x_, const int *y_, const int len);
+  void canon_600_fixed_wb (int temp);
+  int canon_600_color (int ratio[2], int mar);
+  void canon_600_auto_wb();
+  void canon_600_coeff();
+  void canon_600_load_raw();
+  void canon_600_correct();
+  int canon_s2is();
+  void getbithuff_fill (int nbits);
+  unsigned getbithuff (int nbits, ushort *huff);
+  ushort * make_decoder_ref (const uchar **source);
+  ushort * make_decoder (const uchar *source);
+  void crw_init_tables (unsigned table, ushort *huff[2]);
+  int canon_has_lowbits();
+  void canon_load_raw();
+  int ljpeg_start (struct jhead *jh, int info_only);
+  void ljpeg_end (struct jhead *jh);
+  int ljpeg_diff (ushort *huff);
+  int ljpeg_diff (ushort *huff, const int *fast);
+  int * ljpeg_fast_table (ushort *huff);
+  ushort * ljpeg_row (int jrow, struct jhead *jh);
+  void lossless_jpeg_load_raw();
+  void canon_sraw_load_raw();
+  void adobe_copy_pixel (unsigned row, unsigned col, ushort **rp);
+  void ljpeg_idct (struct jhead *jh);
+  void lossless_dng_load_raw();
+  void packed_dng_load_raw();
+  void pentax_load_raw();
+  void nikon_load_raw();
+  void nikon_yuv_load_raw();
+  int nikon_e995();
+  int nikon_e2100();
+  void nikon_3700();
+  int minolta_z2();
+  void ppm_thumb();
+  void ppm16_thumb();
+  void layer_thumb();
+  void rollei_thumb();
+  void rollei_load_raw();
+  int raw (unsigned row, unsigned col);
+  void phase_one_flat_field (int is_float, int nc);
+  void phase_one_correct();
+  void phase_one_load_raw();
+  unsigned ph1_bithuff (int nbits, ushort *huff);
+  void phase_one_load_raw_c();
+  void hasselblad_load_raw();
+  void leaf_hdr_load_raw();
+  void unpacked_load_raw();
+  void sinar_4shot_load_raw();
+  void imacon_full_load_raw();
+  void packed_load_raw();
+  void nokia_load_raw();
+  void canon_rmf_load_raw();
+  unsigned pana_bits (int nbits);
+  void panasonic_load_raw();
+  void olympus_load_raw();
+  void minolta_rd175_load_raw();
+  void quicktake_100_load_raw();
+  void kodak_radc_load_raw();
+  void kodak_jpeg_load_raw();
+  void lossy_dng_load_raw();
+  void kodak_dc120_load_raw();
+  void eight_bit_load_raw();
+  void kodak_c330_load_raw();
+  void kodak_c603_load_raw();
+  void kodak_262_load_raw();
+  int kodak_65000_decode (short *out, int bsize);
+  void kodak_65000_load_raw();
+  void kodak_ycbcr_load_raw();
+  void kodak_rgb_load_raw();
+  void kodak_thumb_load_raw();
+  void sony_decrypt (unsigned *data, int len, int start, int key);
+  void sony_load_raw();
+  void sony_arw_load_raw();
+  void sony_arw2_load_raw();
+  void samsung_load_raw();
+  void samsung2_load_raw();
+  void samsung3_load_raw();
+  void smal_decode_segment (unsigned seg[2][2], int holes);
+  void smal_v6_load_raw();
+  int median4 (int *p);
+  void fill_holes (int holes);
+  void smal_v9_load_raw();
+  void redcine_load_raw();
+  void crop_masked_pixels();
+  void remove_zeroes();
+  void bad_pixels (const char *cfname);
+  void subtract (const char *fname);
+  void gamma_curve (double pwr, double ts, int mode, int imax);
+  void pseudoinverse (double (*in)[3], double (*out)[3], int size);
+  void cam_xyz_coeff (float rgb_cam[3][4], double cam_xyz[4][3]);
+#ifdef COLORCHECK
+  void colorcheck();
+#endif
+  void hat_transform (float *temp, float *base, int st, int size, int sc);
+  void wavelet_denoise();
+  void scale_colors();
+  void pre_interpolate();
+  int parallel_parts (int begin, int end, int grain);
+  void parallel_for (int begin, int end, int grain,
+	const std::function<void (int, int, int)> &job);
+  void border_interpolate (int border);
+  void lin_interpolate();
+  void vng_interpolate();
+  void ppg_interpolate();
+  void cielab (ushort rgb[3], short lab[3]);
+  void xtrans_interpolate (int passes);
+  void ahd_interpolate();
+  void ahd_interpolate_tile (int top, int left, char *buffer);
+  void median_filter();
+  void blend_highlights();
+  void recover_highlights();
+  void tiff_get (unsigned base,
+	unsigned *tag, unsigned *type, unsigned *len, unsigned *save);
+  void parse_thumb_note (int base, unsigned toff, unsigned tlen);
+  void parse_makernote (int base, int uptag);
+  void get_timestamp (int reversed);
+  void parse_exif (int base);
+  void parse_gps (int base);
+  void romm_coeff (float romm_cam[3][3]);
+  void parse_mos (int offset);
+  void linear_table (unsigned len);
+  void parse_kodak_ifd (int base);
+  int parse_tiff_ifd (int base);
+  int parse_tiff (int base);
+  void apply_tiff();
+  void parse_minolta (int base);
+  void parse_external_jpeg();
+  void ciff_block_1030();
+  void parse_ciff (int offset, int length, int depth);
+  void parse_rollei();
+  void parse_sinar_ia();
+  void parse_phase_one (int base);
+  void parse_fuji (int offset);
+  int parse_jpeg (int offset);
+  void parse_riff();
+  void parse_qt (int end);
+  void parse_smal (int offset, int fsize);
+  void parse_cine();
+  void parse_redcine();
+  char * foveon_gets (int offset, char *str, int len);
+  void parse_foveon();
+  void adobe_coeff (const char *make, const char *model);
+  void simple_coeff (int index);
+  short guess_byte_order (int words);
+  float find_green (int bps, int bite, int off0, int off1);
+  void identify();
+#ifndef NO_LCMS
+  void apply_profile (const char *input, const char *output);
+#endif
+  void convert_to_rgb();
+  void fuji_rotate();
+  void stretch();
+  int flip_index (int row, int col);
+  void tiff_set (struct tiff_hdr *th, ushort *ntag,
+	ushort tag, ushort type, int count, int val);
+  void tiff_head (struct tiff_hdr *th, int full);
+  void jpeg_thumb();
+  void write_ppm_tiff();
+  bool decode( const int interpolationQuality );
+  boost::shared_array<ushort> getRawData( const int interpolationQuality );
+  template<typename T>
+  void output_row (int row, T *dst, int nchannels, const T *table, T alpha);
+  void output_row (int row, uchar *dst, int nchannels);
+  void output_row (int row, ushort *dst, int nchannels);
+  void output_row (int row, float *dst, int nchannels, bool linear);
+  bool croppable();
+  void output_size (int &wide, int &high);
+  int crop_region (int area[4], int region[4]);
+  void crop_image (int top, int left, int high, int wide);
+  void * decode_buffer (void *&buffer, size_t &buffer_size, size_t size);
+  double stage_time (std::chrono::steady_clock::time_point &start);
+  void free_image();
+  bool openRaw( const boost::filesystem::path & filename );
+  void cleanup();
+  ~DecoderContext();
+};
+
+}
+
+#define CLASS dcraw::DecoderContext::
 
 #define FORC(cnt) for (c=0; c < cnt; c++)
 #define FORC3 FORC(3)
@@ -599,22 +839,41 @@ int CLASS canon_s2is()
   return 0;
 }
 
-unsigned CLASS getbithuff (int nbits, ushort *huff)
+/*
+   Fill the bit buffer with at least nbits.  JPEG streams (zero_after_ff)
+   are read ahead up to 64 bits: a marker stops the reads, so the data
+   after the stream is not consumed.  Other streams are read as needed,
+   their loaders may read the file between the calls.
+   NO_LJPEG_TABLES builds read all streams as needed, as dcraw did.
+ */
+void CLASS getbithuff_fill (int nbits)
 {
-  static unsigned bitbuf=0;
-  static int vbits=0, reset=0;
+  UINT64 &bitbuf = getbithuff_bitbuf;
+  int &vbits = getbithuff_vbits, &reset = getbithuff_reset;
   unsigned c;
 
-  if (nbits > 25) return 0;
-  if (nbits < 0)
-    return bitbuf = vbits = reset = 0;
-  if (nbits == 0 || vbits < 0) return 0;
+#ifndef NO_LJPEG_TABLES
+  if (zero_after_ff) nbits = 57;
+#endif
   while (!reset && vbits < nbits && (c = fgetc(ifp)) != EOF &&
     !(reset = zero_after_ff && c == 0xff && fgetc(ifp))) {
     bitbuf = (bitbuf << 8) + (uchar) c;
     vbits += 8;
   }
-  c = bitbuf << (32-vbits) >> (32-nbits);
+}
+
+unsigned CLASS getbithuff (int nbits, ushort *huff)
+{
+  UINT64 &bitbuf = getbithuff_bitbuf;
+  int &vbits = getbithuff_vbits, &reset = getbithuff_reset;
+  unsigned c;
+
+  if (nbits > 25) return 0;
+  if (nbits < 0)
+    return bitbuf = vbits = reset = 0;
+  if (nbits == 0 || vbits < 0) return 0;
+  if (vbits < nbits) getbithuff_fill (nbits);
+  c = bitbuf << (64-vbits) >> (64-nbits);
   if (huff) {
     vbits -= huff[c] >> 8;
     c = (uchar) huff[c];
@@ -818,11 +1077,13 @@ void CLASS canon_load_raw()
 struct jhead {
   int algo, bits, high, wide, clrs, sraw, psv, restart, vpred[6];
   ushort quant[64], idct[64], *huff[20], *free[20], *row;
+  int *fast[20];
 };
 
 int CLASS ljpeg_start (struct jhead *jh, int info_only)
 {
   ushort c, tag, len;
+  int i;
   uchar data[0x10000];
   const uchar *dp;
 
@@ -870,6 +1131,12 @@ int CLASS ljpeg_start (struct jhead *jh, int info_only)
     FORC(4)        jh->huff[2+c] = jh->huff[1];
     FORC(jh->sraw) jh->huff[1+c] = jh->huff[0];
   }
+#ifndef NO_LJPEG_TABLES
+  FORC4 if (jh->free[c]) jh->fast[c] = ljpeg_fast_table (jh->free[c]);
+  FORC(20)
+    for (i=0; i < 4; i++)
+      if (jh->huff[c] == jh->free[i]) jh->fast[c] = jh->fast[i];
+#endif
   jh->row = (ushort *) calloc (jh->wide*jh->clrs, 4);
   merror (jh->row, "ljpeg_start()");
   return zero_after_ff = 1;
@@ -879,6 +1146,7 @@ void CLASS ljpeg_end (struct jhead *jh)
 {
   int c;
   FORC4 if (jh->free[c]) free (jh->free[c]);
+  FORC4 if (jh->free[c]) free (jh->fast[c]);
   free (jh->row);
 }
 
@@ -895,6 +1163,53 @@ int CLASS ljpeg_diff (ushort *huff)
   return diff;
 }
 
+/*
+   Lossless JPEG differences are a Huffman code followed by the bits of
+   the difference.  When both fit in LJPEG_FAST_BITS, the table built
+   by ljpeg_fast_table() gives the difference and the number of bits
+   read in one lookup:  entry = diff * 256 + bits, 0 if the lookup fails.
+   NO_LJPEG_TABLES builds keep the previous decoder, one getbithuff()
+   call for the code and one for the difference (dcrawBenchmarkReference).
+ */
+#define LJPEG_FAST_BITS 14
+
+int * CLASS ljpeg_fast_table (ushort *huff)
+{
+  int *fast, max, i, h, len, bits, diff;
+
+  fast = (int *) calloc (1 << LJPEG_FAST_BITS, sizeof *fast);
+  merror (fast, "ljpeg_fast_table()");
+  max = huff[0];
+  for (i=0; i < 1 << LJPEG_FAST_BITS; i++) {
+    h = max > LJPEG_FAST_BITS ?
+	huff[1 + (i << (max - LJPEG_FAST_BITS))] :
+	huff[1 + (i >> (LJPEG_FAST_BITS - max))];
+    bits = h >> 8;
+    len = (uchar) h;
+    if (!bits || len > 15 || bits + len > LJPEG_FAST_BITS) continue;
+    diff = i >> (LJPEG_FAST_BITS - bits - len) & ((1 << len) - 1);
+    if (len && (diff & (1 << (len-1))) == 0)
+      diff -= (1 << len) - 1;
+    fast[i] = diff * 256 + bits + len;
+  }
+  return fast;
+}
+
+int CLASS ljpeg_diff (ushort *huff, const int *fast)
+{
+  UINT64 &bitbuf = getbithuff_bitbuf;
+  int &vbits = getbithuff_vbits;
+  int entry;
+
+  if (vbits >= 0 && vbits < LJPEG_FAST_BITS)
+    getbithuff_fill (LJPEG_FAST_BITS);
+  if (vbits < LJPEG_FAST_BITS ||
+      !(entry = fast[bitbuf << (64-vbits) >> (64-LJPEG_FAST_BITS)]))
+    return ljpeg_diff (huff);
+  vbits -= entry & 255;
+  return entry >> 8;
+}
+
 ushort * CLASS ljpeg_row (int jrow, struct jhead *jh)
 {
   int col, c, diff, pred, spred=0;
@@ -912,7 +1227,11 @@ ushort * CLASS ljpeg_row (int jrow, struct jhead *jh)
   FORC3 row[c] = jh->row + jh->wide*jh->clrs*((jrow+c) & 1);
   for (col=0; col < jh->wide; col++)
     FORC(jh->clrs) {
+#ifdef NO_LJPEG_TABLES
       diff = ljpeg_diff (jh->huff[c]);
+#else
+      diff = ljpeg_diff (jh->huff[c], jh->fast[c]);
+#endif
       if (jh->sraw && c <= jh->sraw && (col | c))
 		    pred = spred;
       else if (col) pred = row[0][-jh->clrs];
@@ -1069,7 +1388,7 @@ void CLASS ljpeg_idct (struct jhead *jh)
 {
   int c, i, j, len, skip, coef;
   float work[3][8][8];
-  static float cs[106] = { 0 };
+  float (&cs)[106] = ljpeg_idct_cs;
   static const uchar zigzag[80] =
   {  0, 1, 8,16, 9, 2, 3,10,17,24,32,25,18,11, 4, 5,12,19,26,33,
     40,48,41,34,27,20,13, 6, 7,14,21,28,35,42,49,56,57,50,43,36,
@@ -1354,7 +1673,6 @@ int CLASS minolta_z2()
   return nz > 20;
 }
 
-void CLASS jpeg_thumb();
 
 void CLASS ppm_thumb()
 {
@@ -1718,8 +2036,8 @@ void CLASS phase_one_load_raw()
 
 unsigned CLASS ph1_bithuff (int nbits, ushort *huff)
 {
-  static UINT64 bitbuf=0;
-  static int vbits=0;
+  UINT64 &bitbuf = ph1_bithuff_bitbuf;
+  int &vbits = ph1_bithuff_vbits;
   unsigned c;
 
   if (nbits == -1)
@@ -2022,8 +2340,8 @@ void CLASS canon_rmf_load_raw()
 
 unsigned CLASS pana_bits (int nbits)
 {
-  static uchar buf[0x4000];
-  static int vbits;
+  uchar (&buf)[0x4000] = pana_bits_buf;
+  int &vbits = pana_bits_vbits;
   int byte;
 
   if (!nbits) return vbits=0;
@@ -2312,10 +2630,11 @@ void CLASS lossy_dng_load_raw() {}
 METHODDEF(boolean)
 fill_input_buffer (j_decompress_ptr cinfo)
 {
-  static uchar jpeg_buffer[4096];
+  dcraw::DecoderContext *context = (dcraw::DecoderContext *) cinfo->client_data;
+  uchar *jpeg_buffer = context->jpeg_buffer;
   size_t nbytes;
 
-  nbytes = fread (jpeg_buffer, 1, 4096, ifp);
+  nbytes = fread (jpeg_buffer, 1, 4096, context->ifp);
   swab (jpeg_buffer, jpeg_buffer, nbytes);
   cinfo->src->next_input_byte = jpeg_buffer;
   cinfo->src->bytes_in_buffer = nbytes;
@@ -2332,6 +2651,7 @@ void CLASS kodak_jpeg_load_raw()
 
   cinfo.err = jpeg_std_error (&jerr);
   jpeg_create_decompress (&cinfo);
+  cinfo.client_data = this;
   jpeg_stdio_src (&cinfo, ifp);
   cinfo.src->fill_input_buffer = fill_input_buffer;
   jpeg_read_header (&cinfo, TRUE);
@@ -2362,7 +2682,6 @@ void CLASS kodak_jpeg_load_raw()
   maximum = 0xff << 1;
 }
 
-void CLASS gamma_curve (double pwr, double ts, int mode, int imax);
 
 void CLASS lossy_dng_load_raw()
 {
@@ -2668,7 +2987,7 @@ void CLASS kodak_thumb_load_raw()
 
 void CLASS sony_decrypt (unsigned *data, int len, int start, int key)
 {
-  static unsigned pad[128], p;
+  unsigned (&pad)[128] = sony_decrypt_pad, &p = sony_decrypt_p;
 
   if (start) {
     for (p=0; p < 4; p++)
@@ -3572,7 +3891,32 @@ skip_block: ;
     cblack[4] = cblack[5] = 0;
   }
   size = iheight*iwidth;
-  for (i=0; i < size*4; i++) {
+  i = 0;
+#ifdef DCRAW_SSE2
+  if (!(cblack[4] && cblack[5])) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi32 (0x8000);
+    const __m128i sign = _mm_set1_epi16 ((short) 0x8000);
+    const __m128i vblack = _mm_setr_epi32 (cblack[0], cblack[1], cblack[2], cblack[3]);
+    const __m128 vmul = _mm_loadu_ps (scale_mul);
+    const __m128 vmax = _mm_set1_ps (65535);
+    __m128i pix2, lo, hi;
+    /* Two pixels at a time, zero values stay zero */
+    for (; i+8 <= size*4; i+=8) {
+      pix2 = _mm_loadu_si128 ((__m128i *)((ushort *)image + i));
+      lo = _mm_sub_epi32 (_mm_unpacklo_epi16 (pix2, zero), vblack);
+      hi = _mm_sub_epi32 (_mm_unpackhi_epi16 (pix2, zero), vblack);
+      lo = _mm_cvttps_epi32 (_mm_max_ps (_mm_min_ps (_mm_mul_ps
+		(_mm_cvtepi32_ps (lo), vmul), vmax), _mm_setzero_ps()));
+      hi = _mm_cvttps_epi32 (_mm_max_ps (_mm_min_ps (_mm_mul_ps
+		(_mm_cvtepi32_ps (hi), vmul), vmax), _mm_setzero_ps()));
+      lo = _mm_packs_epi32 (_mm_sub_epi32 (lo, bias), _mm_sub_epi32 (hi, bias));
+      lo = _mm_andnot_si128 (_mm_cmpeq_epi16 (pix2, zero), _mm_xor_si128 (lo, sign));
+      _mm_storeu_si128 ((__m128i *)((ushort *)image + i), lo);
+    }
+  }
+#endif
+  for (; i < size*4; i++) {
     if (!(val = ((ushort *)image)[i])) continue;
     if (cblack[4] && cblack[5])
       val -= cblack[6 + i/4 / iwidth % cblack[4] * cblack[5] +
@@ -3638,7 +3982,7 @@ void CLASS pre_interpolate()
 	  c = fcol(row,col);
 	  img[row*width+col][c] = image[(row >> 1)*iwidth+(col >> 1)][c];
 	}
-      free (image);
+      free_image();
       image = img;
       shrink = 0;
     }
@@ -3656,6 +4000,34 @@ void CLASS pre_interpolate()
   if (half_size) filters = 0;
 }
 
+/*
+   The interpolations run on parts of the image in parallel: job is
+   called as job (part, first, last) on contiguous ranges of [begin,end),
+   one part per thread, at least grain long.  Jobs must not call merror()
+   or longjmp(), which do not cross threads: buffers are allocated before.
+ */
+int CLASS parallel_parts (int begin, int end, int grain)
+{
+  int parts = nthreads > 0 ? nthreads : std::thread::hardware_concurrency();
+  if (grain < 1) grain = 1;
+  parts = MIN(parts, (end - begin) / grain);
+  return MAX(parts, 1);
+}
+
+void CLASS parallel_for (int begin, int end, int grain,
+	const std::function<void (int, int, int)> &job)
+{
+  int parts = parallel_parts (begin, end, grain), part;
+  std::vector<std::thread> threads;
+
+  for (part=1; part < parts; part++)
+    threads.push_back (std::thread (job, part,
+	begin + (end-begin)*part/parts, begin + (end-begin)*(part+1)/parts));
+  job (0, begin, begin + (end-begin)/parts);
+  for (part=0; part < (int) threads.size(); part++)
+    threads[part].join();
+}
+
 void CLASS border_interpolate (int border)
 {
   unsigned row, col, y, x, f, c, sum[8];
@@ -3681,8 +4053,7 @@ void CLASS border_interpolate (int border)
 void CLASS lin_interpolate()
 {
   int code[16][16][32], size=16, *ip, sum[4];
-  int f, c, i, x, y, row, col, shift, color;
-  ushort *pix;
+  int f, c, x, y, row, col, shift, color;
 
   if (verbose) fprintf (stderr,_("Bilinear interpolation...\n"));
   if (filters == 9) size = 6;
@@ -3709,16 +4080,21 @@ void CLASS lin_interpolate()
 	  *ip++ = 256 / sum[c];
 	}
     }
-  for (row=1; row < height-1; row++)
-    for (col=1; col < width-1; col++) {
-      pix = image[row*width+col];
-      ip = code[row % size][col % size];
-      memset (sum, 0, sizeof sum);
-      for (i=*ip++; i--; ip+=3)
-	sum[ip[2]] += pix[ip[0]] << ip[1];
-      for (i=colors; --i; ip+=2)
-	pix[ip[0]] = sum[ip[0]] * ip[1] >> 8;
-    }
+/*  Each pixel only reads the raw color of its neighbors:	*/
+  parallel_for (1, height-1, 16, [&] (int part, int first, int last) {
+    int row, col, i, sum[4], *ip;
+    ushort *pix;
+    for (row=first; row < last; row++)
+      for (col=1; col < width-1; col++) {
+	pix = image[row*width+col];
+	ip = code[row % size][col % size];
+	memset (sum, 0, sizeof sum);
+	for (i=*ip++; i--; ip+=3)
+	  sum[ip[2]] += pix[ip[0]] << ip[1];
+	for (i=colors; --i; ip+=2)
+	  pix[ip[0]] = sum[ip[0]] * ip[1] >> 8;
+      }
+  });
 }
 
 /*
@@ -3757,10 +4133,10 @@ void CLASS vng_interpolate()
     +1,-1,+1,+1,0,(signed char)0x88, +1,+0,+1,+2,0,0x08, +1,+0,+2,-1,0,0x40,
     +1,+0,+2,+1,0,0x10
   }, chood[] = { -1,-1, -1,0, -1,+1, 0,+1, +1,+1, +1,0, +1,-1, 0,-1 };
-  ushort (*brow[5])[4], *pix;
-  int prow=8, pcol=2, *ip, *code[16][16], gval[8], gmin, gmax, sum[4];
+  ushort (*buffer)[4], (*held)[4];
+  int prow=8, pcol=2, *ip, *code[16][16];
   int row, col, x, y, x1, x2, y1, y2, t, weight, grads, color, diag;
-  int g, diff, thold, num, c;
+  int g, c, parts, part, first, last;
 
   lin_interpolate();
   if (verbose) fprintf (stderr,_("VNG interpolation...\n"));
@@ -3799,62 +4175,85 @@ void CLASS vng_interpolate()
 	  *ip++ = 0;
       }
     }
-  brow[4] = (ushort (*)[4]) calloc (width*3, sizeof **brow);
-  merror (brow[4], "vng_interpolate()");
-  for (row=0; row < 3; row++)
-    brow[row] = brow[4] + row*width;
-  for (row=2; row < height-2; row++) {		/* Do VNG interpolation */
-    for (col=2; col < width-2; col++) {
-      pix = image[row*width+col];
-      ip = code[row % prow][col % pcol];
-      memset (gval, 0, sizeof gval);
-      while ((g = ip[0]) != INT_MAX) {		/* Calculate gradients */
-	diff = ABS(pix[g] - pix[ip[1]]) << ip[2];
-	gval[ip[3]] += diff;
-	ip += 5;
-	if ((g = ip[-1]) == -1) continue;
-	gval[g] += diff;
-	while ((g = *ip++) != -1)
+/*  Rows are interpolated in parallel bands.  A band reads the two
+    rows around it, so its first and last two rows are held until all
+    the bands are done.  Each band has 4 held and 3 buffer rows:	*/
+  parts = parallel_parts (2, height-2, 16);
+  buffer = (ushort (*)[4]) calloc (width*7*parts, sizeof *buffer);
+  merror (buffer, "vng_interpolate()");
+  parallel_for (2, height-2, 16, [&] (int part, int first, int last) {
+    ushort (*brow[4])[4], (*held)[4], *pix;
+    int row, col, t, color, g, diff, thold, num, c, *ip;
+    int gval[8], gmin, gmax, sum[4];
+
+    held = buffer + width*7*part;
+    for (row=0; row < 3; row++)
+      brow[row] = held + width*(4+row);
+    for (row=first; row < last; row++) {	/* Do VNG interpolation */
+      for (col=2; col < width-2; col++) {
+	pix = image[row*width+col];
+	ip = code[row % prow][col % pcol];
+	memset (gval, 0, sizeof gval);
+	while ((g = ip[0]) != INT_MAX) {		/* Calculate gradients */
+	  diff = ABS(pix[g] - pix[ip[1]]) << ip[2];
+	  gval[ip[3]] += diff;
+	  ip += 5;
+	  if ((g = ip[-1]) == -1) continue;
 	  gval[g] += diff;
-      }
-      ip++;
-      gmin = gmax = gval[0];			/* Choose a threshold */
-      for (g=1; g < 8; g++) {
-	if (gmin > gval[g]) gmin = gval[g];
-	if (gmax < gval[g]) gmax = gval[g];
-      }
-      if (gmax == 0) {
-	memcpy (brow[2][col], pix, sizeof *image);
-	continue;
-      }
-      thold = gmin + (gmax >> 1);
-      memset (sum, 0, sizeof sum);
-      color = fcol(row,col);
-      for (num=g=0; g < 8; g++,ip+=2) {		/* Average the neighbors */
-	if (gval[g] <= thold) {
-	  FORCC
-	    if (c == color && ip[1])
-	      sum[c] += (pix[c] + pix[ip[1]]) >> 1;
-	    else
-	      sum[c] += pix[ip[0] + c];
-	  num++;
+	  while ((g = *ip++) != -1)
+	    gval[g] += diff;
+	}
+	ip++;
+	gmin = gmax = gval[0];			/* Choose a threshold */
+	for (g=1; g < 8; g++) {
+	  if (gmin > gval[g]) gmin = gval[g];
+	  if (gmax < gval[g]) gmax = gval[g];
+	}
+	if (gmax == 0) {
+	  memcpy (brow[2][col], pix, sizeof *image);
+	  continue;
+	}
+	thold = gmin + (gmax >> 1);
+	memset (sum, 0, sizeof sum);
+	color = fcol(row,col);
+	for (num=g=0; g < 8; g++,ip+=2) {		/* Average the neighbors */
+	  if (gval[g] <= thold) {
+	    FORCC
+	      if (c == color && ip[1])
+		sum[c] += (pix[c] + pix[ip[1]]) >> 1;
+	      else
+		sum[c] += pix[ip[0] + c];
+	    num++;
+	  }
+	}
+	FORCC {					/* Save to buffer */
+	  t = pix[color];
+	  if (c != color)
+	    t += (sum[c] - sum[color]) / num;
+	  brow[2][col][c] = CLIP(t);
 	}
       }
-      FORCC {					/* Save to buffer */
-	t = pix[color];
-	if (c != color)
-	  t += (sum[c] - sum[color]) / num;
-	brow[2][col][c] = CLIP(t);
-      }
+      if (row >= first+4)			/* Write buffer to image */
+	memcpy (image[(row-2)*width+2], brow[0]+2, (width-4)*sizeof *image);
+      else if (row >= first+2)
+	memcpy (held[(row-2-first)*width], brow[0], width*sizeof *image);
+      for (g=0; g < 4; g++)
+	brow[(g-1) & 3] = brow[g];
+    }
+    memcpy (held[2*width], brow[0], width*sizeof *image);
+    memcpy (held[3*width], brow[1], width*sizeof *image);
+  });
+  for (part=0; part < parts; part++) {		/* Write the held rows */
+    held  = buffer + width*7*part;
+    first = 2 + (height-4)*part/parts;
+    last  = 2 + (height-4)*(part+1)/parts;
+    FORC4 {
+      row = c < 2 ? first+c : last-4+c;
+      if (row >= first && row < last)
+	memcpy (image[row*width+2], held[c*width+2], (width-4)*sizeof *image);
     }
-    if (row > 3)				/* Write buffer to image */
-      memcpy (image[(row-2)*width+2], brow[0]+2, (width-4)*sizeof *image);
-    for (g=0; g < 4; g++)
-      brow[(g-1) & 3] = brow[g];
   }
-  memcpy (image[(row-2)*width+2], brow[0]+2, (width-4)*sizeof *image);
-  memcpy (image[(row-1)*width+2], brow[1]+2, (width-4)*sizeof *image);
-  free (brow[4]);
+  free (buffer);
   free (code[0][0]);
 }
 
@@ -3864,59 +4263,71 @@ void CLASS vng_interpolate()
 void CLASS ppg_interpolate()
 {
   int dir[5] = { 1, width, -1, -width, 1 };
-  int row, col, diff[2], guess[2], c, d, i;
-  ushort (*pix)[4];
 
   border_interpolate(3);
   if (verbose) fprintf (stderr,_("PPG interpolation...\n"));
 
+/*  Each pass only reads what the previous ones wrote, its rows are
+    computed in parallel:						*/
 /*  Fill in the green layer with gradients and pattern recognition: */
-  for (row=3; row < height-3; row++)
-    for (col=3+(FC(row,3) & 1), c=FC(row,col); col < width-3; col+=2) {
-      pix = image + row*width+col;
-      for (i=0; (d=dir[i]) > 0; i++) {
-	guess[i] = (pix[-d][1] + pix[0][c] + pix[d][1]) * 2
-		      - pix[-2*d][c] - pix[2*d][c];
-	diff[i] = ( ABS(pix[-2*d][c] - pix[ 0][c]) +
-		    ABS(pix[ 2*d][c] - pix[ 0][c]) +
-		    ABS(pix[  -d][1] - pix[ d][1]) ) * 3 +
-		  ( ABS(pix[ 3*d][1] - pix[ d][1]) +
-		    ABS(pix[-3*d][1] - pix[-d][1]) ) * 2;
+  parallel_for (3, height-3, 16, [&] (int part, int first, int last) {
+    int row, col, diff[2], guess[2], c, d, i;
+    ushort (*pix)[4];
+    for (row=first; row < last; row++)
+      for (col=3+(FC(row,3) & 1), c=FC(row,col); col < width-3; col+=2) {
+	pix = image + row*width+col;
+	for (i=0; (d=dir[i]) > 0; i++) {
+	  guess[i] = (pix[-d][1] + pix[0][c] + pix[d][1]) * 2
+			- pix[-2*d][c] - pix[2*d][c];
+	  diff[i] = ( ABS(pix[-2*d][c] - pix[ 0][c]) +
+		      ABS(pix[ 2*d][c] - pix[ 0][c]) +
+		      ABS(pix[  -d][1] - pix[ d][1]) ) * 3 +
+		    ( ABS(pix[ 3*d][1] - pix[ d][1]) +
+		      ABS(pix[-3*d][1] - pix[-d][1]) ) * 2;
+	}
+	d = dir[i = diff[0] > diff[1]];
+	pix[0][1] = ULIM(guess[i] >> 2, pix[d][1], pix[-d][1]);
       }
-      d = dir[i = diff[0] > diff[1]];
-      pix[0][1] = ULIM(guess[i] >> 2, pix[d][1], pix[-d][1]);
-    }
+  });
 /*  Calculate red and blue for each green pixel:		*/
-  for (row=1; row < height-1; row++)
-    for (col=1+(FC(row,2) & 1), c=FC(row,col+1); col < width-1; col+=2) {
-      pix = image + row*width+col;
-      for (i=0; (d=dir[i]) > 0; c=2-c, i++)
-	pix[0][c] = CLIP((pix[-d][c] + pix[d][c] + 2*pix[0][1]
-			- pix[-d][1] - pix[d][1]) >> 1);
-    }
+  parallel_for (1, height-1, 16, [&] (int part, int first, int last) {
+    int row, col, c, d, i;
+    ushort (*pix)[4];
+    for (row=first; row < last; row++)
+      for (col=1+(FC(row,2) & 1), c=FC(row,col+1); col < width-1; col+=2) {
+	pix = image + row*width+col;
+	for (i=0; (d=dir[i]) > 0; c=2-c, i++)
+	  pix[0][c] = CLIP((pix[-d][c] + pix[d][c] + 2*pix[0][1]
+			  - pix[-d][1] - pix[d][1]) >> 1);
+      }
+  });
 /*  Calculate blue for red pixels and vice versa:		*/
-  for (row=1; row < height-1; row++)
-    for (col=1+(FC(row,1) & 1), c=2-FC(row,col); col < width-1; col+=2) {
-      pix = image + row*width+col;
-      for (i=0; (d=dir[i]+dir[i+1]) > 0; i++) {
-	diff[i] = ABS(pix[-d][c] - pix[d][c]) +
-		  ABS(pix[-d][1] - pix[0][1]) +
-		  ABS(pix[ d][1] - pix[0][1]);
-	guess[i] = pix[-d][c] + pix[d][c] + 2*pix[0][1]
-		 - pix[-d][1] - pix[d][1];
+  parallel_for (1, height-1, 16, [&] (int part, int first, int last) {
+    int row, col, diff[2], guess[2], c, d, i;
+    ushort (*pix)[4];
+    for (row=first; row < last; row++)
+      for (col=1+(FC(row,1) & 1), c=2-FC(row,col); col < width-1; col+=2) {
+	pix = image + row*width+col;
+	for (i=0; (d=dir[i]+dir[i+1]) > 0; i++) {
+	  diff[i] = ABS(pix[-d][c] - pix[d][c]) +
+		    ABS(pix[-d][1] - pix[0][1]) +
+		    ABS(pix[ d][1] - pix[0][1]);
+	  guess[i] = pix[-d][c] + pix[d][c] + 2*pix[0][1]
+		   - pix[-d][1] - pix[d][1];
+	}
+	if (diff[0] != diff[1])
+	  pix[0][c] = CLIP(guess[diff[0] > diff[1]] >> 1);
+	else
+	  pix[0][c] = CLIP((guess[0]+guess[1]) >> 2);
       }
-      if (diff[0] != diff[1])
-	pix[0][c] = CLIP(guess[diff[0] > diff[1]] >> 1);
-      else
-	pix[0][c] = CLIP((guess[0]+guess[1]) >> 2);
-    }
+  });
 }
 
 void CLASS cielab (ushort rgb[3], short lab[3])
 {
   int c, i, j, k;
   float r, xyz[3];
-  static float cbrt[0x10000], xyz_cam[3][4];
+  float (&cbrt)[0x10000] = cielab_cbrt, (&xyz_cam)[3][4] = cielab_xyz_cam;
 
   if (!rgb) {
     for (i=0; i < 0x10000; i++) {
@@ -4180,107 +4591,127 @@ void CLASS xtrans_interpolate (int passes)
    Adaptive Homogeneity-Directed interpolation is based on
    the work of Keigo Hirakawa, Thomas Parks, and Paul Lee.
  */
+/*
+   Tiles only read the raw colors of the image, which the results of
+   the other tiles leave unchanged, and write disjoint areas: they are
+   interpolated in parallel, each thread with its own buffer.
+ */
 void CLASS ahd_interpolate()
 {
-  int i, j, top, left, row, col, tr, tc, c, d, val, hm[2];
-  static const int dir[4] = { -1, 1, -TS, TS };
-  unsigned ldiff[2][4], abdiff[2][4], leps, abeps;
-  ushort (*rgb)[TS][TS][3], (*rix)[3], (*pix)[4];
-   short (*lab)[TS][TS][3], (*lix)[3];
-   char (*homo)[TS][TS], *buffer;
+  int top, left, ntiles, parts;
+  std::vector<int> tiles;
+  char *buffer;
 
   if (verbose) fprintf (stderr,_("AHD interpolation...\n"));
 
   cielab (0,0);
   border_interpolate(5);
-  buffer = (char *) malloc (26*TS*TS);
+  for (top=2; top < height-5; top += TS-6)
+    for (left=2; left < width-5; left += TS-6) {
+      tiles.push_back (top);
+      tiles.push_back (left);
+    }
+  ntiles = tiles.size() / 2;
+  parts = parallel_parts (0, ntiles, 1);
+  buffer = (char *) malloc (26*TS*TS*parts);
   merror (buffer, "ahd_interpolate()");
+  parallel_for (0, ntiles, 1, [&] (int part, int first, int last) {
+    for (int tile=first; tile < last; tile++)
+      ahd_interpolate_tile (tiles[tile*2], tiles[tile*2+1], buffer + 26*TS*TS*part);
+  });
+  free (buffer);
+}
+
+void CLASS ahd_interpolate_tile (int top, int left, char *buffer)
+{
+  int i, j, row, col, tr, tc, c, d, val, hm[2];
+  static const int dir[4] = { -1, 1, -TS, TS };
+  unsigned ldiff[2][4], abdiff[2][4], leps, abeps;
+  ushort (*rgb)[TS][TS][3], (*rix)[3], (*pix)[4];
+   short (*lab)[TS][TS][3], (*lix)[3];
+   char (*homo)[TS][TS];
+
   rgb  = (ushort(*)[TS][TS][3]) buffer;
   lab  = (short (*)[TS][TS][3])(buffer + 12*TS*TS);
   homo = (char  (*)[TS][TS])   (buffer + 24*TS*TS);
 
-  for (top=2; top < height-5; top += TS-6)
-    for (left=2; left < width-5; left += TS-6) {
-
 /*  Interpolate green horizontally and vertically:		*/
-      for (row=top; row < top+TS && row < height-2; row++) {
-	col = left + (FC(row,left) & 1);
-	for (c = FC(row,col); col < left+TS && col < width-2; col+=2) {
-	  pix = image + row*width+col;
-	  val = ((pix[-1][1] + pix[0][c] + pix[1][1]) * 2
-		- pix[-2][c] - pix[2][c]) >> 2;
-	  rgb[0][row-top][col-left][1] = ULIM(val,pix[-1][1],pix[1][1]);
-	  val = ((pix[-width][1] + pix[0][c] + pix[width][1]) * 2
-		- pix[-2*width][c] - pix[2*width][c]) >> 2;
-	  rgb[1][row-top][col-left][1] = ULIM(val,pix[-width][1],pix[width][1]);
-	}
-      }
+  for (row=top; row < top+TS && row < height-2; row++) {
+    col = left + (FC(row,left) & 1);
+    for (c = FC(row,col); col < left+TS && col < width-2; col+=2) {
+      pix = image + row*width+col;
+      val = ((pix[-1][1] + pix[0][c] + pix[1][1]) * 2
+	    - pix[-2][c] - pix[2][c]) >> 2;
+      rgb[0][row-top][col-left][1] = ULIM(val,pix[-1][1],pix[1][1]);
+      val = ((pix[-width][1] + pix[0][c] + pix[width][1]) * 2
+	    - pix[-2*width][c] - pix[2*width][c]) >> 2;
+      rgb[1][row-top][col-left][1] = ULIM(val,pix[-width][1],pix[width][1]);
+    }
+  }
 /*  Interpolate red and blue, and convert to CIELab:		*/
-      for (d=0; d < 2; d++)
-	for (row=top+1; row < top+TS-1 && row < height-3; row++)
-	  for (col=left+1; col < left+TS-1 && col < width-3; col++) {
-	    pix = image + row*width+col;
-	    rix = &rgb[d][row-top][col-left];
-	    lix = &lab[d][row-top][col-left];
-	    if ((c = 2 - FC(row,col)) == 1) {
-	      c = FC(row+1,col);
-	      val = pix[0][1] + (( pix[-1][2-c] + pix[1][2-c]
-				 - rix[-1][1] - rix[1][1] ) >> 1);
-	      rix[0][2-c] = CLIP(val);
-	      val = pix[0][1] + (( pix[-width][c] + pix[width][c]
-				 - rix[-TS][1] - rix[TS][1] ) >> 1);
-	    } else
-	      val = rix[0][1] + (( pix[-width-1][c] + pix[-width+1][c]
-				 + pix[+width-1][c] + pix[+width+1][c]
-				 - rix[-TS-1][1] - rix[-TS+1][1]
-				 - rix[+TS-1][1] - rix[+TS+1][1] + 1) >> 2);
-	    rix[0][c] = CLIP(val);
-	    c = FC(row,col);
-	    rix[0][c] = pix[0][c];
-	    cielab (rix[0],lix[0]);
-	  }
+  for (d=0; d < 2; d++)
+    for (row=top+1; row < top+TS-1 && row < height-3; row++)
+      for (col=left+1; col < left+TS-1 && col < width-3; col++) {
+	pix = image + row*width+col;
+	rix = &rgb[d][row-top][col-left];
+	lix = &lab[d][row-top][col-left];
+	if ((c = 2 - FC(row,col)) == 1) {
+	  c = FC(row+1,col);
+	  val = pix[0][1] + (( pix[-1][2-c] + pix[1][2-c]
+			     - rix[-1][1] - rix[1][1] ) >> 1);
+	  rix[0][2-c] = CLIP(val);
+	  val = pix[0][1] + (( pix[-width][c] + pix[width][c]
+			     - rix[-TS][1] - rix[TS][1] ) >> 1);
+	} else
+	  val = rix[0][1] + (( pix[-width-1][c] + pix[-width+1][c]
+			     + pix[+width-1][c] + pix[+width+1][c]
+			     - rix[-TS-1][1] - rix[-TS+1][1]
+			     - rix[+TS-1][1] - rix[+TS+1][1] + 1) >> 2);
+	rix[0][c] = CLIP(val);
+	c = FC(row,col);
+	rix[0][c] = pix[0][c];
+	cielab (rix[0],lix[0]);
+      }
 /*  Build homogeneity maps from the CIELab images:		*/
-      memset (homo, 0, 2*TS*TS);
-      for (row=top+2; row < top+TS-2 && row < height-4; row++) {
-	tr = row-top;
-	for (col=left+2; col < left+TS-2 && col < width-4; col++) {
-	  tc = col-left;
-	  for (d=0; d < 2; d++) {
-	    lix = &lab[d][tr][tc];
-	    for (i=0; i < 4; i++) {
-	       ldiff[d][i] = ABS(lix[0][0]-lix[dir[i]][0]);
-	      abdiff[d][i] = SQR(lix[0][1]-lix[dir[i]][1])
-			   + SQR(lix[0][2]-lix[dir[i]][2]);
-	    }
-	  }
-	  leps = MIN(MAX(ldiff[0][0],ldiff[0][1]),
-		     MAX(ldiff[1][2],ldiff[1][3]));
-	  abeps = MIN(MAX(abdiff[0][0],abdiff[0][1]),
-		      MAX(abdiff[1][2],abdiff[1][3]));
-	  for (d=0; d < 2; d++)
-	    for (i=0; i < 4; i++)
-	      if (ldiff[d][i] <= leps && abdiff[d][i] <= abeps)
-		homo[d][tr][tc]++;
+  memset (homo, 0, 2*TS*TS);
+  for (row=top+2; row < top+TS-2 && row < height-4; row++) {
+    tr = row-top;
+    for (col=left+2; col < left+TS-2 && col < width-4; col++) {
+      tc = col-left;
+      for (d=0; d < 2; d++) {
+	lix = &lab[d][tr][tc];
+	for (i=0; i < 4; i++) {
+	   ldiff[d][i] = ABS(lix[0][0]-lix[dir[i]][0]);
+	  abdiff[d][i] = SQR(lix[0][1]-lix[dir[i]][1])
+		       + SQR(lix[0][2]-lix[dir[i]][2]);
 	}
       }
+      leps = MIN(MAX(ldiff[0][0],ldiff[0][1]),
+		 MAX(ldiff[1][2],ldiff[1][3]));
+      abeps = MIN(MAX(abdiff[0][0],abdiff[0][1]),
+		  MAX(abdiff[1][2],abdiff[1][3]));
+      for (d=0; d < 2; d++)
+	for (i=0; i < 4; i++)
+	  if (ldiff[d][i] <= leps && abdiff[d][i] <= abeps)
+	    homo[d][tr][tc]++;
+    }
+  }
 /*  Combine the most homogenous pixels for the final result:	*/
-      for (row=top+3; row < top+TS-3 && row < height-5; row++) {
-	tr = row-top;
-	for (col=left+3; col < left+TS-3 && col < width-5; col++) {
-	  tc = col-left;
-	  for (d=0; d < 2; d++)
-	    for (hm[d]=0, i=tr-1; i <= tr+1; i++)
-	      for (j=tc-1; j <= tc+1; j++)
-		hm[d] += homo[d][i][j];
-	  if (hm[0] != hm[1])
-	    FORC3 image[row*width+col][c] = rgb[hm[1] > hm[0]][tr][tc][c];
-	  else
-	    FORC3 image[row*width+col][c] =
-		(rgb[0][tr][tc][c] + rgb[1][tr][tc][c]) >> 1;
-	}
-      }
+  for (row=top+3; row < top+TS-3 && row < height-5; row++) {
+    tr = row-top;
+    for (col=left+3; col < left+TS-3 && col < width-5; col++) {
+      tc = col-left;
+      for (d=0; d < 2; d++)
+	for (hm[d]=0, i=tr-1; i <= tr+1; i++)
+	  for (j=tc-1; j <= tc+1; j++)
+	    hm[d] += homo[d][i][j];
+      if (hm[0] != hm[1])
+	FORC3 image[row*width+col][c] = rgb[hm[1] > hm[0]][tr][tc][c];
+      else
+	FORC3 image[row*width+col][c] =
+	    (rgb[0][tr][tc][c] + rgb[1][tr][tc][c]) >> 1;
     }
-  free (buffer);
+  }
 }
 #undef TS
 
@@ -4451,7 +4882,6 @@ void CLASS parse_thumb_note (int base, unsigned toff, unsigned tlen)
   }
 }
 
-int CLASS parse_tiff_ifd (int base);
 
 void CLASS parse_makernote (int base, int uptag)
 {
@@ -4979,8 +5409,6 @@ void CLASS parse_kodak_ifd (int base)
   }
 }
 
-void CLASS parse_minolta (int base);
-int CLASS parse_tiff (int base);
 
 int CLASS parse_tiff_ifd (int base)
 {
@@ -8744,6 +9172,35 @@ void CLASS convert_to_rgb()
 	_("Converting to %s colorspace...\n"), name[output_color-1]);
 
   memset (histogram, 0, sizeof histogram);
+#ifdef DCRAW_SSE2
+  /* The matrix as columns, summed in the order of the scalar code */
+  if (!raw_color) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i keep = _mm_setr_epi32 (-1, -1, -1, 0);
+    const __m128i bias = _mm_set1_epi32 (0x8000);
+    const __m128i sign = _mm_set1_epi16 ((short) 0x8000);
+    const __m128 vmax = _mm_set1_ps (65535);
+    __m128 col_cam[4], pix, acc;
+    __m128i in, res;
+    FORCC col_cam[c] = _mm_setr_ps (out_cam[0][c], out_cam[1][c], out_cam[2][c], 0);
+    for (img=image[0], row=0; row < height; row++)
+      for (col=0; col < width; col++, img+=4) {
+	in = _mm_unpacklo_epi16 (_mm_loadl_epi64 ((__m128i *) img), zero);
+	pix = _mm_cvtepi32_ps (in);
+	acc = _mm_mul_ps (col_cam[0], _mm_shuffle_ps (pix, pix, 0x00));
+	acc = _mm_add_ps (acc, _mm_mul_ps (col_cam[1], _mm_shuffle_ps (pix, pix, 0x55)));
+	acc = _mm_add_ps (acc, _mm_mul_ps (col_cam[2], _mm_shuffle_ps (pix, pix, 0xaa)));
+	if (colors == 4)
+	  acc = _mm_add_ps (acc, _mm_mul_ps (col_cam[3], _mm_shuffle_ps (pix, pix, 0xff)));
+	res = _mm_cvttps_epi32 (_mm_max_ps (_mm_min_ps (acc, vmax), _mm_setzero_ps()));
+	res = _mm_or_si128 (_mm_and_si128 (keep, res), _mm_andnot_si128 (keep, in));
+	res = _mm_sub_epi32 (res, bias);
+	res = _mm_xor_si128 (_mm_packs_epi32 (res, res), sign);
+	_mm_storel_epi64 ((__m128i *) img, res);
+	FORCC histogram[c][img[c] >> 3]++;
+      }
+  } else
+#endif
   for (img=image[0], row=0; row < height; row++)
     for (col=0; col < width; col++, img+=4) {
       if (!raw_color) {
@@ -8794,7 +9251,7 @@ void CLASS fuji_rotate()
 	  (pix[    0][i]*(1-fc) + pix[      1][i]*fc) * (1-fr) +
 	  (pix[width][i]*(1-fc) + pix[width+1][i]*fc) * fr;
     }
-  free (image);
+  free_image();
   width  = wide;
   height = high;
   image  = img;
@@ -8834,7 +9291,7 @@ void CLASS stretch()
     }
     width = newdim;
   }
-  free (image);
+  free_image();
   image = img;
 }
 
@@ -9037,16 +9494,19 @@ void CLASS write_ppm_tiff()
   free (ppm);
 }
 
-namespace dcraw
-{
-
 /**
- * @brief read raw data
+ * @brief decode the opened image, up to the output curve
  * @param interpolationQuality user interpolation quality [0-3]
+ * @return false if the image can't be decoded
  */
-boost::shared_array<ushort> getRawData( const int interpolationQuality )
+bool CLASS decode( const int interpolationQuality )
 {
     int use_fuji_rotate=1;
+    if ( !ifp || !is_raw || !load_raw )
+    {
+        return false;
+    }
+    std::chrono::steady_clock::time_point stage = std::chrono::steady_clock::now();
     fseeko (ifp, data_offset, SEEK_SET);
 
     if (load_raw == &CLASS kodak_ycbcr_load_raw)
@@ -9054,40 +9514,45 @@ boost::shared_array<ushort> getRawData( const int interpolationQuality )
         height += height & 1;
         width  += width  & 1;
     }
+    shrink = filters && half_size;
     iheight = (height + shrink) >> shrink;
     iwidth  = (width  + shrink) >> shrink;
 
+    free_image();
     if (filters || colors == 1)
     {
-        if ( raw_image ) free( raw_image );
-        raw_image = (ushort *) calloc( (raw_height+7), raw_width*2 );
-        merror (raw_image, "main()");
+        raw_image = (ushort *) decode_buffer( raw_buffer, raw_buffer_size, (size_t) (raw_height+7) * raw_width*2 );
     }
     else
     {
-        if ( image ) free( image );
-        image = (ushort (*)[4]) calloc( iheight, iwidth*sizeof *image );
-        merror (image, "main()");
+        image = (ushort (*)[4]) decode_buffer( image_buffer, image_buffer_size, (size_t) iheight * iwidth*sizeof *image );
     }
     
-    (*load_raw)();
+    (this->*load_raw)();
 
-    int c, row, col, rstep;
-
-    iheight = height;
-    iwidth  = width;
-
-    if (flip & 4) SWAP(height,width);
+    int c;
 
     if (raw_image)
     {
-        if ( image ) free( image );
-        image = (ushort (*)[4]) calloc (iheight, iwidth*sizeof *image);
-        merror (image, "main()");
+        free_image();
+        image = (ushort (*)[4]) decode_buffer( image_buffer, image_buffer_size, (size_t) iheight * iwidth*sizeof *image );
         crop_masked_pixels();
-        free (raw_image);
         raw_image = NULL;
     }
+    timings.loadRaw = stage_time (stage);
+
+    // Only the cropped part and its border go thru the processing
+    int area[4], region[4];
+    const int cropped = crop_region( area, region );
+    if (cropped)
+    {
+        crop_image( region[0] >> shrink, region[1] >> shrink,
+                    (region[2] + shrink) >> shrink, (region[3] + shrink) >> shrink );
+        top_margin  += region[0];
+        left_margin += region[1];
+        height = region[2];
+        width  = region[3];
+    }
 
     int quality = 2 + !fuji_width;
     if ( interpolationQuality >= 0 ) quality = interpolationQuality;
@@ -9107,6 +9572,7 @@ boost::shared_array<ushort> getRawData( const int interpolationQuality )
 
     scale_colors();
     pre_interpolate();
+    timings.scale = stage_time (stage);
     if (filters && !document_mode) {
       if (quality == 0)
 	lin_interpolate();
@@ -9119,6 +9585,7 @@ boost::shared_array<ushort> getRawData( const int interpolationQuality )
       else
 	ahd_interpolate();
     }
+    timings.interpolate = stage_time (stage);
     if (mix_green)
       for (colors=3, i=0; i < height*width; i++)
 	image[i][1] = (image[i][1] + image[i][3]) >> 1;
@@ -9131,12 +9598,18 @@ boost::shared_array<ushort> getRawData( const int interpolationQuality )
 #endif
     convert_to_rgb();
     if (use_fuji_rotate) stretch();
+    if (cropped)
+    {
+        crop_image( area[0] - (region[0] >> shrink), area[1] - (region[1] >> shrink),
+                    area[2], area[3] );
+        height = iheight;
+        width  = iwidth;
+    }
 
-    // Now read image
-    boost::shared_array<ushort> ppm2( new ushort[ height * width * colors ] );
-
-    assert( image );
-    assert( curve );
+    // Output dimensions, the image is read thru flip_index()
+    iheight = height;
+    iwidth  = width;
+    if (flip & 4) SWAP(height,width);
 
     int perc, val, total, white=0x2000;
     perc = width * height * 0.01;		/* 99th percentile white level */
@@ -9149,62 +9622,104 @@ boost::shared_array<ushort> getRawData( const int interpolationQuality )
         if (white < val) white = val;
       }
     }
-    gamma_curve( gamm[0], gamm[1], 2, (white << 3) / bright );
+    output_white = (white << 3) / bright;
+    gamma_curve( gamm[0], gamm[1], 2, output_white );
 
-    int soff  = flip_index (0, 0);
-    int cstep = flip_index (0, 1) - soff;
-    rstep = flip_index (1, 0) - flip_index ( 0, width );
-    for ( row = 0; row < height; row++, soff += rstep )
+    // 8 bits and float output tables, the gamma ones match the 16 bits output
+    byte_curve.resize( 0x10000 );
+    float_curve.resize( 0x10000 );
+    linear_curve.resize( 0x10000 );
+    for ( i = 0; i < 0x10000; i++ )
     {
-        const int rwc = row * width * colors;
-        for (col=0; col < width; col++, soff += cstep)
-        {
-            const int cc = col * colors;
-            for (c=0; c < colors; ++c)
-            {
-                ppm2[ rwc + cc + c ] = curve[image[soff][c]];
-            }
-        }
+        byte_curve[i] = curve[i] >> 8;
+        float_curve[i] = curve[i] / 65535.0f;
+        linear_curve[i] = i < output_white ? (float) i / output_white : 1.0f;
     }
-
-    return ppm2;
+    timings.convert = stage_time (stage);
+    return true;
 }
 
 /**
- * @brief read raw image header
- * @param[out] w width
- * @param[out] h height
+ * @brief read raw data
+ * @param interpolationQuality user interpolation quality [0-3]
  */
-void readDimensions( int & w, int & h )
+boost::shared_array<ushort> CLASS getRawData( const int interpolationQuality )
 {
-    w = width;
-    h = height;
+    boost::shared_array<ushort> ppm2;
+    if ( !decode( interpolationQuality ) )
+    {
+        return ppm2;
+    }
+    ppm2.reset( new ushort[ height * width * colors ] );
+    for ( int row = 0; row < height; row++ )
+    {
+        output_row( row, &ppm2[ row * width * colors ], (int) colors );
+    }
+    return ppm2;
 }
 
-/**
- * @brief get number of used channels
- * @return the number of channels in {1,3,4}
+/*
+   Output of the decoded image, one row at a time, in a single pass from
+   the image thru the flip to the destination with the output table
+   applied.  The destination has the colors of the image, or is RGB or
+   RGBA: 1 color images are written as gray RGB, alpha is the maximum.
  */
-int numberOfChannel()
+template<typename T>
+void CLASS output_row (int row, T *dst, int nchannels, const T *table, T alpha)
 {
-    return colors;
+  int col, c, soff, cstep;
+  ushort *pix;
+
+  soff  = flip_index (row, 0);
+  cstep = flip_index (0, 1) - flip_index (0, 0);
+  if (nchannels == (int) colors) {
+    for (col=0; col < width; col++, soff += cstep, dst += nchannels)
+      FORCC dst[c] = table[image[soff][c]];
+    return;
+  }
+  for (col=0; col < width; col++, soff += cstep, dst += nchannels) {
+    pix = image[soff];
+    if (colors == 1)
+      dst[0] = dst[1] = dst[2] = table[pix[0]];
+    else
+      FORC3 dst[c] = table[pix[c]];
+    if (nchannels > 3)
+      dst[3] = alpha;
+  }
+}
+
+void CLASS output_row (int row, uchar *dst, int nchannels)
+{
+  output_row (row, dst, nchannels, &byte_curve[0], (uchar) 0xff);
+}
+
+void CLASS output_row (int row, ushort *dst, int nchannels)
+{
+  output_row (row, dst, nchannels, curve, (ushort) 0xffff);
+}
+
+void CLASS output_row (int row, float *dst, int nchannels, bool linear)
+{
+  output_row (row, dst, nchannels, linear ? &linear_curve[0] : &float_curve[0], 1.0f);
 }
 
 /**
  * @brief open a raw image
  * @warning need to be called before all
  */
-bool openRaw( const boost::filesystem::path & filename )
+bool CLASS openRaw( const boost::filesystem::path & path )
 {
-    const std::string sFilename = filename.string();
-    ifname = sFilename.c_str();
     cleanup();
+    filename = path.string();
+    ifname = filename.c_str();
     if ( !( ifp = fopen (ifname, "rb") ) )
     {
         perror( ifname );
         return false;
     }
+    std::chrono::steady_clock::time_point stage = std::chrono::steady_clock::now();
     identify();
+    timings.identify = stage_time (stage);
     return true;
 }
 
@@ -9212,7 +9727,7 @@ bool openRaw( const boost::filesystem::path & filename )
  * @brief cleanup dcraw internal data
  * @warning need to be called each time you call getRawData
  */
-void cleanup()
+void CLASS cleanup()
 {
     if ( meta_data )
     {
@@ -9224,16 +9739,9 @@ void cleanup()
         free( oprof );
         oprof = NULL;
     }
-    if ( image )
-    {
-        free( image );
-        image = NULL;
-    }
-    if (raw_image)
-    {
-        free (raw_image);
-        raw_image = NULL;
-    }
+    // The decode buffers are kept for the next image
+    free_image();
+    raw_image = NULL;
     if ( ifp )
     {
         fclose( ifp );
@@ -9241,4 +9749,298 @@ void cleanup()
     }
 }
 
+/*
+   The crop is done on the sensor pixels:  images rotated (fuji) or
+   stretched to their output shape are always processed whole.
+ */
+bool CLASS croppable()
+{
+  return !fuji_width && pixel_aspect == 1;
+}
+
+/*
+   Size of the full size output image of the opened file, as decode()
+   gives it:  after the fuji rotation, the stretch and the flip.
+ */
+void CLASS output_size (int &wide, int &high)
+{
+  double step;
+  int fwidth;
+
+  wide = width;
+  high = height;
+  if (fuji_width) {
+    fwidth = fuji_width - 1;
+    step = sqrt(0.5);
+    wide = (ushort) (fwidth / step);
+    high = (ushort) ((height - fwidth) / step);
+  }
+  if (pixel_aspect < 1)
+    high = (ushort) (high / pixel_aspect + 0.5);
+  else if (pixel_aspect > 1)
+    wide = (ushort) (wide * pixel_aspect + 0.5);
+  if (flip & 4) SWAP(wide,high);
+}
+
+/*
+   Map the output crop (full size output pixels) to the image before the
+   flip:  area is the cropped part in the pixels of the decoded image
+   (shrunk for half size outputs), region the processed part of the
+   sensor, with a border for the interpolations, aligned on the color
+   filter and black level patterns.  Returns 0 to process the whole image.
+ */
+int CLASS crop_region (int area[4], int region[4])
+{
+  int high, wide, top, left, bottom, right, rstep, cstep, i;
+
+  if (crop_width <= 0 || crop_height <= 0 || !croppable())
+    return 0;
+  high   = (height + shrink) >> shrink;
+  wide   = (width  + shrink) >> shrink;
+  top    = MAX(crop_top, 0) >> shrink;
+  left   = MAX(crop_left, 0) >> shrink;
+  bottom = (crop_top  + crop_height + shrink) >> shrink;
+  right  = (crop_left + crop_width  + shrink) >> shrink;
+  if (flip & 4) {
+    SWAP(top,left);
+    SWAP(bottom,right);
+  }
+  bottom = MIN(bottom, high);
+  right  = MIN(right, wide);
+  if (top >= bottom || left >= right) return 0;
+  if (flip & 2) {
+    i = top;
+    top = high - bottom;
+    bottom = high - i;
+  }
+  if (flip & 1) {
+    i = left;
+    left = wide - right;
+    right = wide - i;
+  }
+  area[0] = top;
+  area[1] = left;
+  area[2] = bottom - top;
+  area[3] = right - left;
+
+  rstep = filters == 9 ? 6 : 8;
+  cstep = filters == 9 ? 6 : 2;
+  if (cblack[4] && cblack[5]) {
+    for (i=rstep; i % (cblack[4] << shrink); i += rstep);
+    rstep = i;
+    for (i=cstep; i % (cblack[5] << shrink); i += cstep);
+    cstep = i;
+  }
+  top    = MAX((top << shrink) - 8, 0);
+  left   = MAX((left << shrink) - 8, 0);
+  region[0] = top - top % rstep;
+  region[1] = left - left % cstep;
+  region[2] = MIN((bottom << shrink) + 8, height) - region[0];
+  region[3] = MIN((right << shrink) + 8, width) - region[1];
+  return 1;
+}
+
+/*
+   Keep a part of the image:  its rows are moved to the start of the
+   buffer, iheight and iwidth become the size of the part.
+ */
+void CLASS crop_image (int top, int left, int high, int wide)
+{
+  int row;
+
+  high = MIN(high, iheight - top);
+  wide = MIN(wide, iwidth - left);
+  for (row=0; row < high; row++)
+    memmove (image[row*wide], image[(row+top)*iwidth+left], wide * sizeof *image);
+  iheight = high;
+  iwidth  = wide;
+}
+
+/*
+   The raw and decoded images are written in buffers kept from an image
+   to the next: the frames of a roll have the same size, their memory is
+   reused instead of being mapped, zeroed by the kernel and unmapped for
+   each frame.  Reused buffers are zeroed as the loaders expect.
+ */
+void * CLASS decode_buffer (void *&buffer, size_t &buffer_size, size_t size)
+{
+  if (buffer && buffer_size == size) {
+    memset (buffer, 0, size);
+    return buffer;
+  }
+  free (buffer);
+  buffer_size = 0;
+  buffer = calloc (size, 1);
+  merror (buffer, "decode_buffer()");
+  buffer_size = size;
+  return buffer;
+}
+
+/*
+   Microseconds since start, start becomes now:  the decode stages are
+   timed one after the other.
+ */
+double CLASS stage_time (std::chrono::steady_clock::time_point &start)
+{
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  const double elapsed = std::chrono::duration<double, std::micro> (now - start).count();
+  start = now;
+  return elapsed;
+}
+
+/*
+   Release the decoded image, unless it is the kept buffer.
+ */
+void CLASS free_image()
+{
+  if (image != image_buffer) free (image);
+  image = NULL;
+}
+
+CLASS ~DecoderContext()
+{
+  free_image();
+  free (raw_buffer);
+  free (image_buffer);
+}
+
+namespace dcraw
+{
+
+Decoder::Decoder()
+: _context( new DecoderContext() )
+{
+}
+
+Decoder::~Decoder()
+{
+    cleanup();
+}
+
+/**
+ * @brief read raw data
+ * @param interpolationQuality user interpolation quality [0-3]
+ */
+boost::shared_array<ushort> Decoder::getRawData( const int interpolationQuality )
+{
+    return _context->getRawData( interpolationQuality );
+}
+
+/**
+ * @brief decode the opened image
+ * @param interpolationQuality user interpolation quality [0-3]
+ */
+bool Decoder::decode( const int interpolationQuality )
+{
+    return _context->decode( interpolationQuality );
+}
+
+/**
+ * @brief write a row of the decoded image
+ */
+void Decoder::readRow( const int row, boost::uint8_t* dst, const int nbChannels ) const
+{
+    _context->output_row( row, dst, nbChannels );
+}
+
+void Decoder::readRow( const int row, boost::uint16_t* dst, const int nbChannels ) const
+{
+    _context->output_row( row, dst, nbChannels );
+}
+
+void Decoder::readRow( const int row, float* dst, const int nbChannels, const bool linear ) const
+{
+    _context->output_row( row, dst, nbChannels, linear );
+}
+
+/**
+ * @brief read raw image header
+ * @param[out] w width
+ * @param[out] h height
+ */
+void Decoder::readDimensions( int & w, int & h ) const
+{
+    w = _context->width;
+    h = _context->height;
+}
+
+/**
+ * @brief get number of used channels
+ * @return the number of channels in {1,3,4}
+ */
+int Decoder::numberOfChannel() const
+{
+    return _context->colors;
+}
+
+/**
+ * @brief get the header of the opened image
+ */
+Header Decoder::header() const
+{
+    Header header;
+    _context->output_size( header.width, header.height );
+    header.colors = _context->colors;
+    header.croppable = _context->croppable();
+    return header;
+}
+
+/**
+ * @brief durations of the stages of the last openRaw and decode
+ */
+DecodeTimings Decoder::timings() const
+{
+    return _context->timings;
+}
+
+/**
+ * @brief open a raw image
+ * @warning need to be called before all
+ */
+bool Decoder::openRaw( const boost::filesystem::path & filename )
+{
+    return _context->openRaw( filename );
+}
+
+/**
+ * @brief set the number of threads of the interpolations
+ * @param n number of threads, 0 for one per core
+ */
+void Decoder::setNumberOfThreads( const int n )
+{
+    _context->nthreads = n;
+}
+
+/**
+ * @brief half size decoding, without interpolation
+ * @param halfSize enable the half size decoding
+ */
+void Decoder::setHalfSize( const bool halfSize )
+{
+    _context->half_size = halfSize;
+}
+
+/**
+ * @brief decode a part of the image only
+ * @param left left of the part (full size output pixels)
+ * @param top top of the part
+ * @param width width of the part, 0 to decode the whole image
+ * @param height height of the part, 0 to decode the whole image
+ */
+void Decoder::setCrop( const int left, const int top, const int width, const int height )
+{
+    _context->crop_left = left;
+    _context->crop_top = top;
+    _context->crop_width = width;
+    _context->crop_height = height;
+}
+
+/**
+ * @brief cleanup dcraw internal data
+ */
+void Decoder::cleanup()
+{
+    _context->cleanup();
+}
+
 }
@@ -9,35 +9,148 @@
 #include <boost/gil/gil_all.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/shared_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/mpl/bool.hpp>
+#include <boost/type_traits/is_pointer.hpp>
+#include <boost/type_traits/is_same.hpp>
+#include <algorithm>
 #include <string>
 #include <iostream>
+#include <vector>
 
 namespace dcraw
 {
-    /**
-     * @brief read raw data
-     * @param user_quality user interpolation quality [0-3]
-     */
-    boost::shared_array<ushort> getRawData( const int interpolationQuality = 3 );
+    struct DecoderContext;
 
     /**
-     * @brief open a raw image
-     * @warning need to be called before all
+     * @brief raw image header, as read by openRaw
      */
-    bool openRaw( const boost::filesystem::path & filename );
+    struct Header
+    {
+        int width;      ///< full size output width (after the rotation, stretch and flip of the sensor image)
+        int height;     ///< full size output height
+        int colors;     ///< number of channels in {1,3,4}
+        bool croppable; ///< setCrop is supported, rotated or stretched images are always decoded whole
+    };
 
     /**
-     * @brief cleanup dcraw internal data
+     * @brief durations of the decoding stages (microseconds)
      */
-    void cleanup();
+    struct DecodeTimings
+    {
+        double identify;        ///< openRaw: parsing of the file header
+        double loadRaw;         ///< reading and unpacking of the raw data
+        double scale;           ///< black levels, white balance and pre interpolation
+        double interpolate;     ///< demosaicing
+        double convert;         ///< post processing, conversion to the output colorspace and output curve
+    };
 
     /**
-     * @brief read raw image header
-     * @param[out] w width
-     * @param[out] h height
+     * @brief raw image decoder
+     * A decoder owns the whole dcraw state of a decode (file, header, buffers
+     * and tables), several raw images may be decoded concurrently, one decoder
+     * each. A decoder shall not be used by two threads at the same time.
      */
-    void readDimensions( int & w, int & h );
+    class Decoder : boost::noncopyable
+    {
+    public:
+        Decoder();
+        ~Decoder();
+
+        /**
+         * @brief read raw data
+         * @param user_quality user interpolation quality [0-3]
+         */
+        boost::shared_array<ushort> getRawData( const int interpolationQuality = 3 );
+
+        /**
+         * @brief decode the opened image, readDimensions then gives the output dimensions
+         * @param interpolationQuality user interpolation quality [0-3]
+         * @return false if the image can't be decoded
+         */
+        bool decode( const int interpolationQuality = 3 );
+
+        /**
+         * @brief write a row of the decoded image, the output curve applied
+         * The destination has numberOfChannel() channels, or is RGB or RGBA
+         * (gray images are written as gray RGB, alpha is the maximum value).
+         * @param row output row
+         * @param dst destination row
+         * @param nbChannels number of channels of the destination
+         * @param linear float rows only: skip the gamma curve, values are linear in 0..1
+         */
+        void readRow( const int row, boost::uint8_t* dst, const int nbChannels ) const;
+        void readRow( const int row, boost::uint16_t* dst, const int nbChannels ) const;
+        void readRow( const int row, float* dst, const int nbChannels, const bool linear = false ) const;
+
+        /**
+         * @brief open a raw image
+         * @warning need to be called before all
+         */
+        bool openRaw( const boost::filesystem::path & filename );
+
+        /**
+         * @brief cleanup dcraw internal data
+         */
+        void cleanup();
+
+        /**
+         * @brief set the number of threads of the interpolations
+         * @param n number of threads, 0 for one per core
+         */
+        void setNumberOfThreads( const int n );
+
+        /**
+         * @brief half size decoding: each 2x2 block of the sensor gives one
+         * pixel, without interpolation (fast preview)
+         * @warning need to be called before openRaw
+         * @param halfSize enable the half size decoding
+         */
+        void setHalfSize( const bool halfSize );
+
+        /**
+         * @brief decode a part of the image only
+         * Only the part and a border for the interpolation are processed,
+         * readDimensions then gives the size of the part. The automatic
+         * brightness is computed on the part. Images which are not
+         * croppable (see Header) are decoded whole.
+         * @warning need to be called before decode
+         * @param left left of the part (full size output pixels)
+         * @param top top of the part
+         * @param width width of the part, 0 to decode the whole image
+         * @param height height of the part, 0 to decode the whole image
+         */
+        void setCrop( const int left, const int top, const int width, const int height );
+
+        /**
+         * @brief read raw image header
+         * @param[out] w width
+         * @param[out] h height
+         */
+        void readDimensions( int & w, int & h ) const;
+
+        /**
+         * @brief get number of used channels
+         * @return the number of channels in {1,3,4}
+         */
+        int numberOfChannel() const;
+
+        /**
+         * @brief get the header of the opened image
+         */
+        Header header() const;
+
+        /**
+         * @brief durations of the stages of the last openRaw and decode
+         */
+        DecodeTimings timings() const;
+
+    private:
+        boost::scoped_ptr<DecoderContext> _context;
+    };
 
     /**
      * @brief read raw image header
@@ -47,63 +160,169 @@ namespace dcraw
      */
     inline void readDimensions( const boost::filesystem::path & filename, int & w, int & h )
     {
-        openRaw( filename );
-        readDimensions( w, h );
+        Decoder decoder;
+        decoder.openRaw( filename );
+        decoder.readDimensions( w, h );
     }
 
     /**
-     * @brief get number of used channels
-     * @return the number of channels in {1,3,4}
+     * @brief read raw image header
+     * @param[in] filename input filename
+     * @param[out] header image header
+     * @return false if the file can't be opened
      */
-    int numberOfChannel();
+    inline bool readHeader( const boost::filesystem::path & filename, Header & header )
+    {
+        Decoder decoder;
+        if ( !decoder.openRaw( filename ) )
+        {
+            return false;
+        }
+        header = decoder.header();
+        return true;
+    }
+
+    namespace detail
+    {
+        /// @brief channel types the decoder writes
+        template<typename Channel> struct IsDecoderChannel : boost::mpl::false_ {};
+        template<> struct IsDecoderChannel<boost::uint8_t> : boost::mpl::true_ {};
+        template<> struct IsDecoderChannel<boost::uint16_t> : boost::mpl::true_ {};
+        template<> struct IsDecoderChannel<float> : boost::mpl::true_ {};
+
+        /// @brief views the decoder writes in: interleaved RGB or RGBA rows of a decoder channel type
+        template<class DView>
+        struct IsDecoderView
+        {
+            typedef typename boost::gil::channel_type<DView>::type Channel;
+            typedef typename boost::gil::base_channel_type<Channel>::type RawChannel;
+            typedef typename DView::value_type Pixel;
+            static const bool value = boost::is_pointer<typename DView::x_iterator>::value &&
+                                      IsDecoderChannel<RawChannel>::value &&
+                                      ( boost::is_same<Pixel, boost::gil::pixel<Channel, boost::gil::rgb_layout_t> >::value ||
+                                        boost::is_same<Pixel, boost::gil::pixel<Channel, boost::gil::rgba_layout_t> >::value );
+            typedef boost::mpl::bool_<value> type;
+        };
+
+        inline void readRow( const Decoder & decoder, const int row, boost::uint8_t* dst, const int nbChannels, const bool )
+        {
+            decoder.readRow( row, dst, nbChannels );
+        }
+
+        inline void readRow( const Decoder & decoder, const int row, boost::uint16_t* dst, const int nbChannels, const bool )
+        {
+            decoder.readRow( row, dst, nbChannels );
+        }
+
+        inline void readRow( const Decoder & decoder, const int row, float* dst, const int nbChannels, const bool linear )
+        {
+            decoder.readRow( row, dst, nbChannels, linear );
+        }
+
+        /// @brief the decoder writes in the view rows
+        template<class DView>
+        void readRows( const Decoder & decoder, const DView & dst, const int width, const int height, const bool linear, boost::mpl::true_ )
+        {
+            typedef typename IsDecoderView<DView>::RawChannel RawChannel;
+            const int nbChannels = boost::gil::num_channels<DView>::value;
+            for( int y = 0; y < height; ++y )
+            {
+                readRow( decoder, y, reinterpret_cast<RawChannel*>( dst.row_begin( y ) ), nbChannels, linear );
+            }
+        }
+
+        /// @brief other views: float RGB rows, converted by boost::gil
+        template<class DView>
+        void readRows( const Decoder & decoder, const DView & dst, const int width, const int height, const bool linear, boost::mpl::false_ )
+        {
+            std::vector<boost::gil::rgb32f_pixel_t> row( width );
+            const boost::gil::rgb32f_view_t rowView = boost::gil::interleaved_view( width, 1, &row[0], sizeof( boost::gil::rgb32f_pixel_t ) * width );
+            for( int y = 0; y < height; ++y )
+            {
+                decoder.readRow( y, reinterpret_cast<float*>( &row[0] ), 3, linear );
+                boost::gil::copy_and_convert_pixels( rowView, boost::gil::subimage_view( dst, 0, y, width, 1 ) );
+            }
+        }
+
+        /// @brief destination of another size (render scale): nearest decoded pixels
+        template<class DView>
+        void readSampledRows( const Decoder & decoder, const DView & dst, const int width, const int height, const bool linear )
+        {
+            const int dstWidth = dst.width();
+            const int dstHeight = dst.height();
+            std::vector<boost::gil::rgb32f_pixel_t> row( width );
+            std::vector<boost::gil::rgb32f_pixel_t> sampled( dstWidth );
+            std::vector<int> columns( dstWidth );
+            for( int x = 0; x < dstWidth; ++x )
+            {
+                columns[x] = std::min( width - 1, static_cast<int>( ( 2 * x + 1 ) * static_cast<long long>( width ) / ( 2 * dstWidth ) ) );
+            }
+            const boost::gil::rgb32f_view_t sampledView = boost::gil::interleaved_view( dstWidth, 1, &sampled[0], sizeof( boost::gil::rgb32f_pixel_t ) * dstWidth );
+            int decodedRow = -1;
+            for( int y = 0; y < dstHeight; ++y )
+            {
+                const int sy = std::min( height - 1, static_cast<int>( ( 2 * y + 1 ) * static_cast<long long>( height ) / ( 2 * dstHeight ) ) );
+                if( sy != decodedRow )
+                {
+                    decoder.readRow( sy, reinterpret_cast<float*>( &row[0] ), 3, linear );
+                    for( int x = 0; x < dstWidth; ++x )
+                    {
+                        sampled[x] = row[columns[x]];
+                    }
+                    decodedRow = sy;
+                }
+                boost::gil::copy_and_convert_pixels( sampledView, boost::gil::subimage_view( dst, 0, y, dstWidth, 1 ) );
+            }
+        }
+    }
 
     /**
      * @brief read raw image
+     * The decoded image is written in the destination in a single pass,
+     * without intermediate 16 bits image. A destination of another size
+     * (half size decoding, render scale) gets the nearest decoded pixels.
+     * @param decoder the decoder
      * @param filename the input filename
      * @param dst the destination view
      * @param interpolationQuality quality of the interpolation in [0-3]
+     * @param linear skip the gamma curve (float outputs)
      * @return true or false, true if success
      */
     template<class DView>
-    bool readRaw( const boost::filesystem::path & filename, const DView & dst, const int interpolationQuality = 3 )
+    bool readRaw( Decoder & decoder, const boost::filesystem::path & filename, const DView & dst, const int interpolationQuality = 3, const bool linear = false )
     {
-        int iwidth = 0, iheight = 0;
-        openRaw( filename );
-        readDimensions( iwidth, iheight );
-        boost::shared_array<ushort> ppm2 = getRawData( interpolationQuality );
-        bool ret = (ppm2.get() != NULL);
-        if ( ret )
+        if ( !decoder.openRaw( filename ) || !decoder.decode( interpolationQuality ) )
         {
-            switch( numberOfChannel() )
-            {
-                case 1:
-                {
-                    boost::gil::gray16_view_t srcView = boost::gil::interleaved_view( iwidth, iheight, reinterpret_cast<boost::gil::gray16_pixel_t*>( ppm2.get() ), sizeof(ushort) * iwidth * 1 );
-                    boost::gil::copy_and_convert_pixels( srcView, dst );
-                    break;
-                }
-                case 3:
-                {
-                    boost::gil::rgb16_view_t srcView = boost::gil::interleaved_view( iwidth, iheight, reinterpret_cast<boost::gil::rgb16_pixel_t*>( ppm2.get() ), sizeof(ushort) * iwidth * 3 );
-                    boost::gil::copy_and_convert_pixels( srcView, dst );
-                    break;
-                }
-                case 4:
-                {
-                    boost::gil::rgba16_view_t srcView = boost::gil::interleaved_view( iwidth, iheight, reinterpret_cast<boost::gil::rgba16_pixel_t*>( ppm2.get() ), sizeof(ushort) * iwidth * 4 );
-                    boost::gil::copy_and_convert_pixels( srcView, dst );
-                    break;
-                }
-                default:
-                {
-                    std::cerr << "Invalid number of channels!" << std::endl;
-                    ret = false;
-                    break;
-                }
-            }
+            decoder.cleanup();
+            return false;
+        }
+        int width = 0, height = 0;
+        decoder.readDimensions( width, height );
+        if ( width == dst.width() && height == dst.height() )
+        {
+            detail::readRows( decoder, dst, width, height, linear, typename detail::IsDecoderView<DView>::type() );
+        }
+        else if ( width > 0 && height > 0 && dst.width() > 0 && dst.height() > 0 )
+        {
+            detail::readSampledRows( decoder, dst, width, height, linear );
         }
-        cleanup();
-        return ret;
+        decoder.cleanup();
+        return true;
+    }
+
+    /**
+     * @brief read raw image with its own decoder
+     * @param filename the input filename
+     * @param dst the destination view
+     * @param interpolationQuality quality of the interpolation in [0-3]
+     * @param linear skip the gamma curve (float outputs)
+     * @return true or false, true if success
+     */
+    template<class DView>
+    bool readRaw( const boost::filesystem::path & filename, const DView & dst, const int interpolationQuality = 3, const bool linear = false )
+    {
+        Decoder decoder;
+        return readRaw( decoder, filename, dst, interpolationQuality, linear );
     }
 }
 